@@ -0,0 +1,977 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Code Manipulation API Sample:
+ * heapprof.c
+ *
+ * Heap allocation profiler.  Uses the drwrap extension to wrap the
+ * allocator family (malloc, calloc, realloc, and free on Linux;
+ * RtlAllocateHeap, RtlReAllocateHeap, and RtlFreeHeap on Windows) and
+ * attributes every allocation to its callstack.  At exit, or on a nudge,
+ * the allocation sites holding the most live bytes are written to a log
+ * file, symbolized via the drsyms extension when SHOW_SYMBOLS is on.
+ *
+ * The wrapping callbacks are kept lean:
+ * - drwrap is put in its DRWRAP_NO_FRILLS and DRWRAP_FAST_CLEANCALLS modes.
+ * - Callstacks are gathered by walking frame pointers and are hash-consed:
+ *   each (frame pc, caller node) pair is stored once in a shared table
+ *   whose lookups take no lock, so a callstack is identified by a single
+ *   pointer to its innermost node.  A small per-thread cache short-circuits
+ *   even that lookup for callstacks seen recently.
+ * - Per-site statistics are accumulated in a per-thread table and only
+ *   merged into the shared per-site counters every -merge_every events,
+ *   at thread exit, and at process exit.  A nudge reports the merged
+ *   counters, which may thus lag slightly behind each thread's activity.
+ *
+ * The runtime options for this client include:
+ * -depth <N>       Number of frames to record per callstack (default 8,
+ *                  maximum 32).
+ * -top <N>         Number of allocation sites to report (default 32).
+ * -merge_every <N> Number of allocator events a thread accumulates
+ *                  privately before merging (default 1024).
+ * -logdir <dir>    Sets log directory, which by default is at the same
+ *                  directory as the client library.  It must be the last
+ *                  option.
+ *
+ * Callstacks are only complete for code compiled with frame pointers.
+ */
+
+#include "dr_api.h"
+#include "drmgr.h"
+#include "drwrap.h"
+#ifdef SHOW_SYMBOLS
+# include "drsyms.h"
+#endif
+#include <string.h> /* memset, strstr */
+
+#ifdef WINDOWS
+# define IF_WINDOWS(x) x
+# define IF_WINDOWS_ELSE(x,y) x
+# define DISPLAY_STRING(msg) dr_messagebox(msg)
+# define COMPILER_BARRIER() _ReadWriteBarrier()
+#else
+# define IF_WINDOWS(x) /* nothing */
+# define IF_WINDOWS_ELSE(x,y) y
+# define DISPLAY_STRING(msg) dr_printf("%s\n", msg);
+# define COMPILER_BARRIER() __asm__ __volatile__("" : : : "memory")
+#endif
+
+#define BUFFER_SIZE_BYTES(buf)      sizeof(buf)
+#define BUFFER_SIZE_ELEMENTS(buf)   (BUFFER_SIZE_BYTES(buf) / sizeof((buf)[0]))
+#define BUFFER_LAST_ELEMENT(buf)    (buf)[BUFFER_SIZE_ELEMENTS(buf) - 1]
+#define NULL_TERMINATE_BUFFER(buf)  BUFFER_LAST_ELEMENT(buf) = 0
+
+#ifdef DEBUG
+# define ASSERT(x, msg) DR_ASSERT_MSG(x, msg)
+#else
+# define ASSERT(x, msg) /* nothing */
+#endif
+
+#define MAX_DEPTH 32
+#define HASH_FUNC(val, bits) ((uint)((val) * 2654435769U) >> (32 - (bits)))
+
+typedef struct _heapprof_option_t {
+    uint depth;
+    uint top;
+    uint merge_every;
+    const char *logdir;
+} heapprof_option_t;
+static heapprof_option_t options = {8, 32, 1024, NULL};
+
+static client_id_t client_id;
+static int tls_idx;
+
+/****************************************************************************
+ * Callstack Table
+ *
+ * Each node represents one frame along with all of its callers: a
+ * callstack is identified by its innermost node.  Nodes are never
+ * removed until exit, which lets lookups walk the chains with no lock.
+ * Insertions are serialized per bucket stripe.
+ */
+
+typedef struct _callstack_node_t {
+    app_pc pc;
+    struct _callstack_node_t *caller;  /* NULL for the outermost frame */
+    struct _callstack_node_t *next;    /* hash chain */
+    /* Merged statistics for callstacks that end at this node.
+     * Protected by stats_lock.
+     */
+    uint64 num_allocs;
+    uint64 num_frees;
+    uint64 bytes_allocated;
+    uint64 bytes_freed;
+} callstack_node_t;
+
+#define CALLSTACK_TABLE_BITS 16
+#define CALLSTACK_LOCK_BITS  6
+static callstack_node_t * volatile callstack_table[1 << CALLSTACK_TABLE_BITS];
+static void *callstack_locks[1 << CALLSTACK_LOCK_BITS];
+static volatile int num_callstack_nodes;
+
+/* Protects the statistics fields of every callstack_node_t */
+static void *stats_lock;
+
+static inline uint
+callstack_node_hash(callstack_node_t *caller, app_pc pc)
+{
+    return HASH_FUNC((uint)(ptr_uint_t)pc ^ (uint)((ptr_uint_t)caller >> 4),
+                     CALLSTACK_TABLE_BITS);
+}
+
+static callstack_node_t *
+callstack_node_find(callstack_node_t *head, callstack_node_t *caller, app_pc pc)
+{
+    callstack_node_t *node;
+    for (node = head; node != NULL; node = node->next) {
+        if (node->pc == pc && node->caller == caller)
+            return node;
+    }
+    return NULL;
+}
+
+static callstack_node_t *
+callstack_node_intern(callstack_node_t *caller, app_pc pc)
+{
+    uint hash = callstack_node_hash(caller, pc);
+    void *lock;
+    callstack_node_t *node = callstack_node_find(callstack_table[hash], caller, pc);
+    if (node != NULL)
+        return node;
+    lock = callstack_locks[hash & ((1 << CALLSTACK_LOCK_BITS) - 1)];
+    dr_mutex_lock(lock);
+    /* re-check now that we hold the lock */
+    node = callstack_node_find(callstack_table[hash], caller, pc);
+    if (node == NULL) {
+        node = dr_global_alloc(sizeof(*node));
+        memset(node, 0, sizeof(*node));
+        node->pc = pc;
+        node->caller = caller;
+        node->next = callstack_table[hash];
+        /* lock-free readers must never see a partially-initialized node */
+        COMPILER_BARRIER();
+        callstack_table[hash] = node;
+        dr_atomic_add32_return_sum(&num_callstack_nodes, 1);
+    }
+    dr_mutex_unlock(lock);
+    return node;
+}
+
+/* Returns whether the callstack ending at node consists of exactly frames */
+static bool
+callstack_node_matches(callstack_node_t *node, app_pc *frames, uint num_frames)
+{
+    uint i;
+    for (i = 0; i < num_frames; i++) {
+        if (node == NULL || node->pc != frames[i])
+            return false;
+        node = node->caller;
+    }
+    return node == NULL;
+}
+
+static void
+callstack_table_init(void)
+{
+    uint i;
+    for (i = 0; i < BUFFER_SIZE_ELEMENTS(callstack_locks); i++)
+        callstack_locks[i] = dr_mutex_create();
+    stats_lock = dr_mutex_create();
+}
+
+static void
+callstack_table_exit(void)
+{
+    uint i;
+    for (i = 0; i < BUFFER_SIZE_ELEMENTS(callstack_table); i++) {
+        callstack_node_t *node, *next;
+        for (node = callstack_table[i]; node != NULL; node = next) {
+            next = node->next;
+            dr_global_free(node, sizeof(*node));
+        }
+        callstack_table[i] = NULL;
+    }
+    for (i = 0; i < BUFFER_SIZE_ELEMENTS(callstack_locks); i++)
+        dr_mutex_destroy(callstack_locks[i]);
+    dr_mutex_destroy(stats_lock);
+}
+
+/****************************************************************************
+ * Live Allocation Table
+ *
+ * Maps each live allocation to its size and callstack so that frees can
+ * be attributed.  The table is split into shards by address, each with
+ * its own lock, chains, and free list of entries.
+ */
+
+typedef struct _alloc_entry_t {
+    app_pc base;
+    size_t size;
+    callstack_node_t *site;
+    struct _alloc_entry_t *next;
+} alloc_entry_t;
+
+#define ALLOC_CHUNK_ENTRIES 256
+typedef struct _alloc_chunk_t {
+    struct _alloc_chunk_t *next;
+    alloc_entry_t entries[ALLOC_CHUNK_ENTRIES];
+} alloc_chunk_t;
+
+typedef struct _alloc_shard_t {
+    void *lock;
+    alloc_entry_t **buckets;
+    uint bits;
+    uint entries;
+    alloc_entry_t *free_list;
+    alloc_chunk_t *chunks;
+} alloc_shard_t;
+
+#define ALLOC_SHARD_BITS      6
+#define ALLOC_SHARD_INIT_BITS 10
+static alloc_shard_t alloc_shards[1 << ALLOC_SHARD_BITS];
+
+static inline alloc_shard_t *
+alloc_shard(app_pc base)
+{
+    /* malloc results are at least 8-aligned so skip the low bits */
+    return &alloc_shards[((ptr_uint_t)base >> 4) & ((1 << ALLOC_SHARD_BITS) - 1)];
+}
+
+static inline uint
+alloc_bucket(alloc_shard_t *shard, app_pc base)
+{
+    return HASH_FUNC((uint)((ptr_uint_t)base >> (4 + ALLOC_SHARD_BITS)), shard->bits);
+}
+
+/* Caller must hold shard->lock */
+static void
+alloc_shard_resize(alloc_shard_t *shard)
+{
+    alloc_entry_t **old_buckets = shard->buckets;
+    uint old_size = 1 << shard->bits;
+    uint i;
+    shard->bits++;
+    shard->buckets = dr_global_alloc(sizeof(alloc_entry_t *) << shard->bits);
+    memset(shard->buckets, 0, sizeof(alloc_entry_t *) << shard->bits);
+    for (i = 0; i < old_size; i++) {
+        alloc_entry_t *e, *next;
+        for (e = old_buckets[i]; e != NULL; e = next) {
+            uint b = alloc_bucket(shard, e->base);
+            next = e->next;
+            e->next = shard->buckets[b];
+            shard->buckets[b] = e;
+        }
+    }
+    dr_global_free(old_buckets, sizeof(alloc_entry_t *) * old_size);
+}
+
+static void
+alloc_table_add(app_pc base, size_t size, callstack_node_t *site)
+{
+    alloc_shard_t *shard = alloc_shard(base);
+    alloc_entry_t *e;
+    uint b;
+    dr_mutex_lock(shard->lock);
+    if (shard->free_list == NULL) {
+        alloc_chunk_t *chunk = dr_global_alloc(sizeof(*chunk));
+        uint i;
+        chunk->next = shard->chunks;
+        shard->chunks = chunk;
+        for (i = 0; i < ALLOC_CHUNK_ENTRIES; i++) {
+            chunk->entries[i].next = shard->free_list;
+            shard->free_list = &chunk->entries[i];
+        }
+    }
+    e = shard->free_list;
+    shard->free_list = e->next;
+    e->base = base;
+    e->size = size;
+    e->site = site;
+    b = alloc_bucket(shard, base);
+    e->next = shard->buckets[b];
+    shard->buckets[b] = e;
+    shard->entries++;
+    if (shard->entries > (2U << shard->bits))
+        alloc_shard_resize(shard);
+    dr_mutex_unlock(shard->lock);
+}
+
+/* Removes base from the table and returns its size and site via the OUT
+ * params.  Returns false if base is not a live allocation we saw.
+ */
+static bool
+alloc_table_remove(app_pc base, size_t *size OUT, callstack_node_t **site OUT)
+{
+    alloc_shard_t *shard = alloc_shard(base);
+    alloc_entry_t *e, *prev = NULL;
+    uint b;
+    bool found = false;
+    dr_mutex_lock(shard->lock);
+    b = alloc_bucket(shard, base);
+    for (e = shard->buckets[b]; e != NULL; prev = e, e = e->next) {
+        if (e->base == base) {
+            if (prev == NULL)
+                shard->buckets[b] = e->next;
+            else
+                prev->next = e->next;
+            *size = e->size;
+            *site = e->site;
+            e->next = shard->free_list;
+            shard->free_list = e;
+            shard->entries--;
+            found = true;
+            break;
+        }
+    }
+    dr_mutex_unlock(shard->lock);
+    return found;
+}
+
+static void
+alloc_table_init(void)
+{
+    uint i;
+    for (i = 0; i < BUFFER_SIZE_ELEMENTS(alloc_shards); i++) {
+        alloc_shard_t *shard = &alloc_shards[i];
+        memset(shard, 0, sizeof(*shard));
+        shard->lock = dr_mutex_create();
+        shard->bits = ALLOC_SHARD_INIT_BITS;
+        shard->buckets = dr_global_alloc(sizeof(alloc_entry_t *) << shard->bits);
+        memset(shard->buckets, 0, sizeof(alloc_entry_t *) << shard->bits);
+    }
+}
+
+static void
+alloc_table_exit(void)
+{
+    uint i;
+    for (i = 0; i < BUFFER_SIZE_ELEMENTS(alloc_shards); i++) {
+        alloc_shard_t *shard = &alloc_shards[i];
+        alloc_chunk_t *chunk, *next;
+        for (chunk = shard->chunks; chunk != NULL; chunk = next) {
+            next = chunk->next;
+            dr_global_free(chunk, sizeof(*chunk));
+        }
+        dr_global_free(shard->buckets, sizeof(alloc_entry_t *) << shard->bits);
+        dr_mutex_destroy(shard->lock);
+    }
+}
+
+/****************************************************************************
+ * Per-Thread Data
+ */
+
+/* Per-thread statistics for one site that have not yet been merged */
+typedef struct _site_delta_t {
+    callstack_node_t *site;
+    uint num_allocs;
+    uint num_frees;
+    uint64 bytes_allocated;
+    uint64 bytes_freed;
+} site_delta_t;
+
+/* Recently seen callstacks, keyed by a hash of their raw frames */
+typedef struct _stack_cache_entry_t {
+    uint hash;
+    callstack_node_t *site;
+} stack_cache_entry_t;
+
+#define SITE_DELTA_BITS  8
+#define STACK_CACHE_BITS 8
+
+typedef struct _per_thread_t {
+    /* Allocator calls made from inside another allocator call are not
+     * interesting to the application and are ignored.
+     */
+    uint alloc_depth;
+    /* pre-to-post state of the outermost in-progress call */
+    size_t pending_size;
+    app_pc pending_old;
+    uint num_events;
+    uint num_deltas;
+    site_delta_t deltas[1 << SITE_DELTA_BITS];
+    stack_cache_entry_t stack_cache[1 << STACK_CACHE_BITS];
+    struct _per_thread_t *prev, *next;
+} per_thread_t;
+
+/* All live per_thread_t, so exit can merge threads that did not see
+ * their thread exit event.  Protected by thread_list_lock.
+ */
+static per_thread_t *thread_list;
+static void *thread_list_lock;
+
+static void
+thread_data_merge(per_thread_t *data)
+{
+    uint i;
+    if (data->num_deltas == 0)
+        return;
+    dr_mutex_lock(stats_lock);
+    for (i = 0; i < BUFFER_SIZE_ELEMENTS(data->deltas); i++) {
+        site_delta_t *d = &data->deltas[i];
+        if (d->site == NULL)
+            continue;
+        d->site->num_allocs += d->num_allocs;
+        d->site->num_frees += d->num_frees;
+        d->site->bytes_allocated += d->bytes_allocated;
+        d->site->bytes_freed += d->bytes_freed;
+    }
+    dr_mutex_unlock(stats_lock);
+    memset(data->deltas, 0, sizeof(data->deltas));
+    data->num_deltas = 0;
+    data->num_events = 0;
+}
+
+static site_delta_t *
+thread_data_delta(per_thread_t *data, callstack_node_t *site)
+{
+    uint mask = (1 << SITE_DELTA_BITS) - 1;
+    uint i = HASH_FUNC((uint)((ptr_uint_t)site >> 4), SITE_DELTA_BITS);
+    /* Merge early rather than let the open-address table fill up */
+    if (data->num_deltas >= (3U << SITE_DELTA_BITS) / 4 ||
+        data->num_events >= options.merge_every)
+        thread_data_merge(data);
+    data->num_events++;
+    for (;; i = (i + 1) & mask) {
+        site_delta_t *d = &data->deltas[i];
+        if (d->site == site)
+            return d;
+        if (d->site == NULL) {
+            d->site = site;
+            data->num_deltas++;
+            return d;
+        }
+    }
+}
+
+static void
+event_thread_init(void *drcontext)
+{
+    per_thread_t *data = dr_thread_alloc(drcontext, sizeof(*data));
+    memset(data, 0, sizeof(*data));
+    drmgr_set_tls_field(drcontext, tls_idx, data);
+    dr_mutex_lock(thread_list_lock);
+    data->next = thread_list;
+    if (thread_list != NULL)
+        thread_list->prev = data;
+    thread_list = data;
+    dr_mutex_unlock(thread_list_lock);
+}
+
+static void
+event_thread_exit(void *drcontext)
+{
+    per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    thread_data_merge(data);
+    dr_mutex_lock(thread_list_lock);
+    if (data->prev != NULL)
+        data->prev->next = data->next;
+    else
+        thread_list = data->next;
+    if (data->next != NULL)
+        data->next->prev = data->prev;
+    dr_mutex_unlock(thread_list_lock);
+    dr_thread_free(drcontext, data, sizeof(*data));
+}
+
+/****************************************************************************
+ * Callstack Capture
+ */
+
+/* Walks the frame pointer chain starting at the wrapped function's entry.
+ * Returns the number of frames stored, innermost first.
+ */
+static uint
+callstack_walk(void *wrapcxt, app_pc *frames, uint max_frames)
+{
+    dr_mcontext_t *mc = drwrap_get_mcontext_ex(wrapcxt, DR_MC_CONTROL|DR_MC_INTEGER);
+    uint num = 0;
+    app_pc fp = (app_pc) mc->xbp;
+    app_pc prev_fp = (app_pc) mc->xsp;
+    app_pc buf[2]; /* saved fp, return address */
+    size_t read;
+    /* At the entry point the caller's frame pointer has not been pushed yet,
+     * so the first frame comes from the top of the stack.
+     */
+    if (!dr_safe_read((void *)mc->xsp, sizeof(buf[1]), &buf[1], &read) ||
+        read != sizeof(buf[1]))
+        return 0;
+    frames[num++] = buf[1];
+    while (num < max_frames) {
+        /* the chain must head toward the base of the stack */
+        if (fp <= prev_fp || ((ptr_uint_t)fp & (sizeof(void *) - 1)) != 0)
+            break;
+        if (!dr_safe_read(fp, sizeof(buf), buf, &read) || read != sizeof(buf))
+            break;
+        if (buf[1] == NULL)
+            break;
+        frames[num++] = buf[1];
+        prev_fp = fp;
+        fp = buf[0];
+    }
+    return num;
+}
+
+static callstack_node_t *
+callstack_capture(void *wrapcxt, per_thread_t *data)
+{
+    app_pc frames[MAX_DEPTH];
+    uint num = callstack_walk(wrapcxt, frames, options.depth);
+    uint hash = 0, i;
+    stack_cache_entry_t *cached;
+    callstack_node_t *node = NULL;
+    for (i = 0; i < num; i++)
+        hash = (hash * 31) ^ (uint)(ptr_uint_t)frames[i];
+    cached = &data->stack_cache[HASH_FUNC(hash, STACK_CACHE_BITS)];
+    if (cached->site != NULL && cached->hash == hash &&
+        callstack_node_matches(cached->site, frames, num))
+        return cached->site;
+    /* intern from the outermost frame inward so callers are shared */
+    for (i = num; i > 0; i--)
+        node = callstack_node_intern(node, frames[i - 1]);
+    if (node == NULL) {
+        /* no frames at all: attribute to a single unknown site */
+        node = callstack_node_intern(NULL, NULL);
+    }
+    cached->hash = hash;
+    cached->site = node;
+    return node;
+}
+
+/****************************************************************************
+ * Wrapping Callbacks
+ */
+
+static void
+record_alloc(per_thread_t *data, app_pc base, size_t size, callstack_node_t *site)
+{
+    site_delta_t *d;
+    alloc_table_add(base, size, site);
+    d = thread_data_delta(data, site);
+    d->num_allocs++;
+    d->bytes_allocated += size;
+}
+
+static void
+record_free(per_thread_t *data, app_pc base)
+{
+    size_t size;
+    callstack_node_t *site;
+    site_delta_t *d;
+    if (base == NULL || !alloc_table_remove(base, &size, &site))
+        return;
+    d = thread_data_delta(data, site);
+    d->num_frees++;
+    d->bytes_freed += size;
+}
+
+/* Returns the per-thread data if this is an outermost allocator call */
+static per_thread_t *
+alloc_pre_common(void *wrapcxt)
+{
+    per_thread_t *data = (per_thread_t *)
+        drmgr_get_tls_field(drwrap_get_drcontext(wrapcxt), tls_idx);
+    if (data->alloc_depth++ > 0)
+        return NULL;
+    return data;
+}
+
+static void
+wrap_malloc_pre(void *wrapcxt, OUT void **user_data)
+{
+    per_thread_t *data = alloc_pre_common(wrapcxt);
+    *user_data = NULL;
+    if (data == NULL)
+        return;
+    /* malloc(size) or RtlAllocateHeap(heap, flags, size) */
+    data->pending_old = NULL;
+    data->pending_size = (size_t) drwrap_get_arg(wrapcxt, IF_WINDOWS_ELSE(2,0));
+    *user_data = callstack_capture(wrapcxt, data);
+}
+
+#ifndef WINDOWS
+static void
+wrap_calloc_pre(void *wrapcxt, OUT void **user_data)
+{
+    per_thread_t *data = alloc_pre_common(wrapcxt);
+    *user_data = NULL;
+    if (data == NULL)
+        return;
+    data->pending_old = NULL;
+    data->pending_size = (size_t) drwrap_get_arg(wrapcxt, 0) *
+        (size_t) drwrap_get_arg(wrapcxt, 1);
+    *user_data = callstack_capture(wrapcxt, data);
+}
+#endif
+
+static void
+wrap_realloc_pre(void *wrapcxt, OUT void **user_data)
+{
+    per_thread_t *data = alloc_pre_common(wrapcxt);
+    *user_data = NULL;
+    if (data == NULL)
+        return;
+    /* realloc(ptr, size) or RtlReAllocateHeap(heap, flags, ptr, size) */
+    data->pending_old = (app_pc) drwrap_get_arg(wrapcxt, IF_WINDOWS_ELSE(2,0));
+    data->pending_size = (size_t) drwrap_get_arg(wrapcxt, IF_WINDOWS_ELSE(3,1));
+    *user_data = callstack_capture(wrapcxt, data);
+}
+
+static void
+wrap_alloc_post(void *wrapcxt, void *user_data)
+{
+    callstack_node_t *site = (callstack_node_t *) user_data;
+    per_thread_t *data;
+    app_pc base;
+    if (wrapcxt == NULL) {
+        /* abnormal unwind: we can't ask for the drcontext via wrapcxt */
+        data = (per_thread_t *)
+            drmgr_get_tls_field(dr_get_current_drcontext(), tls_idx);
+        data->alloc_depth--;
+        return;
+    }
+    data = (per_thread_t *)
+        drmgr_get_tls_field(drwrap_get_drcontext(wrapcxt), tls_idx);
+    data->alloc_depth--;
+    if (site == NULL)
+        return;
+    base = (app_pc) drwrap_get_retval(wrapcxt);
+    if (data->pending_old != NULL) {
+        /* realloc: the old block is freed on success, and on Linux also
+         * when called with a zero size (which returns NULL)
+         */
+        if (base != NULL || IF_WINDOWS_ELSE(false, data->pending_size == 0))
+            record_free(data, data->pending_old);
+        data->pending_old = NULL;
+    }
+    if (base != NULL)
+        record_alloc(data, base, data->pending_size, site);
+}
+
+static void
+wrap_free_pre(void *wrapcxt, OUT void **user_data)
+{
+    per_thread_t *data = (per_thread_t *)
+        drmgr_get_tls_field(drwrap_get_drcontext(wrapcxt), tls_idx);
+    /* free(ptr) or RtlFreeHeap(heap, flags, ptr) */
+    if (data->alloc_depth == 0)
+        record_free(data, (app_pc) drwrap_get_arg(wrapcxt, IF_WINDOWS_ELSE(2,0)));
+}
+
+static void
+wrap_routine(const module_data_t *mod, const char *name,
+             void (*pre)(void *, void **), void (*post)(void *, void *))
+{
+    app_pc towrap = (app_pc) dr_get_proc_address(mod->handle, name);
+    if (towrap != NULL) {
+        bool ok = drwrap_wrap(towrap, pre, post);
+        /* We expect failure w/ forwarded exports that we already wrapped */
+        dr_log(NULL, LOG_ALL, ok ? 2 : 1, "heapprof: %s wrapping %s @"PFX"\n",
+               ok ? "done" : "FAILED", name, towrap);
+    }
+}
+
+static void
+event_module_load(void *drcontext, const module_data_t *mod, bool loaded)
+{
+#ifdef WINDOWS
+    /* All Windows heap routines funnel into these ntdll exports */
+    wrap_routine(mod, "RtlAllocateHeap", wrap_malloc_pre, wrap_alloc_post);
+    wrap_routine(mod, "RtlReAllocateHeap", wrap_realloc_pre, wrap_alloc_post);
+    wrap_routine(mod, "RtlFreeHeap", wrap_free_pre, NULL);
+#else
+    wrap_routine(mod, "malloc", wrap_malloc_pre, wrap_alloc_post);
+    wrap_routine(mod, "calloc", wrap_calloc_pre, wrap_alloc_post);
+    wrap_routine(mod, "realloc", wrap_realloc_pre, wrap_alloc_post);
+    wrap_routine(mod, "free", wrap_free_pre, NULL);
+#endif
+}
+
+/****************************************************************************
+ * Reporting
+ */
+
+static file_t
+log_file_open(void)
+{
+    char buf[MAXIMUM_PATH];
+    const char *app_name = dr_get_application_name();
+    const char *dir = options.logdir;
+    char *dirsep;
+    file_t log;
+    int len, i;
+    if (dir == NULL) {
+        /* default to the directory of our library */
+        len = dr_snprintf(buf, BUFFER_SIZE_ELEMENTS(buf), "%s",
+                          dr_get_client_path(client_id));
+        ASSERT(len > 0, "dr_snprintf failed");
+        NULL_TERMINATE_BUFFER(buf);
+        for (dirsep = buf + strlen(buf);
+             dirsep > buf && *dirsep != '/' IF_WINDOWS(&& *dirsep != '\\');
+             dirsep--)
+            ; /* nothing */
+        *dirsep = '\0';
+        dir = buf;
+    }
+    if (app_name == NULL)
+        app_name = "unknown";
+    for (i = 0; i < 10000; i++) {
+        char name[MAXIMUM_PATH];
+        len = dr_snprintf(name, BUFFER_SIZE_ELEMENTS(name), "%s/heapprof.%s.%05d.%04d.log",
+                          dir, app_name, dr_get_process_id(), i);
+        if (len < 0)
+            break;
+        NULL_TERMINATE_BUFFER(name);
+        log = dr_open_file(name, DR_FILE_WRITE_REQUIRE_NEW | DR_FILE_ALLOW_LARGE);
+        if (log != INVALID_FILE) {
+            dr_log(NULL, LOG_ALL, 1, "heapprof: log file is %s\n", name);
+            return log;
+        }
+    }
+    return INVALID_FILE;
+}
+
+static void
+print_frame(file_t f, app_pc pc)
+{
+    module_data_t *data = dr_lookup_module(pc);
+    const char *modname;
+    if (data == NULL) {
+        dr_fprintf(f, "\t"PFX" <unknown module>\n", pc);
+        return;
+    }
+    modname = dr_module_preferred_name(data);
+    if (modname == NULL)
+        modname = "<noname>";
+#ifdef SHOW_SYMBOLS
+    {
+# define MAX_SYM_RESULT 256
+        drsym_error_t symres;
+        char sbuf[sizeof(drsym_info_t) + MAX_SYM_RESULT];
+        drsym_info_t *sym = (drsym_info_t *) sbuf;
+        sym->struct_size = sizeof(*sym);
+        sym->name_size = MAX_SYM_RESULT;
+        symres = drsym_lookup_address(data->full_path, pc - data->start, sym,
+                                      DRSYM_DEFAULT_FLAGS);
+        if (symres == DRSYM_SUCCESS || symres == DRSYM_ERROR_LINE_NOT_AVAILABLE) {
+            dr_fprintf(f, "\t"PFX" %s!%s+"PIFX, pc, modname, sym->name,
+                       pc - data->start - sym->start_offs);
+            if (symres == DRSYM_SUCCESS) {
+                dr_fprintf(f, " %s:%"UINT64_FORMAT_CODE"\n", sym->file, sym->line);
+            } else
+                dr_fprintf(f, "\n");
+            dr_free_module_data(data);
+            return;
+        }
+    }
+#endif
+    dr_fprintf(f, "\t"PFX" %s+"PIFX"\n", pc, modname, pc - data->start);
+    dr_free_module_data(data);
+}
+
+/* Writes the options.top sites with the most live bytes to a new log file.
+ * Only merged statistics are reported.
+ */
+static void
+report_profile(bool at_exit)
+{
+    callstack_node_t **top;
+    uint num_top = 0, num_sites = 0, i, j;
+    uint64 total_live = 0, total_allocs = 0;
+    file_t f = log_file_open();
+    if (f == INVALID_FILE) {
+        ASSERT(false, "failed to open log file");
+        return;
+    }
+    top = dr_global_alloc(sizeof(*top) * options.top);
+    dr_mutex_lock(stats_lock);
+    for (i = 0; i < BUFFER_SIZE_ELEMENTS(callstack_table); i++) {
+        callstack_node_t *node;
+        for (node = callstack_table[i]; node != NULL; node = node->next) {
+            uint64 live;
+            if (node->num_allocs == 0)
+                continue;
+            num_sites++;
+            live = node->bytes_allocated - node->bytes_freed;
+            total_live += live;
+            total_allocs += node->num_allocs;
+            /* insert into the sorted top list, dropping the smallest */
+            for (j = num_top; j > 0; j--) {
+                callstack_node_t *t = top[j - 1];
+                if (t->bytes_allocated - t->bytes_freed >= live)
+                    break;
+                if (j < options.top)
+                    top[j] = t;
+            }
+            if (j < options.top) {
+                top[j] = node;
+                if (num_top < options.top)
+                    num_top++;
+            }
+        }
+    }
+    dr_fprintf(f, "Heap profile %s: %u allocation sites, %u callstack nodes\n",
+               at_exit ? "at exit" : "on nudge", num_sites, num_callstack_nodes);
+    dr_fprintf(f, "Total: %"UINT64_FORMAT_CODE" live bytes, "
+               "%"UINT64_FORMAT_CODE" allocations\n\n", total_live, total_allocs);
+    for (i = 0; i < num_top; i++) {
+        callstack_node_t *node = top[i];
+        dr_fprintf(f, "#%u: %"UINT64_FORMAT_CODE" live bytes in "
+                   "%"UINT64_FORMAT_CODE" blocks; %"UINT64_FORMAT_CODE
+                   " bytes in %"UINT64_FORMAT_CODE" allocations total\n", i,
+                   node->bytes_allocated - node->bytes_freed,
+                   node->num_allocs - node->num_frees,
+                   node->bytes_allocated, node->num_allocs);
+        /* the callstack is identified by its innermost node */
+        for (; node != NULL; node = node->caller)
+            print_frame(f, node->pc);
+    }
+    dr_mutex_unlock(stats_lock);
+    dr_global_free(top, sizeof(*top) * options.top);
+    dr_close_file(f);
+#ifdef SHOW_RESULTS
+    if (at_exit) {
+        char msg[256];
+        int len = dr_snprintf(msg, BUFFER_SIZE_ELEMENTS(msg),
+                              "<Allocation sites: %u>\n<Live bytes at exit: "
+                              "%"UINT64_FORMAT_CODE">", num_sites, total_live);
+        DR_ASSERT(len > 0);
+        NULL_TERMINATE_BUFFER(msg);
+        DISPLAY_STRING(msg);
+    }
+#endif
+}
+
+static void
+event_nudge(void *drcontext, uint64 argument)
+{
+    report_profile(false);
+}
+
+static void
+event_exit(void)
+{
+    per_thread_t *data;
+    /* Threads still alive at exit may not have merged their statistics */
+    dr_mutex_lock(thread_list_lock);
+    for (data = thread_list; data != NULL; data = data->next)
+        thread_data_merge(data);
+    dr_mutex_unlock(thread_list_lock);
+    report_profile(true);
+#ifdef SHOW_SYMBOLS
+    if (drsym_exit() != DRSYM_SUCCESS)
+        dr_log(NULL, LOG_ALL, 1, "WARNING: error cleaning up symbol library\n");
+#endif
+    drwrap_exit();
+    if (!drmgr_unregister_tls_field(tls_idx) ||
+        !drmgr_unregister_thread_init_event(event_thread_init) ||
+        !drmgr_unregister_thread_exit_event(event_thread_exit))
+        DR_ASSERT(false);
+    drmgr_exit();
+    alloc_table_exit();
+    callstack_table_exit();
+    dr_mutex_destroy(thread_list_lock);
+}
+
+/****************************************************************************
+ * Initialization
+ */
+
+static uint
+option_uint(const char *opstr, const char *name, uint dflt, uint min, uint max)
+{
+    const char *s = strstr(opstr, name);
+    int val;
+    if (s == NULL || dr_sscanf(s + strlen(name), "%d", &val) != 1)
+        return dflt;
+    if (val < (int)min)
+        return min;
+    if (val > (int)max)
+        return max;
+    return (uint) val;
+}
+
+static void
+options_init(client_id_t id)
+{
+    const char *opstr = dr_get_options(id);
+    /* i#1049: DR should provide a utility routine to split the string
+     * into an array of tokens.
+     */
+    options.depth = option_uint(opstr, "-depth ", options.depth, 1, MAX_DEPTH);
+    options.top = option_uint(opstr, "-top ", options.top, 1, 100000);
+    options.merge_every = option_uint(opstr, "-merge_every ", options.merge_every,
+                                      1, 1 << 30);
+    options.logdir = strstr(opstr, "-logdir ");
+    if (options.logdir != NULL) {
+        options.logdir += strlen("-logdir");
+        for (; *options.logdir == ' '; options.logdir++);
+        ASSERT(options.logdir[0] != '\0' && dr_directory_exists(options.logdir),
+               "invalid logdir");
+    }
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    dr_log(NULL, LOG_ALL, 1, "Client 'heapprof' initializing\n");
+#ifdef SHOW_RESULTS
+    if (dr_is_notify_on()) {
+# ifdef WINDOWS
+        /* ask for best-effort printing to cmd window.  must be called in dr_init(). */
+        dr_enable_console_printing();
+# endif
+        dr_fprintf(STDERR, "Client heapprof is running\n");
+    }
+#endif
+    client_id = id;
+    options_init(id);
+    drmgr_init();
+    drwrap_init();
+    /* We wrap only entry points at module load and never unwrap */
+    drwrap_set_global_flags(DRWRAP_NO_FRILLS | DRWRAP_FAST_CLEANCALLS);
+#ifdef SHOW_SYMBOLS
+    if (drsym_init(0) != DRSYM_SUCCESS)
+        dr_log(NULL, LOG_ALL, 1, "WARNING: unable to initialize symbol translation\n");
+#endif
+    callstack_table_init();
+    alloc_table_init();
+    thread_list_lock = dr_mutex_create();
+    tls_idx = drmgr_register_tls_field();
+    DR_ASSERT(tls_idx != -1);
+    dr_register_exit_event(event_exit);
+    if (!drmgr_register_thread_init_event(event_thread_init) ||
+        !drmgr_register_thread_exit_event(event_thread_exit) ||
+        !drmgr_register_module_load_event(event_module_load))
+        DR_ASSERT(false);
+    dr_register_nudge_event(event_nudge, id);
+}
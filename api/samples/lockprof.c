@@ -0,0 +1,743 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Code Manipulation API Sample:
+ * lockprof.c
+ *
+ * Lock contention profiler.  Uses the drwrap extension to wrap lock
+ * acquisition and release routines and times how long each acquisition
+ * waits and how long each lock is then held, using the processor's
+ * timestamp counter.  Results are attributed to the pair of lock
+ * address and acquisition callsite.
+ *
+ * On Linux, pthread mutexes and rwlocks are wrapped, and futex waits are
+ * observed through the drmgr system call events so that blocking in
+ * condition variables and in hand-rolled locks is visible too.  Futex
+ * waits made from inside a wrapped lock routine are charged to that
+ * lock rather than counted twice.  On Windows, critical sections and
+ * slim reader-writer locks are wrapped.
+ *
+ * Each thread accumulates statistics in a private table which is merged
+ * into a global drcontainers hashtable only when it fills up, at thread
+ * exit, and at process exit, keeping the wrapping callbacks lock-free.
+ * At exit the lock and callsite pairs with the most wait time are
+ * written to a log file, symbolized via the drsyms extension when
+ * SHOW_SYMBOLS is on.
+ *
+ * The runtime options for this client include:
+ * -top <N>              Number of lock and callsite pairs to report
+ *                       (default 32).
+ * -contended_cycles <N> An acquisition that waits for longer than this
+ *                       many timestamp counter cycles is counted as
+ *                       contended (default 5000).
+ * -logdir <dir>         Sets log directory, which by default is at the same
+ *                       directory as the client library.  It must be the last
+ *                       option.
+ */
+
+#include "dr_api.h"
+#include "drmgr.h"
+#include "drwrap.h"
+#include "hashtable.h"
+#ifdef SHOW_SYMBOLS
+# include "drsyms.h"
+#endif
+#include <string.h> /* memset, strstr */
+
+#ifdef LINUX
+# include <syscall.h>
+#endif
+
+#ifdef WINDOWS
+# include <intrin.h>
+# define IF_WINDOWS(x) x
+# define DISPLAY_STRING(msg) dr_messagebox(msg)
+#else
+# define IF_WINDOWS(x) /* nothing */
+# define DISPLAY_STRING(msg) dr_printf("%s\n", msg);
+#endif
+
+#define BUFFER_SIZE_BYTES(buf)      sizeof(buf)
+#define BUFFER_SIZE_ELEMENTS(buf)   (BUFFER_SIZE_BYTES(buf) / sizeof((buf)[0]))
+#define BUFFER_LAST_ELEMENT(buf)    (buf)[BUFFER_SIZE_ELEMENTS(buf) - 1]
+#define NULL_TERMINATE_BUFFER(buf)  BUFFER_LAST_ELEMENT(buf) = 0
+
+#ifdef DEBUG
+# define ASSERT(x, msg) DR_ASSERT_MSG(x, msg)
+#else
+# define ASSERT(x, msg) /* nothing */
+#endif
+
+#ifdef LINUX
+/* From linux/futex.h, which we avoid including for portability */
+# define FUTEX_WAIT         0
+# define FUTEX_WAIT_BITSET  9
+# define FUTEX_PRIVATE_FLAG 128
+# define FUTEX_CLOCK_REALTIME 256
+# define FUTEX_CMD_MASK ~(FUTEX_PRIVATE_FLAG | FUTEX_CLOCK_REALTIME)
+#endif
+
+static inline uint64
+get_timestamp(void)
+{
+#ifdef WINDOWS
+    return __rdtsc();
+#else
+    uint lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64)hi << 32) | lo;
+#endif
+}
+
+typedef enum {
+    LOCK_KIND_MUTEX,
+    LOCK_KIND_READ,
+    LOCK_KIND_WRITE,
+    LOCK_KIND_FUTEX,
+} lock_kind_t;
+
+static const char * const lock_kind_names[] = {
+    "mutex",
+    "read",
+    "write",
+    "futex",
+};
+
+typedef struct _lockprof_option_t {
+    uint top;
+    uint64 contended_cycles;
+    const char *logdir;
+} lockprof_option_t;
+static lockprof_option_t options = {32, 5000, NULL};
+
+static client_id_t client_id;
+static int tls_idx;
+
+/****************************************************************************
+ * Lock Statistics
+ */
+
+typedef struct _lock_key_t {
+    app_pc lock;
+    app_pc callsite;
+    lock_kind_t kind;
+} lock_key_t;
+
+typedef struct _lock_stats_t {
+    lock_key_t key;
+    uint64 acquires;
+    uint64 contended;
+    uint64 wait_cycles;
+    uint64 max_wait_cycles;
+    uint64 hold_cycles;
+} lock_stats_t;
+
+/* Merged statistics: keys point at the key field of their payloads.
+ * Protected by the table lock.
+ */
+static hashtable_t global_stats;
+
+static uint
+lock_key_hash(void *key)
+{
+    lock_key_t *k = (lock_key_t *) key;
+    return (uint)(((ptr_uint_t)k->lock >> 3) ^ ((ptr_uint_t)k->callsite << 7)) ^
+        (uint)k->kind;
+}
+
+static bool
+lock_key_equal(void *key1, void *key2)
+{
+    lock_key_t *k1 = (lock_key_t *) key1;
+    lock_key_t *k2 = (lock_key_t *) key2;
+    return k1->lock == k2->lock && k1->callsite == k2->callsite &&
+        k1->kind == k2->kind;
+}
+
+static void
+lock_stats_free(void *payload)
+{
+    dr_global_free(payload, sizeof(lock_stats_t));
+}
+
+static inline void
+lock_stats_add(lock_stats_t *dst, lock_stats_t *src)
+{
+    dst->acquires += src->acquires;
+    dst->contended += src->contended;
+    dst->wait_cycles += src->wait_cycles;
+    dst->hold_cycles += src->hold_cycles;
+    if (src->max_wait_cycles > dst->max_wait_cycles)
+        dst->max_wait_cycles = src->max_wait_cycles;
+}
+
+/****************************************************************************
+ * Per-Thread Data
+ */
+
+#define THREAD_STATS_BITS 9
+#define MAX_HELD_LOCKS 16
+
+typedef struct _held_lock_t {
+    lock_key_t key; /* as acquired, to charge the hold time to */
+    uint64 acquired;
+} held_lock_t;
+
+typedef struct _per_thread_t {
+    /* Nested lock calls (e.g., a rwlock built on a mutex) are not timed */
+    uint lock_depth;
+    lock_key_t pending;
+    uint64 pending_start;
+#ifdef LINUX
+    bool in_futex_wait;
+#endif
+    uint num_held;
+    held_lock_t held[MAX_HELD_LOCKS];
+    uint num_stats;
+    lock_stats_t stats[1 << THREAD_STATS_BITS];
+    struct _per_thread_t *prev, *next;
+} per_thread_t;
+
+/* All live per_thread_t, so exit can merge threads that did not see
+ * their thread exit event.  Protected by thread_list_lock.
+ */
+static per_thread_t *thread_list;
+static void *thread_list_lock;
+
+static void
+thread_stats_merge(per_thread_t *data)
+{
+    uint i;
+    if (data->num_stats == 0)
+        return;
+    hashtable_lock(&global_stats);
+    for (i = 0; i < BUFFER_SIZE_ELEMENTS(data->stats); i++) {
+        lock_stats_t *src = &data->stats[i];
+        lock_stats_t *dst;
+        if (src->key.lock == NULL) /* empty slot */
+            continue;
+        dst = (lock_stats_t *) hashtable_lookup(&global_stats, &src->key);
+        if (dst == NULL) {
+            dst = dr_global_alloc(sizeof(*dst));
+            memset(dst, 0, sizeof(*dst));
+            dst->key = src->key;
+            hashtable_add(&global_stats, &dst->key, dst);
+        }
+        lock_stats_add(dst, src);
+    }
+    hashtable_unlock(&global_stats);
+    memset(data->stats, 0, sizeof(data->stats));
+    data->num_stats = 0;
+}
+
+static lock_stats_t *
+thread_stats_lookup(per_thread_t *data, lock_key_t *key)
+{
+    uint mask = (1 << THREAD_STATS_BITS) - 1;
+    uint i = lock_key_hash(key) & mask;
+    if (data->num_stats >= (3U << THREAD_STATS_BITS) / 4)
+        thread_stats_merge(data);
+    for (;; i = (i + 1) & mask) {
+        lock_stats_t *s = &data->stats[i];
+        if (s->key.lock == NULL) {
+            s->key = *key;
+            data->num_stats++;
+            return s;
+        }
+        if (lock_key_equal(&s->key, key))
+            return s;
+    }
+}
+
+static void
+record_acquire(per_thread_t *data, lock_key_t *key, uint64 start, uint64 end)
+{
+    uint64 wait = end - start;
+    lock_stats_t *s;
+    if (key->lock == NULL) /* invalid, and our empty-slot marker */
+        return;
+    s = thread_stats_lookup(data, key);
+    s->acquires++;
+    s->wait_cycles += wait;
+    if (wait > s->max_wait_cycles)
+        s->max_wait_cycles = wait;
+    if (wait > options.contended_cycles)
+        s->contended++;
+    if (key->kind != LOCK_KIND_FUTEX && data->num_held < MAX_HELD_LOCKS) {
+        held_lock_t *h = &data->held[data->num_held++];
+        h->key = *key;
+        h->acquired = end;
+    }
+}
+
+static void
+record_release(per_thread_t *data, app_pc lock, uint64 now)
+{
+    int i;
+    /* locks are mostly released in LIFO order */
+    for (i = data->num_held - 1; i >= 0; i--) {
+        if (data->held[i].key.lock == lock) {
+            lock_stats_t *s = thread_stats_lookup(data, &data->held[i].key);
+            s->hold_cycles += now - data->held[i].acquired;
+            data->held[i] = data->held[--data->num_held];
+            return;
+        }
+    }
+}
+
+static void
+event_thread_init(void *drcontext)
+{
+    per_thread_t *data = dr_thread_alloc(drcontext, sizeof(*data));
+    memset(data, 0, sizeof(*data));
+    drmgr_set_tls_field(drcontext, tls_idx, data);
+    dr_mutex_lock(thread_list_lock);
+    data->next = thread_list;
+    if (thread_list != NULL)
+        thread_list->prev = data;
+    thread_list = data;
+    dr_mutex_unlock(thread_list_lock);
+}
+
+static void
+event_thread_exit(void *drcontext)
+{
+    per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    thread_stats_merge(data);
+    dr_mutex_lock(thread_list_lock);
+    if (data->prev != NULL)
+        data->prev->next = data->next;
+    else
+        thread_list = data->next;
+    if (data->next != NULL)
+        data->next->prev = data->prev;
+    dr_mutex_unlock(thread_list_lock);
+    dr_thread_free(drcontext, data, sizeof(*data));
+}
+
+/****************************************************************************
+ * Wrapping Callbacks
+ */
+
+static void
+lock_pre_common(void *wrapcxt, lock_kind_t kind)
+{
+    per_thread_t *data = (per_thread_t *)
+        drmgr_get_tls_field(drwrap_get_drcontext(wrapcxt), tls_idx);
+    if (data->lock_depth++ > 0)
+        return;
+    data->pending.lock = (app_pc) drwrap_get_arg(wrapcxt, 0);
+    data->pending.callsite = drwrap_get_retaddr(wrapcxt);
+    data->pending.kind = kind;
+    /* read the counter last to keep our own overhead out of the wait */
+    data->pending_start = get_timestamp();
+}
+
+static void
+wrap_mutex_lock_pre(void *wrapcxt, OUT void **user_data)
+{
+    lock_pre_common(wrapcxt, LOCK_KIND_MUTEX);
+}
+
+static void
+wrap_read_lock_pre(void *wrapcxt, OUT void **user_data)
+{
+    lock_pre_common(wrapcxt, LOCK_KIND_READ);
+}
+
+static void
+wrap_write_lock_pre(void *wrapcxt, OUT void **user_data)
+{
+    lock_pre_common(wrapcxt, LOCK_KIND_WRITE);
+}
+
+static void
+wrap_lock_post(void *wrapcxt, void *user_data)
+{
+    uint64 end = get_timestamp();
+    per_thread_t *data = (per_thread_t *)
+        drmgr_get_tls_field(wrapcxt == NULL ? dr_get_current_drcontext() :
+                            drwrap_get_drcontext(wrapcxt), tls_idx);
+    if (--data->lock_depth > 0 || wrapcxt == NULL)
+        return;
+#ifdef LINUX
+    /* pthread lock routines return 0 on success */
+    if (drwrap_get_retval(wrapcxt) != NULL)
+        return;
+#endif
+    record_acquire(data, &data->pending, data->pending_start, end);
+}
+
+static void
+wrap_unlock_pre(void *wrapcxt, OUT void **user_data)
+{
+    uint64 now = get_timestamp();
+    per_thread_t *data = (per_thread_t *)
+        drmgr_get_tls_field(drwrap_get_drcontext(wrapcxt), tls_idx);
+    if (data->lock_depth == 0)
+        record_release(data, (app_pc) drwrap_get_arg(wrapcxt, 0), now);
+}
+
+static void
+wrap_routine(const module_data_t *mod, const char *name,
+             void (*pre)(void *, void **), void (*post)(void *, void *))
+{
+    app_pc towrap = (app_pc) dr_get_proc_address(mod->handle, name);
+    if (towrap != NULL) {
+        bool ok = drwrap_wrap(towrap, pre, post);
+        /* We expect failure w/ forwarded exports that we already wrapped */
+        dr_log(NULL, LOG_ALL, ok ? 2 : 1, "lockprof: %s wrapping %s @"PFX"\n",
+               ok ? "done" : "FAILED", name, towrap);
+    }
+}
+
+static void
+event_module_load(void *drcontext, const module_data_t *mod, bool loaded)
+{
+#ifdef WINDOWS
+    /* kernel32 and kernelbase forward these to ntdll */
+    wrap_routine(mod, "RtlEnterCriticalSection", wrap_mutex_lock_pre, wrap_lock_post);
+    wrap_routine(mod, "RtlLeaveCriticalSection", wrap_unlock_pre, NULL);
+    wrap_routine(mod, "RtlAcquireSRWLockShared", wrap_read_lock_pre, wrap_lock_post);
+    wrap_routine(mod, "RtlAcquireSRWLockExclusive", wrap_write_lock_pre,
+                 wrap_lock_post);
+    wrap_routine(mod, "RtlReleaseSRWLockShared", wrap_unlock_pre, NULL);
+    wrap_routine(mod, "RtlReleaseSRWLockExclusive", wrap_unlock_pre, NULL);
+#else
+    wrap_routine(mod, "pthread_mutex_lock", wrap_mutex_lock_pre, wrap_lock_post);
+    wrap_routine(mod, "pthread_mutex_unlock", wrap_unlock_pre, NULL);
+    wrap_routine(mod, "pthread_rwlock_rdlock", wrap_read_lock_pre, wrap_lock_post);
+    wrap_routine(mod, "pthread_rwlock_wrlock", wrap_write_lock_pre, wrap_lock_post);
+    wrap_routine(mod, "pthread_rwlock_unlock", wrap_unlock_pre, NULL);
+#endif
+}
+
+/****************************************************************************
+ * Futex Waits
+ */
+
+#ifdef LINUX
+static bool
+event_filter_syscall(void *drcontext, int sysnum)
+{
+    return sysnum == SYS_futex;
+}
+
+static bool
+event_pre_syscall(void *drcontext, int sysnum)
+{
+    per_thread_t *data;
+    int op;
+    dr_mcontext_t mc = {sizeof(mc), DR_MC_CONTROL};
+    if (sysnum != SYS_futex)
+        return true;
+    data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    op = (int) dr_syscall_get_param(drcontext, 1) & FUTEX_CMD_MASK;
+    /* waits inside wrapped routines are already timed by the wrapper */
+    if (data->lock_depth > 0 || (op != FUTEX_WAIT && op != FUTEX_WAIT_BITSET))
+        return true;
+    dr_get_mcontext(drcontext, &mc);
+    data->pending.lock = (app_pc) dr_syscall_get_param(drcontext, 0);
+    /* the post-syscall pc identifies the waiting routine */
+    data->pending.callsite = mc.pc;
+    data->pending.kind = LOCK_KIND_FUTEX;
+    data->in_futex_wait = true;
+    data->pending_start = get_timestamp();
+    return true;
+}
+
+static void
+event_post_syscall(void *drcontext, int sysnum)
+{
+    uint64 end = get_timestamp();
+    per_thread_t *data;
+    if (sysnum != SYS_futex)
+        return;
+    data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    if (!data->in_futex_wait)
+        return;
+    data->in_futex_wait = false;
+    record_acquire(data, &data->pending, data->pending_start, end);
+}
+#endif
+
+/****************************************************************************
+ * Reporting
+ */
+
+static file_t
+log_file_open(void)
+{
+    char buf[MAXIMUM_PATH];
+    const char *app_name = dr_get_application_name();
+    const char *dir = options.logdir;
+    char *dirsep;
+    file_t log;
+    int len, i;
+    if (dir == NULL) {
+        /* default to the directory of our library */
+        len = dr_snprintf(buf, BUFFER_SIZE_ELEMENTS(buf), "%s",
+                          dr_get_client_path(client_id));
+        ASSERT(len > 0, "dr_snprintf failed");
+        NULL_TERMINATE_BUFFER(buf);
+        for (dirsep = buf + strlen(buf);
+             dirsep > buf && *dirsep != '/' IF_WINDOWS(&& *dirsep != '\\');
+             dirsep--)
+            ; /* nothing */
+        *dirsep = '\0';
+        dir = buf;
+    }
+    if (app_name == NULL)
+        app_name = "unknown";
+    for (i = 0; i < 10000; i++) {
+        char name[MAXIMUM_PATH];
+        len = dr_snprintf(name, BUFFER_SIZE_ELEMENTS(name), "%s/lockprof.%s.%05d.%04d.log",
+                          dir, app_name, dr_get_process_id(), i);
+        if (len < 0)
+            break;
+        NULL_TERMINATE_BUFFER(name);
+        log = dr_open_file(name, DR_FILE_WRITE_REQUIRE_NEW | DR_FILE_ALLOW_LARGE);
+        if (log != INVALID_FILE) {
+            dr_log(NULL, LOG_ALL, 1, "lockprof: log file is %s\n", name);
+            return log;
+        }
+    }
+    return INVALID_FILE;
+}
+
+static void
+print_address(file_t f, app_pc pc)
+{
+    module_data_t *data = dr_lookup_module(pc);
+    const char *modname;
+    if (data == NULL) {
+        dr_fprintf(f, "\t"PFX" <unknown module>\n", pc);
+        return;
+    }
+    modname = dr_module_preferred_name(data);
+    if (modname == NULL)
+        modname = "<noname>";
+#ifdef SHOW_SYMBOLS
+    {
+# define MAX_SYM_RESULT 256
+        drsym_error_t symres;
+        char sbuf[sizeof(drsym_info_t) + MAX_SYM_RESULT];
+        drsym_info_t *sym = (drsym_info_t *) sbuf;
+        sym->struct_size = sizeof(*sym);
+        sym->name_size = MAX_SYM_RESULT;
+        symres = drsym_lookup_address(data->full_path, pc - data->start, sym,
+                                      DRSYM_DEFAULT_FLAGS);
+        if (symres == DRSYM_SUCCESS || symres == DRSYM_ERROR_LINE_NOT_AVAILABLE) {
+            dr_fprintf(f, "\t"PFX" %s!%s+"PIFX, pc, modname, sym->name,
+                       pc - data->start - sym->start_offs);
+            if (symres == DRSYM_SUCCESS) {
+                dr_fprintf(f, " %s:%"UINT64_FORMAT_CODE"\n", sym->file, sym->line);
+            } else
+                dr_fprintf(f, "\n");
+            dr_free_module_data(data);
+            return;
+        }
+    }
+#endif
+    dr_fprintf(f, "\t"PFX" %s+"PIFX"\n", pc, modname, pc - data->start);
+    dr_free_module_data(data);
+}
+
+static void
+report_profile(void)
+{
+    lock_stats_t **top;
+    uint num_top = 0, num_pairs = 0, i, j;
+    uint64 total_wait = 0, total_contended = 0;
+    file_t f = log_file_open();
+    if (f == INVALID_FILE) {
+        ASSERT(false, "failed to open log file");
+        return;
+    }
+    top = dr_global_alloc(sizeof(*top) * options.top);
+    hashtable_lock(&global_stats);
+    for (i = 0; i < HASHTABLE_SIZE(global_stats.table_bits); i++) {
+        hash_entry_t *he;
+        for (he = global_stats.table[i]; he != NULL; he = he->next) {
+            lock_stats_t *s = (lock_stats_t *) he->payload;
+            num_pairs++;
+            total_wait += s->wait_cycles;
+            total_contended += s->contended;
+            /* insert into the sorted top list, dropping the smallest */
+            for (j = num_top; j > 0; j--) {
+                if (top[j - 1]->wait_cycles >= s->wait_cycles)
+                    break;
+                if (j < options.top)
+                    top[j] = top[j - 1];
+            }
+            if (j < options.top) {
+                top[j] = s;
+                if (num_top < options.top)
+                    num_top++;
+            }
+        }
+    }
+    dr_fprintf(f, "Lock profile: %u lock and callsite pairs, "
+               "%"UINT64_FORMAT_CODE" contended acquisitions, "
+               "%"UINT64_FORMAT_CODE" total wait cycles\n\n",
+               num_pairs, total_contended, total_wait);
+    for (i = 0; i < num_top; i++) {
+        lock_stats_t *s = top[i];
+        dr_fprintf(f, "#%u: %s "PFX": %"UINT64_FORMAT_CODE" acquisitions, "
+                   "%"UINT64_FORMAT_CODE" contended\n", i,
+                   lock_kind_names[s->key.kind], s->key.lock,
+                   s->acquires, s->contended);
+        dr_fprintf(f, "\twait cycles: %"UINT64_FORMAT_CODE" total, "
+                   "%"UINT64_FORMAT_CODE" average, %"UINT64_FORMAT_CODE" max; "
+                   "hold cycles: %"UINT64_FORMAT_CODE" total\n",
+                   s->wait_cycles,
+                   s->acquires == 0 ? 0 : s->wait_cycles / s->acquires,
+                   s->max_wait_cycles, s->hold_cycles);
+        print_address(f, s->key.callsite);
+    }
+    hashtable_unlock(&global_stats);
+    dr_global_free(top, sizeof(*top) * options.top);
+    dr_close_file(f);
+#ifdef SHOW_RESULTS
+    {
+        char msg[256];
+        int len = dr_snprintf(msg, BUFFER_SIZE_ELEMENTS(msg),
+                              "<Lock and callsite pairs: %u>\n<Contended acquisitions: "
+                              "%"UINT64_FORMAT_CODE">", num_pairs, total_contended);
+        DR_ASSERT(len > 0);
+        NULL_TERMINATE_BUFFER(msg);
+        DISPLAY_STRING(msg);
+    }
+#endif
+}
+
+static void
+event_exit(void)
+{
+    per_thread_t *data;
+    /* Threads still alive at exit may not have merged their statistics */
+    dr_mutex_lock(thread_list_lock);
+    for (data = thread_list; data != NULL; data = data->next)
+        thread_stats_merge(data);
+    dr_mutex_unlock(thread_list_lock);
+    report_profile();
+#ifdef SHOW_SYMBOLS
+    if (drsym_exit() != DRSYM_SUCCESS)
+        dr_log(NULL, LOG_ALL, 1, "WARNING: error cleaning up symbol library\n");
+#endif
+    drwrap_exit();
+    if (!drmgr_unregister_tls_field(tls_idx) ||
+        !drmgr_unregister_thread_init_event(event_thread_init) ||
+        !drmgr_unregister_thread_exit_event(event_thread_exit)
+#ifdef LINUX
+        || !drmgr_unregister_pre_syscall_event(event_pre_syscall) ||
+        !drmgr_unregister_post_syscall_event(event_post_syscall)
+#endif
+        )
+        DR_ASSERT(false);
+    drmgr_exit();
+    hashtable_delete(&global_stats);
+    dr_mutex_destroy(thread_list_lock);
+}
+
+/****************************************************************************
+ * Initialization
+ */
+
+static void
+options_init(client_id_t id)
+{
+    const char *opstr = dr_get_options(id);
+    const char *s;
+    uint64 val;
+    /* i#1049: DR should provide a utility routine to split the string
+     * into an array of tokens.
+     */
+    s = strstr(opstr, "-top ");
+    if (s != NULL && dr_sscanf(s + strlen("-top "), "%u", &options.top) == 1) {
+        if (options.top == 0)
+            options.top = 1;
+    }
+    s = strstr(opstr, "-contended_cycles ");
+    if (s != NULL &&
+        dr_sscanf(s + strlen("-contended_cycles "), "%llu", &val) == 1)
+        options.contended_cycles = val;
+    options.logdir = strstr(opstr, "-logdir ");
+    if (options.logdir != NULL) {
+        options.logdir += strlen("-logdir");
+        for (; *options.logdir == ' '; options.logdir++);
+        ASSERT(options.logdir[0] != '\0' && dr_directory_exists(options.logdir),
+               "invalid logdir");
+    }
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    dr_log(NULL, LOG_ALL, 1, "Client 'lockprof' initializing\n");
+#ifdef SHOW_RESULTS
+    if (dr_is_notify_on()) {
+# ifdef WINDOWS
+        /* ask for best-effort printing to cmd window.  must be called in dr_init(). */
+        dr_enable_console_printing();
+# endif
+        dr_fprintf(STDERR, "Client lockprof is running\n");
+    }
+#endif
+    client_id = id;
+    options_init(id);
+    drmgr_init();
+    drwrap_init();
+    /* We wrap only entry points at module load and never unwrap */
+    drwrap_set_global_flags(DRWRAP_NO_FRILLS | DRWRAP_FAST_CLEANCALLS);
+#ifdef SHOW_SYMBOLS
+    if (drsym_init(0) != DRSYM_SUCCESS)
+        dr_log(NULL, LOG_ALL, 1, "WARNING: unable to initialize symbol translation\n");
+#endif
+    hashtable_init_ex(&global_stats, 8, HASH_CUSTOM, false/*!strdup*/,
+                      false/*!synch: we lock around whole merges*/,
+                      lock_stats_free, lock_key_hash, lock_key_equal);
+    thread_list_lock = dr_mutex_create();
+    tls_idx = drmgr_register_tls_field();
+    DR_ASSERT(tls_idx != -1);
+    dr_register_exit_event(event_exit);
+    if (!drmgr_register_thread_init_event(event_thread_init) ||
+        !drmgr_register_thread_exit_event(event_thread_exit) ||
+        !drmgr_register_module_load_event(event_module_load))
+        DR_ASSERT(false);
+#ifdef LINUX
+    dr_register_filter_syscall_event(event_filter_syscall);
+    if (!drmgr_register_pre_syscall_event(event_pre_syscall) ||
+        !drmgr_register_post_syscall_event(event_post_syscall))
+        DR_ASSERT(false);
+#endif
+}
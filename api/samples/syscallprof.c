@@ -0,0 +1,633 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Code Manipulation API Sample:
+ * syscallprof.c
+ *
+ * System call frequency and latency profiler: a high-throughput
+ * counterpart to the strace.c sample, which prints every system call
+ * as it happens.  Each system call is timed with the processor's
+ * timestamp counter between the drmgr pre- and post-syscall events and
+ * recorded in a log2-scaled latency histogram for its system call
+ * number.  Histograms are private to each thread, so recording takes no
+ * locks; they are summed into a global set at thread exit and reported
+ * at process exit.
+ *
+ * Optionally, every system call is also recorded as a fixed-size binary
+ * record (see syscall_record_t) in a per-thread buffer.  Full buffers
+ * are queued for a client thread that writes them to disk, so
+ * application threads never block on file i/o.
+ *
+ * Uses the drmgr extension for thread-context-local data that is preserved
+ * properly across Windows callbacks, as strace.c does.
+ *
+ * The runtime options for this client include:
+ * -event_stream  Writes a binary record of every system call to a
+ *                syscallprof.*.bin file.
+ * -logdir <dir>  Sets log directory, which by default is at the same
+ *                directory as the client library.  It must be the last
+ *                option.
+ */
+
+#include "dr_api.h"
+#include "drmgr.h"
+#include <string.h> /* memset, strstr */
+
+#ifdef WINDOWS
+# include <intrin.h>
+# define IF_WINDOWS(x) x
+# define IF_WINDOWS_ELSE(x,y) x
+# define DISPLAY_STRING(msg) dr_messagebox(msg)
+#else
+# define IF_WINDOWS(x) /* nothing */
+# define IF_WINDOWS_ELSE(x,y) y
+# define DISPLAY_STRING(msg) dr_printf("%s\n", msg);
+#endif
+
+#define BUFFER_SIZE_BYTES(buf)      sizeof(buf)
+#define BUFFER_SIZE_ELEMENTS(buf)   (BUFFER_SIZE_BYTES(buf) / sizeof((buf)[0]))
+#define BUFFER_LAST_ELEMENT(buf)    (buf)[BUFFER_SIZE_ELEMENTS(buf) - 1]
+#define NULL_TERMINATE_BUFFER(buf)  BUFFER_LAST_ELEMENT(buf) = 0
+
+#ifdef DEBUG
+# define ASSERT(x, msg) DR_ASSERT_MSG(x, msg)
+#else
+# define ASSERT(x, msg) /* nothing */
+#endif
+
+/* Windows win32k system call numbers start at 0x1000.  Larger numbers
+ * share the final histogram.
+ */
+#define MAX_SYSNUM IF_WINDOWS_ELSE(0x2000, 1024)
+#define NUM_BUCKETS 48
+
+static inline uint64
+get_timestamp(void)
+{
+#ifdef WINDOWS
+    return __rdtsc();
+#else
+    uint lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64)hi << 32) | lo;
+#endif
+}
+
+typedef struct _syscallprof_option_t {
+    bool event_stream;
+    const char *logdir;
+} syscallprof_option_t;
+static syscallprof_option_t options;
+
+static client_id_t client_id;
+
+/****************************************************************************
+ * Histograms
+ */
+
+typedef struct _syscall_hist_t {
+    uint64 count;
+    uint64 total_cycles;
+    uint64 min_cycles;
+    uint64 max_cycles;
+    /* bucket i counts calls that took [2^i, 2^(i+1)) cycles */
+    uint64 buckets[NUM_BUCKETS];
+} syscall_hist_t;
+
+/* Sum of all exited threads' histograms.  Protected by global_hist_lock. */
+static syscall_hist_t *global_hist[MAX_SYSNUM];
+static void *global_hist_lock;
+
+static inline uint
+latency_bucket(uint64 cycles)
+{
+    uint b = 0;
+    while (cycles > 1 && b < NUM_BUCKETS - 1) {
+        cycles >>= 1;
+        b++;
+    }
+    return b;
+}
+
+static void
+hist_record(syscall_hist_t *h, uint64 cycles)
+{
+    if (h->count == 0 || cycles < h->min_cycles)
+        h->min_cycles = cycles;
+    if (cycles > h->max_cycles)
+        h->max_cycles = cycles;
+    h->count++;
+    h->total_cycles += cycles;
+    h->buckets[latency_bucket(cycles)]++;
+}
+
+static void
+hist_add(syscall_hist_t *dst, syscall_hist_t *src)
+{
+    uint i;
+    if (dst->count == 0 || src->min_cycles < dst->min_cycles)
+        dst->min_cycles = src->min_cycles;
+    if (src->max_cycles > dst->max_cycles)
+        dst->max_cycles = src->max_cycles;
+    dst->count += src->count;
+    dst->total_cycles += src->total_cycles;
+    for (i = 0; i < NUM_BUCKETS; i++)
+        dst->buckets[i] += src->buckets[i];
+}
+
+/****************************************************************************
+ * Event Stream
+ *
+ * Application threads fill private buffers and push full ones onto
+ * full_list.  The writer thread swaps out the whole list and writes it
+ * while holding write_lock, which keeps DR from suspending it mid-batch,
+ * so the exit event can take write_lock and then drain what is left.
+ */
+
+/* One record per system call in the binary event stream */
+typedef struct _syscall_record_t {
+    uint64 start;         /* timestamp counter at the pre-syscall event */
+    uint64 cycles;        /* timestamp counter delta to the post-syscall event */
+    int64 result;         /* dr_syscall_get_result() */
+    uint thread_id;
+    int sysnum;
+} syscall_record_t;
+
+#define RECORDS_PER_BUFFER 4096
+
+typedef struct _record_buffer_t {
+    struct _record_buffer_t *next;
+    uint num_records;
+    syscall_record_t records[RECORDS_PER_BUFFER];
+} record_buffer_t;
+
+static file_t stream_file = INVALID_FILE;
+static record_buffer_t *full_list;  /* protected by queue_lock */
+static record_buffer_t *free_list;  /* protected by queue_lock */
+static void *queue_lock;
+static void *write_lock;
+static volatile bool writer_exit;
+
+static record_buffer_t *
+buffer_get(void)
+{
+    record_buffer_t *buf;
+    dr_mutex_lock(queue_lock);
+    buf = free_list;
+    if (buf != NULL)
+        free_list = buf->next;
+    dr_mutex_unlock(queue_lock);
+    if (buf == NULL)
+        buf = dr_global_alloc(sizeof(*buf));
+    buf->num_records = 0;
+    buf->next = NULL;
+    return buf;
+}
+
+static void
+buffer_queue(record_buffer_t *buf)
+{
+    record_buffer_t **tail;
+    if (buf->num_records == 0) {
+        dr_global_free(buf, sizeof(*buf));
+        return;
+    }
+    dr_mutex_lock(queue_lock);
+    /* keep the stream in submission order */
+    for (tail = &full_list; *tail != NULL; tail = &(*tail)->next)
+        ; /* nothing */
+    buf->next = NULL;
+    *tail = buf;
+    dr_mutex_unlock(queue_lock);
+}
+
+/* Caller must hold write_lock */
+static bool
+buffer_write_all(void)
+{
+    record_buffer_t *list, *buf, *next;
+    dr_mutex_lock(queue_lock);
+    list = full_list;
+    full_list = NULL;
+    dr_mutex_unlock(queue_lock);
+    if (list == NULL)
+        return false;
+    for (buf = list; buf != NULL; buf = next) {
+        size_t sz = buf->num_records * sizeof(buf->records[0]);
+        next = buf->next;
+        if (dr_write_file(stream_file, buf->records, sz) != (ssize_t) sz)
+            ASSERT(false, "failed to write event stream");
+        dr_mutex_lock(queue_lock);
+        buf->next = free_list;
+        free_list = buf;
+        dr_mutex_unlock(queue_lock);
+    }
+    return true;
+}
+
+static void
+writer_thread(void *arg)
+{
+    while (!writer_exit) {
+        bool wrote;
+        dr_mutex_lock(write_lock);
+        wrote = buffer_write_all();
+        dr_mutex_unlock(write_lock);
+        if (!wrote)
+            dr_sleep(10);
+    }
+}
+
+static void
+buffer_list_free(record_buffer_t *list)
+{
+    record_buffer_t *buf, *next;
+    for (buf = list; buf != NULL; buf = next) {
+        next = buf->next;
+        dr_global_free(buf, sizeof(*buf));
+    }
+}
+
+/****************************************************************************
+ * Per-Thread Data
+ */
+
+typedef struct _per_thread_t {
+    syscall_hist_t *hist[MAX_SYSNUM];
+    record_buffer_t *buffer;
+    uint thread_id;
+    struct _per_thread_t *prev, *next;
+} per_thread_t;
+
+/* State spanning a system call, which must be callback-local on Windows */
+typedef struct _per_context_t {
+    bool pending;
+    uint64 start;
+} per_context_t;
+
+static int tls_idx;
+static int tcls_idx;
+
+/* All live per_thread_t, so exit can merge threads that did not see
+ * their thread exit event.  Protected by global_hist_lock.
+ */
+static per_thread_t *thread_list;
+
+/* Caller must hold global_hist_lock */
+static void
+thread_data_merge(per_thread_t *data)
+{
+    uint i;
+    for (i = 0; i < MAX_SYSNUM; i++) {
+        if (data->hist[i] == NULL)
+            continue;
+        if (global_hist[i] == NULL) {
+            global_hist[i] = dr_global_alloc(sizeof(syscall_hist_t));
+            memset(global_hist[i], 0, sizeof(syscall_hist_t));
+        }
+        hist_add(global_hist[i], data->hist[i]);
+        dr_global_free(data->hist[i], sizeof(syscall_hist_t));
+        data->hist[i] = NULL;
+    }
+    if (data->buffer != NULL) {
+        buffer_queue(data->buffer);
+        data->buffer = NULL;
+    }
+}
+
+static void
+event_thread_init(void *drcontext)
+{
+    per_thread_t *data = dr_thread_alloc(drcontext, sizeof(*data));
+    memset(data, 0, sizeof(*data));
+    data->thread_id = (uint) dr_get_thread_id(drcontext);
+    if (options.event_stream)
+        data->buffer = buffer_get();
+    drmgr_set_tls_field(drcontext, tls_idx, data);
+    dr_mutex_lock(global_hist_lock);
+    data->next = thread_list;
+    if (thread_list != NULL)
+        thread_list->prev = data;
+    thread_list = data;
+    dr_mutex_unlock(global_hist_lock);
+}
+
+static void
+event_thread_exit(void *drcontext)
+{
+    per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    dr_mutex_lock(global_hist_lock);
+    thread_data_merge(data);
+    if (data->prev != NULL)
+        data->prev->next = data->next;
+    else
+        thread_list = data->next;
+    if (data->next != NULL)
+        data->next->prev = data->prev;
+    dr_mutex_unlock(global_hist_lock);
+    dr_thread_free(drcontext, data, sizeof(*data));
+}
+
+static void
+event_thread_context_init(void *drcontext, bool new_depth)
+{
+    per_context_t *cdata;
+    if (new_depth) {
+        cdata = (per_context_t *) dr_thread_alloc(drcontext, sizeof(*cdata));
+        drmgr_set_cls_field(drcontext, tcls_idx, cdata);
+    } else
+        cdata = (per_context_t *) drmgr_get_cls_field(drcontext, tcls_idx);
+    memset(cdata, 0, sizeof(*cdata));
+}
+
+static void
+event_thread_context_exit(void *drcontext, bool thread_exit)
+{
+    if (thread_exit) {
+        per_context_t *cdata = (per_context_t *)
+            drmgr_get_cls_field(drcontext, tcls_idx);
+        dr_thread_free(drcontext, cdata, sizeof(*cdata));
+    }
+    /* else, nothing to do: we leave the struct for re-use on next context */
+}
+
+/****************************************************************************
+ * System Call Events
+ */
+
+static bool
+event_filter_syscall(void *drcontext, int sysnum)
+{
+    return true; /* intercept everything */
+}
+
+static bool
+event_pre_syscall(void *drcontext, int sysnum)
+{
+    per_context_t *cdata = (per_context_t *) drmgr_get_cls_field(drcontext, tcls_idx);
+    cdata->pending = true;
+    /* read the counter last to keep our own overhead out of the latency */
+    cdata->start = get_timestamp();
+    return true; /* execute normally */
+}
+
+static void
+event_post_syscall(void *drcontext, int sysnum)
+{
+    uint64 end = get_timestamp();
+    per_context_t *cdata = (per_context_t *) drmgr_get_cls_field(drcontext, tcls_idx);
+    per_thread_t *data;
+    uint idx;
+    if (!cdata->pending) /* e.g., we attached mid-syscall */
+        return;
+    cdata->pending = false;
+    data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    idx = (sysnum >= 0 && sysnum < MAX_SYSNUM) ? (uint) sysnum : MAX_SYSNUM - 1;
+    if (data->hist[idx] == NULL) {
+        /* global so that exit can free histograms of threads that are still live */
+        data->hist[idx] = dr_global_alloc(sizeof(syscall_hist_t));
+        memset(data->hist[idx], 0, sizeof(syscall_hist_t));
+    }
+    hist_record(data->hist[idx], end - cdata->start);
+    if (data->buffer != NULL) {
+        syscall_record_t *rec = &data->buffer->records[data->buffer->num_records++];
+        rec->start = cdata->start;
+        rec->cycles = end - cdata->start;
+        rec->result = (int64)(ptr_int_t) dr_syscall_get_result(drcontext);
+        rec->thread_id = data->thread_id;
+        rec->sysnum = sysnum;
+        if (data->buffer->num_records == RECORDS_PER_BUFFER) {
+            buffer_queue(data->buffer);
+            data->buffer = buffer_get();
+        }
+    }
+}
+
+/****************************************************************************
+ * Reporting
+ */
+
+static file_t
+log_file_open(const char *suffix)
+{
+    char buf[MAXIMUM_PATH];
+    const char *app_name = dr_get_application_name();
+    const char *dir = options.logdir;
+    char *dirsep;
+    file_t log;
+    int len, i;
+    if (dir == NULL) {
+        /* default to the directory of our library */
+        len = dr_snprintf(buf, BUFFER_SIZE_ELEMENTS(buf), "%s",
+                          dr_get_client_path(client_id));
+        ASSERT(len > 0, "dr_snprintf failed");
+        NULL_TERMINATE_BUFFER(buf);
+        for (dirsep = buf + strlen(buf);
+             dirsep > buf && *dirsep != '/' IF_WINDOWS(&& *dirsep != '\\');
+             dirsep--)
+            ; /* nothing */
+        *dirsep = '\0';
+        dir = buf;
+    }
+    if (app_name == NULL)
+        app_name = "unknown";
+    for (i = 0; i < 10000; i++) {
+        char name[MAXIMUM_PATH];
+        len = dr_snprintf(name, BUFFER_SIZE_ELEMENTS(name),
+                          "%s/syscallprof.%s.%05d.%04d.%s",
+                          dir, app_name, dr_get_process_id(), i, suffix);
+        if (len < 0)
+            break;
+        NULL_TERMINATE_BUFFER(name);
+        log = dr_open_file(name, DR_FILE_WRITE_REQUIRE_NEW | DR_FILE_ALLOW_LARGE);
+        if (log != INVALID_FILE) {
+            dr_log(NULL, LOG_ALL, 1, "syscallprof: %s file is %s\n", suffix, name);
+            return log;
+        }
+    }
+    return INVALID_FILE;
+}
+
+static void
+report_profile(void)
+{
+    uint64 total_count = 0, total_cycles = 0;
+    uint i, b, num_sysnums = 0;
+    file_t f = log_file_open("log");
+    if (f == INVALID_FILE) {
+        ASSERT(false, "failed to open log file");
+        return;
+    }
+    for (i = 0; i < MAX_SYSNUM; i++) {
+        if (global_hist[i] == NULL)
+            continue;
+        num_sysnums++;
+        total_count += global_hist[i]->count;
+        total_cycles += global_hist[i]->total_cycles;
+    }
+    dr_fprintf(f, "System call profile: %"UINT64_FORMAT_CODE" calls to %u "
+               "system calls taking %"UINT64_FORMAT_CODE" cycles\n",
+               total_count, num_sysnums, total_cycles);
+    dr_fprintf(f, "Bucket N counts calls taking [2^N, 2^(N+1)) cycles\n");
+    for (i = 0; i < MAX_SYSNUM; i++) {
+        syscall_hist_t *h = global_hist[i];
+        if (h == NULL)
+            continue;
+        dr_fprintf(f, "\nsysnum %s%u: %"UINT64_FORMAT_CODE" calls, "
+                   "%"UINT64_FORMAT_CODE" total cycles, %"UINT64_FORMAT_CODE
+                   " min, %"UINT64_FORMAT_CODE" average, %"UINT64_FORMAT_CODE" max\n",
+                   i == MAX_SYSNUM - 1 ? ">=" : "", i, h->count, h->total_cycles,
+                   h->min_cycles, h->total_cycles / h->count, h->max_cycles);
+        for (b = 0; b < NUM_BUCKETS; b++) {
+            if (h->buckets[b] > 0) {
+                dr_fprintf(f, "\tbucket %2u: %"UINT64_FORMAT_CODE"\n",
+                           b, h->buckets[b]);
+            }
+        }
+    }
+    dr_close_file(f);
+#ifdef SHOW_RESULTS
+    {
+        char msg[256];
+        int len = dr_snprintf(msg, BUFFER_SIZE_ELEMENTS(msg),
+                              "<Number of system calls seen: %"UINT64_FORMAT_CODE">\n"
+                              "<Distinct system call numbers: %u>",
+                              total_count, num_sysnums);
+        DR_ASSERT(len > 0);
+        NULL_TERMINATE_BUFFER(msg);
+        DISPLAY_STRING(msg);
+    }
+#endif
+}
+
+static void
+event_exit(void)
+{
+    uint i;
+    per_thread_t *data;
+    dr_mutex_lock(global_hist_lock);
+    for (data = thread_list; data != NULL; data = data->next)
+        thread_data_merge(data);
+    dr_mutex_unlock(global_hist_lock);
+    report_profile();
+    if (options.event_stream) {
+        /* the writer thread does not hold write_lock while suspended for exit */
+        writer_exit = true;
+        dr_mutex_lock(write_lock);
+        buffer_write_all();
+        dr_mutex_unlock(write_lock);
+        dr_close_file(stream_file);
+        buffer_list_free(free_list);
+        free_list = NULL;
+    }
+    for (i = 0; i < MAX_SYSNUM; i++) {
+        if (global_hist[i] != NULL)
+            dr_global_free(global_hist[i], sizeof(syscall_hist_t));
+    }
+    if (!drmgr_unregister_tls_field(tls_idx) ||
+        !drmgr_unregister_cls_field(event_thread_context_init,
+                                    event_thread_context_exit, tcls_idx) ||
+        !drmgr_unregister_thread_init_event(event_thread_init) ||
+        !drmgr_unregister_thread_exit_event(event_thread_exit) ||
+        !drmgr_unregister_pre_syscall_event(event_pre_syscall) ||
+        !drmgr_unregister_post_syscall_event(event_post_syscall))
+        DR_ASSERT(false);
+    drmgr_exit();
+    dr_mutex_destroy(global_hist_lock);
+    dr_mutex_destroy(queue_lock);
+    dr_mutex_destroy(write_lock);
+}
+
+/****************************************************************************
+ * Initialization
+ */
+
+static void
+options_init(client_id_t id)
+{
+    const char *opstr = dr_get_options(id);
+    /* i#1049: DR should provide a utility routine to split the string
+     * into an array of tokens.
+     */
+    if (strstr(opstr, "-event_stream") != NULL)
+        options.event_stream = true;
+    options.logdir = strstr(opstr, "-logdir ");
+    if (options.logdir != NULL) {
+        options.logdir += strlen("-logdir");
+        for (; *options.logdir == ' '; options.logdir++);
+        ASSERT(options.logdir[0] != '\0' && dr_directory_exists(options.logdir),
+               "invalid logdir");
+    }
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    dr_log(NULL, LOG_ALL, 1, "Client 'syscallprof' initializing\n");
+#ifdef SHOW_RESULTS
+    if (dr_is_notify_on()) {
+# ifdef WINDOWS
+        /* ask for best-effort printing to cmd window.  must be called in dr_init(). */
+        dr_enable_console_printing();
+# endif
+        dr_fprintf(STDERR, "Client syscallprof is running\n");
+    }
+#endif
+    client_id = id;
+    options_init(id);
+    drmgr_init();
+    global_hist_lock = dr_mutex_create();
+    queue_lock = dr_mutex_create();
+    write_lock = dr_mutex_create();
+    if (options.event_stream) {
+        stream_file = log_file_open("bin");
+        if (stream_file == INVALID_FILE ||
+            !dr_create_client_thread(writer_thread, NULL)) {
+            ASSERT(false, "unable to set up the event stream");
+            if (stream_file != INVALID_FILE)
+                dr_close_file(stream_file);
+            options.event_stream = false;
+        }
+    }
+    tls_idx = drmgr_register_tls_field();
+    DR_ASSERT(tls_idx != -1);
+    tcls_idx = drmgr_register_cls_field(event_thread_context_init,
+                                        event_thread_context_exit);
+    DR_ASSERT(tcls_idx != -1);
+    dr_register_exit_event(event_exit);
+    dr_register_filter_syscall_event(event_filter_syscall);
+    if (!drmgr_register_thread_init_event(event_thread_init) ||
+        !drmgr_register_thread_exit_event(event_thread_exit) ||
+        !drmgr_register_pre_syscall_event(event_pre_syscall) ||
+        !drmgr_register_post_syscall_event(event_post_syscall))
+        DR_ASSERT(false);
+}
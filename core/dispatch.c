@@ -160,8 +160,12 @@ dispatch(dcontext_t *dcontext)
          * fcache related work to do.
          */
         ASSERT(!RUNNING_WITHOUT_CODE_CACHE());
-        targetf = fragment_lookup_fine_and_coarse(dcontext, dcontext->next_tag,
-                                                  &coarse_f, dcontext->last_exit);
+        /* an IBL miss on this exit may already have walked the tables for us */
+        targetf = fragment_take_ibl_miss(dcontext, dcontext->next_tag);
+        if (targetf == NULL) {
+            targetf = fragment_lookup_fine_and_coarse(dcontext, dcontext->next_tag,
+                                                      &coarse_f, dcontext->last_exit);
+        }
         do {
             if (targetf != NULL) {
                 KSTART(monitor_enter);
@@ -519,6 +523,8 @@ enter_fcache(dcontext_t *dcontext, fcache_enter_func_t entry, cache_pc pc)
 static void
 handle_special_tag(dcontext_t *dcontext)
 {
+    /* we are not going straight to dispatch's lookup for this exit */
+    fragment_clear_ibl_miss(dcontext);
     if (native_exec_is_back_from_native(dcontext->next_tag)) {
         /* This can happen if we start interpreting a native module. */
         ASSERT(DYNAMO_OPTION(native_exec));
@@ -856,6 +862,8 @@ dispatch_exit_fcache(dcontext_t *dcontext)
 {
     /* case 7966: no distinction of islinking-ness for hotp_only & thin_client */
     ASSERT(RUNNING_WITHOUT_CODE_CACHE() || is_couldbelinking(dcontext));
+    /* any IBL miss record is from an earlier exit that never reached our lookup */
+    fragment_clear_ibl_miss(dcontext);
 
 #if defined(WINDOWS) && defined (CLIENT_INTERFACE)
     ASSERT(!is_dynamo_address(dcontext->app_fls_data));
@@ -948,11 +956,8 @@ dispatch_exit_fcache(dcontext_t *dcontext)
         /* update IBL target tables for any indirect branch exit */
         SELF_PROTECT_LOCAL(dcontext, WRITABLE);
         /* update IBL target table if target is a valid IBT */
-        /* FIXME: This is good for modularity but adds
-         * extra lookups in the fragment table.  If it is
-         * performance problem can we do it better?
-         * Probably best to get bb2bb to work better and
-         * not worry about optimizing DR code.
+        /* This also records the fragment it finds so that dispatch's own
+         * lookup of next_tag below does not have to walk the tables again.
          */
         fragment_add_ibl_target(dcontext, dcontext->next_tag, 
                                 extract_branchtype(dcontext->last_exit->flags));
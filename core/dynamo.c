@@ -766,7 +766,18 @@ dynamorio_fork_init(dcontext_t *dcontext)
     for (i=0; i<num_threads; i++) {
         if (threads[i] == dcontext->thread_record)
             remove_thread(threads[i]->id);
-        else
+        else if (DYNAMO_OPTION(fork_skip_thread_cleanup)) {
+            /* Leave the thread's state as copy-on-write memory we never write
+             * again: this makes fork cost independent of the parent's thread
+             * count at the price of leaking that state in the child.  We
+             * still must clear any FRAG_TRACE_BUILDING it set on a shared
+             * trace head, or that trace can never be built in the child.
+             * trace_abort() would also unlink and free the thread's fragments
+             * and heap, so we only clear the flag.
+             */
+            trace_release_shared_head(dcontext, threads[i]->dcontext);
+            remove_thread(threads[i]->id);
+        } else
             dynamo_other_thread_exit(threads[i]);
     }
     mutex_unlock(&thread_initexit_lock);
@@ -898,6 +909,10 @@ void
 dynamo_process_exit_with_thread_info(void)
 {
     perscache_fast_exit(); /* "fast" b/c called in release as well */
+    if (DYNAMO_OPTION(rstats_to_stderr))
+        dump_global_rstats_to_stderr();
+    if (DYNAMO_OPTION(prof_locks))
+        dump_lock_profile();
 }
 
 /* shared between app_exit and detach */
@@ -919,9 +934,7 @@ dynamo_shared_exit(IF_WINDOWS_(thread_record_t *toexit)
     hardware_perfctr_exit();
 #endif
 #ifdef DEBUG
-#  ifdef INTERNAL
     print_optimization_stats();
-#  endif
     DOLOG(1, LOG_STATS, {
         dump_global_stats(false);
     });
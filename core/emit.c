@@ -135,6 +135,18 @@ stress_test_recreate(dcontext_t *dcontext, fragment_t *f,
 }
 #endif /* INTERNAL */
 
+/* Returns the last instr of the fragment body proper, skipping any cold
+ * instrs that mangle placed out of line after it.
+ */
+instr_t *
+final_hot_instr(instrlist_t *ilist)
+{
+    instr_t *inst = instrlist_last(ilist);
+    while (inst != NULL && instr_is_cold(inst))
+        inst = instr_get_prev(inst);
+    return inst;
+}
+
 /* here instead of link.c b/c link.c doesn't deal w/ Instrs */
 bool
 final_exit_shares_prev_stub(dcontext_t *dcontext, instrlist_t *ilist, uint frag_flags)
@@ -142,10 +154,10 @@ final_exit_shares_prev_stub(dcontext_t *dcontext, instrlist_t *ilist, uint frag_
     /* if a cbr is final exit pair, should they share a stub? */
     if (INTERNAL_OPTION(cbr_single_stub) && !TEST(FRAG_COARSE_GRAIN, frag_flags)) {
         /* don't need to expand since is_exit_cti will rule out level 0 */
-        instr_t *inst = instrlist_last(ilist);
-        /* FIXME: we could support code after the last cti (this is ubr so
-         * would be out-of-line code) or between cbr and ubr but for
-         * simplicity of identifying exits for traces we don't
+        instr_t *inst = final_hot_instr(ilist);
+        /* FIXME: we could support code between cbr and ubr but for
+         * simplicity of identifying exits for traces we don't.  Cold code
+         * after the last cti is skipped.
          */
         if (instr_is_exit_cti(inst) && instr_is_ubr(inst)) {
             /* don't need to expand since is_exit_cti will rule out level 0 */
@@ -298,7 +310,7 @@ set_linkstub_fields(dcontext_t *dcontext, fragment_t *f, instrlist_t *ilist,
                            /* FIXME: this duplicates calc of final_cbr_single_stub
                             * bool cached in emit_fragment_common()
                             */
-                           (inst == instrlist_last(ilist) && 
+                           (inst == final_hot_instr(ilist) && 
                             final_exit_shares_prev_stub(dcontext, ilist, f->flags)));
                 } else {
                     direct_linkstub_t *dl = (direct_linkstub_t *) l;
@@ -512,7 +524,7 @@ emit_fragment_common(dcontext_t *dcontext, app_pc tag,
 
                 /* if a cbr is final exit pair, should they share a stub? */
                 if (INTERNAL_OPTION(cbr_single_stub) &&
-                    inst == instrlist_last(ilist) && 
+                    inst == final_hot_instr(ilist) && 
                     final_exit_shares_prev_stub(dcontext, ilist, flags)) {
                     final_cbr_single_stub = true;
                     STATS_INC(num_cbr_single_stub);
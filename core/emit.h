@@ -74,6 +74,9 @@ void stress_test_recreate(dcontext_t *dcontext, fragment_t *f,
                           instrlist_t *ilist);
 # endif
 
+instr_t *
+final_hot_instr(instrlist_t *ilist);
+
 bool
 final_exit_shares_prev_stub(dcontext_t *dcontext, instrlist_t *ilist, uint frag_flags);
 
@@ -396,6 +396,13 @@ struct _fcache;
 
 #define UNIT_RESERVED_SIZE(u) ((size_t)((u)->reserved_end_pc - (u)->start_pc))
 
+/* Granularity of a unit's pc lookup map (see fcache_unit_t.pcmap): a
+ * fcache_fragment_pclookup only walks the slots overlapping one granule.
+ */
+#define PCMAP_GRANULARITY 256
+#define UNIT_PCMAP_SIZE(reserved) \
+    (((reserved) / PCMAP_GRANULARITY) * sizeof(uint))
+
 typedef struct _fcache_unit_t {
     cache_pc start_pc;         /* start address of fcache storage */
     cache_pc end_pc;           /* end address of committed storage, open-ended */
@@ -422,6 +429,11 @@ typedef struct _fcache_unit_t {
 #endif    
     uint flushtime;            /* free this unit when this flushtime is freed --
                                 * used only for units_to_free list, else 0 */
+    /* For each PCMAP_GRANULARITY-aligned offset in [start_pc, cur_pc), the offset
+     * of the cache slot containing it.  Kept up to date by pcmap_set_slot() on
+     * every slot creation or coalescing.  NULL for coarse-grain units.
+     */
+    uint *pcmap;
     struct _fcache_unit_t *next_global; /* used to link all units */
     struct _fcache_unit_t *prev_global; /* used to link all units */
     struct _fcache_unit_t *next_local;  /* used to link an fcache_t's units */
@@ -904,6 +916,23 @@ fcache_unit_profile_stop(fcache_unit_t *u)
 }
 #endif
 
+static uint *
+pcmap_alloc(size_t reserved_size)
+{
+    return (uint *) nonpersistent_heap_alloc(GLOBAL_DCONTEXT,
+                                             UNIT_PCMAP_SIZE(reserved_size)
+                                             HEAPACCT(ACCT_MEM_MGT));
+}
+
+static void
+pcmap_free(uint *pcmap, size_t reserved_size)
+{
+    if (pcmap != NULL) {
+        nonpersistent_heap_free(GLOBAL_DCONTEXT, pcmap, UNIT_PCMAP_SIZE(reserved_size)
+                                HEAPACCT(ACCT_MEM_MGT));
+    }
+}
+
 static inline void
 remove_unit_from_cache(fcache_unit_t *u)
 {
@@ -954,6 +983,7 @@ fcache_really_free_unit(fcache_unit_t *u, bool on_dead_list, bool dealloc_unit)
     if (dealloc_unit)
         heap_munmap((void*)u->start_pc, UNIT_RESERVED_SIZE(u));
     /* always dealloc the metadata */
+    pcmap_free(u->pcmap, UNIT_RESERVED_SIZE(u));
     nonpersistent_heap_free(GLOBAL_DCONTEXT, u, sizeof(fcache_unit_t)
                             HEAPACCT(ACCT_MEM_MGT));
 }
@@ -1114,6 +1144,24 @@ fcache_lookup_unit(cache_pc pc)
     return (fcache_unit_t *) vmvector_lookup(fcache_unit_areas, pc);
 }
 
+/* Records that the cache slot [start, start+size) now contains the start of every
+ * pcmap granule it overlaps.  Must be called whenever a slot is created, grown,
+ * or coalesced with its neighbors, while holding the cache lock.
+ */
+static inline void
+pcmap_set_slot(fcache_unit_t *unit, cache_pc start, size_t size)
+{
+    uint offs, end, granule;
+    if (unit->pcmap == NULL)
+        return;
+    ASSERT(start >= unit->start_pc && start + size <= unit->reserved_end_pc);
+    offs = (uint) (start - unit->start_pc);
+    end = offs + (uint) size;
+    for (granule = (uint) ALIGN_FORWARD(offs, PCMAP_GRANULARITY);
+         granule < end; granule += PCMAP_GRANULARITY)
+        unit->pcmap[granule / PCMAP_GRANULARITY] = offs;
+}
+
 /* Returns the fragment_t whose body (not cache slot) contains lookup_pc */  
 fragment_t *
 fcache_fragment_pclookup(dcontext_t *dcontext, cache_pc lookup_pc, fragment_t *wrapper)
@@ -1149,7 +1197,19 @@ fcache_fragment_pclookup(dcontext_t *dcontext, cache_pc lookup_pc, fragment_t *w
             return fragment_pclookup_by_htable(dcontext, lookup_pc, wrapper);
         }
     });
+    if (lookup_pc < unit->start_pc || lookup_pc >= unit->cur_pc) {
+        /* Not yet claimed, or the old memory of a unit we just resized and
+         * whose unmap is still pending: no fragment can be here.
+         */
+        PROTECT_CACHE(unit->cache, unlock);
+        return NULL;
+    }
+    /* Start at the slot containing the start of lookup_pc's granule rather
+     * than walking every slot from the top of the unit.
+     */
     pc = unit->start_pc;
+    if (unit->pcmap != NULL)
+        pc += unit->pcmap[(lookup_pc - unit->start_pc) / PCMAP_GRANULARITY];
     while (pc < unit->cur_pc && pc < lookup_pc) {
         f = *((fragment_t **)pc);
         LOG(THREAD, LOG_CACHE, 6, "\treading "PFX" -> "PFX"\n", pc, f);
@@ -1313,6 +1373,7 @@ fcache_create_unit(dcontext_t *dcontext, fcache_t *cache, cache_pc pc, size_t si
         u = (fcache_unit_t *)
             nonpersistent_heap_alloc(GLOBAL_DCONTEXT, sizeof(fcache_unit_t)
                                      HEAPACCT(ACCT_MEM_MGT));
+        u->pcmap = NULL;
         if (pc != NULL) {
             u->start_pc = pc;
             commit_size = size;
@@ -1348,6 +1409,10 @@ fcache_create_unit(dcontext_t *dcontext, fcache_t *cache, cache_pc pc, size_t si
 
     cache->size += u->size;
 
+    /* coarse units have no slot headers and use their own lookup */
+    if (u->pcmap == NULL && !cache->is_coarse)
+        u->pcmap = pcmap_alloc(UNIT_RESERVED_SIZE(u));
+
     u->cur_pc = u->start_pc;
     u->full = false;
     u->cache = cache;
@@ -1962,6 +2027,7 @@ fcache_increase_size(dcontext_t *dcontext, fcache_t *cache, fcache_unit_t *unit,
                  * here and re-add down below
                  */
                 vmvector_remove(fcache_unit_areas, u->start_pc, u->reserved_end_pc);
+                pcmap_free(u->pcmap, UNIT_RESERVED_SIZE(u));
                 nonpersistent_heap_free(GLOBAL_DCONTEXT, u, sizeof(fcache_unit_t)
                                         HEAPACCT(ACCT_MEM_MGT));
                 break;
@@ -2026,6 +2092,16 @@ fcache_increase_size(dcontext_t *dcontext, fcache_t *cache, fcache_unit_t *unit,
         tu->pending_unmap_size = UNIT_RESERVED_SIZE(unit);
     }
 
+    /* pcmap entries are offsets so they survive the shift; just copy them
+     * over to a map that covers the new reservation
+     */
+    if (unit->pcmap != NULL) {
+        uint *new_pcmap = pcmap_alloc(new_size);
+        memcpy(new_pcmap, unit->pcmap, UNIT_PCMAP_SIZE(UNIT_RESERVED_SIZE(unit)));
+        pcmap_free(unit->pcmap, UNIT_RESERVED_SIZE(unit));
+        unit->pcmap = new_pcmap;
+    }
+
     /* whether newly allocated or taken from dead list, increase cache->size
      * by the difference between new size and old size
      */
@@ -2301,10 +2377,12 @@ fifo_prepend_empty(dcontext_t *dcontext, fcache_t *cache, fcache_unit_t *unit,
             FRAG_START_ASSIGN(cache->fifo, start_pc + HEADER_SIZE_FROM_CACHE(cache));
             *((fragment_t **)start_pc) = cache->fifo;
             FRAG_SIZE_ASSIGN(cache->fifo, FRAG_SIZE(cache->fifo) + size);
+            pcmap_set_slot(unit, start_pc, FRAG_SIZE(cache->fifo));
             return;
         } else if (FRAG_HDR_START(cache->fifo) + FRAG_SIZE(cache->fifo) == start_pc) {
             LOG(THREAD, LOG_CACHE, 5, "prepend: just enlarging prev empty\n");
             FRAG_SIZE_ASSIGN(cache->fifo, FRAG_SIZE(cache->fifo) + size);
+            pcmap_set_slot(unit, FRAG_HDR_START(cache->fifo), FRAG_SIZE(cache->fifo));
             return;
         }
     }
@@ -2317,6 +2395,7 @@ fifo_prepend_empty(dcontext_t *dcontext, fcache_t *cache, fcache_unit_t *unit,
     *((empty_slot_t **)start_pc) = slot;
     slot->start_pc = start_pc + HEADER_SIZE_FROM_CACHE(cache);
     slot->fcache_size = size;
+    pcmap_set_slot(unit, start_pc, size);
     /* stick on front */
     slot->next_fcache = cache->fifo;
     if (cache->fifo == NULL)
@@ -3076,6 +3155,7 @@ add_to_free_list(dcontext_t *dcontext, fcache_t *cache, fcache_unit_t *unit,
     footer = free_list_footer_from_header(header);
     ASSERT_TRUNCATE(footer->size, ushort, size);
     footer->size = (ushort) size;
+    pcmap_set_slot(unit, start_pc, size);
     if (cache->free_list[bucket] != NULL) {
         ASSERT(cache->free_list[bucket]->prev == NULL);
         cache->free_list[bucket]->prev = header;
@@ -3459,6 +3539,7 @@ fcache_return_extra_space(dcontext_t *dcontext, fragment_t *f, size_t space_in)
                     FRAG_START_ASSIGN(next_f, returnable_start + HEADER_SIZE(f));
                     *((fragment_t **)returnable_start) = next_f;
                     FRAG_SIZE_ASSIGN(next_f, FRAG_SIZE(next_f) + returnable_space);
+                    pcmap_set_slot(unit, returnable_start, FRAG_SIZE(next_f));
                     released = true;
                 }
             }
@@ -3626,6 +3707,9 @@ fcache_add_fragment(dcontext_t *dcontext, fragment_t *f)
         cache->name, cache->units->size/1024, f->id, f->size, slot_size);
     
     add_fragment_common(dcontext, cache, f, slot_size);
+    /* f's slot size is only final once add_fragment_common returns */
+    if (!cache->is_coarse)
+        pcmap_set_slot(FIFO_UNIT(f), FRAG_HDR_START(f), FRAG_SIZE(f));
     ASSERT(!PAD_JMPS_SHIFT_START(f->flags) ||
            ALIGNED(f->start_pc, START_PC_ALIGNMENT)); /* for start_pc padding to work */
     DOLOG(3, LOG_CACHE, {
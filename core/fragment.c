@@ -254,6 +254,8 @@ static uint fragment_heap_size(uint flags, int direct_exits, int indirect_exits)
 
 static void fragment_free_future(dcontext_t *dcontext, future_fragment_t *fut);
 
+static inline void fragment_forget_ibl_miss(fragment_t *f);
+
 #if defined(RETURN_AFTER_CALL) || defined(RCT_IND_BRANCH)
 static void
 coarse_persisted_fill_ibl(dcontext_t *dcontext, coarse_info_t *info,
@@ -1174,6 +1176,10 @@ hashtable_fragment_reset(dcontext_t *dcontext, fragment_table_t *table)
      * perform lookups.
      */
     i = table->capacity - 1 - 1 /* sentinel */;
+#ifdef CLIENT_INTERFACE
+    /* everything is going away: report as a single all-encompassing range */
+    instrument_fragment_delete_batch_start(NULL, (app_pc)POINTER_MAX);
+#endif
     while (i >= 0) {
         f = table->table[i];
         if (f == &null_fragment) {
@@ -1227,6 +1233,9 @@ hashtable_fragment_reset(dcontext_t *dcontext, fragment_table_t *table)
             }
         }
     }
+#ifdef CLIENT_INTERFACE
+    instrument_fragment_delete_batch_end();
+#endif
     table->entries = 0;
     table->unlinked_entries = 0;
 }
@@ -1335,6 +1344,9 @@ fragment_reset_init(void)
                                     0 /* hash_mask_offset */,
                                     FRAG_TABLE_SHARED | FRAG_TABLE_TARGET_SHARED
                                     _IF_DEBUG("shared_bb"));
+            /* looked up on every dispatch but added to far less often */
+            if (DYNAMO_OPTION(scalable_rwlocks))
+                rwlock_make_scalable(&shared_bb->rwlock);
         }
         if (DYNAMO_OPTION(shared_traces)) {
             hashtable_fragment_init(GLOBAL_DCONTEXT, shared_trace,
@@ -1344,6 +1356,8 @@ fragment_reset_init(void)
                                     0 /* hash_mask_offset */,
                                     FRAG_TABLE_SHARED | FRAG_TABLE_TARGET_SHARED
                                     _IF_DEBUG("shared_trace"));
+            if (DYNAMO_OPTION(scalable_rwlocks))
+                rwlock_make_scalable(&shared_trace->rwlock);
         }
         /* init routine will work for future_fragment_t* same as for fragment_t* */
         hashtable_fragment_init(GLOBAL_DCONTEXT, shared_future,
@@ -1879,6 +1893,8 @@ fragment_thread_reset_init(dcontext_t *dcontext)
      * so we have to explicitly set to 0 for that case.
      */
     pt->flushtime_last_update = (dynamo_resetting) ? 0 : flushtime_global;
+    pt->ibl_miss_tag = NULL;
+    pt->ibl_miss_fragment = NULL;
 
     /* set initial hashtable sizes */
     hashtable_fragment_init(dcontext, &pt->bb, INIT_HTABLE_SIZE_BB,
@@ -2829,6 +2845,16 @@ fragment_lookup_trace(dcontext_t *dcontext, app_pc tag)
     return fragment_lookup_type(dcontext, tag, LOOKUP_TRACE|LOOKUP_PRIVATE|LOOKUP_SHARED);
 }
 
+uint
+fragment_private_trace_count(dcontext_t *dcontext)
+{
+    per_thread_t *pt = (per_thread_t *) dcontext->fragment_field;
+    if (!PRIVATE_TRACES_ENABLED() || dcontext == GLOBAL_DCONTEXT)
+        return 0;
+    /* only the owning thread adds to its table so no lock is needed for a count */
+    return pt->trace.entries;
+}
+
 /* lookup a fragment tag, but only look in bb tables
  * N.B.: because of shadowing this may not return what fragment_lookup() returns!
  */
@@ -3109,6 +3135,7 @@ fragment_delete(dcontext_t *dcontext, fragment_t *f, uint actions)
     });
     ASSERT((f->flags & FRAG_CANNOT_DELETE) == 0);
     ASSERT((f->flags & FRAG_IS_FUTURE) == 0);
+    fragment_forget_ibl_miss(f);
 
     /* ensure the actual free of a shared fragment is done only
      * after a multi-stage flush or a reset
@@ -3932,6 +3959,7 @@ fragment_remove(dcontext_t *dcontext, fragment_t *f)
     fragment_table_t *table = GET_FTABLE(pt, f->flags);
 
     ASSERT(TEST(FRAG_SHARED, f->flags) || dcontext != GLOBAL_DCONTEXT);
+    fragment_forget_ibl_miss(f);
     /* For consistency we remove entries from the IBT
      * tables before we remove them from the trace table.
      */
@@ -3970,6 +3998,7 @@ fragment_replace(dcontext_t *dcontext, fragment_t *f, fragment_t *new_f)
 {
     per_thread_t *pt = GET_PT(dcontext);
     fragment_table_t *table = GET_FTABLE(pt, f->flags);
+    fragment_forget_ibl_miss(f);
     TABLE_RWLOCK(table, write, lock);
     if (hashtable_fragment_replace(f, new_f, table)) {
         fragment_entry_t fe = FRAGENTRY_FROM_FRAGMENT(f);
@@ -4244,6 +4273,67 @@ fragment_add_ibl_target_helper(dcontext_t *dcontext, fragment_t *f,
     });
 }
 
+/* Remembers that an IBL miss on tag resolved to f, for
+ * fragment_lookup_fine_and_coarse() to hand straight to dispatch.
+ * Coarse-grain wrappers live on our stack and must not be recorded.
+ */
+static inline void
+fragment_record_ibl_miss(per_thread_t *pt, app_pc tag, fragment_t *f)
+{
+    ASSERT(!TEST(FRAG_COARSE_GRAIN, f->flags));
+    pt->ibl_miss_tag = tag;
+    pt->ibl_miss_fragment = f;
+}
+
+/* Drops this thread's IBL miss record, if any.  Dispatch calls this on every
+ * cache exit and on paths that leave for somewhere other than its own lookup,
+ * so a record never outlives the exit it was made for.
+ */
+void
+fragment_clear_ibl_miss(dcontext_t *dcontext)
+{
+    per_thread_t *pt;
+    if (dcontext == NULL || dcontext == GLOBAL_DCONTEXT ||
+        dcontext->fragment_field == NULL)
+        return;
+    pt = (per_thread_t *) dcontext->fragment_field;
+    pt->ibl_miss_tag = NULL;
+    pt->ibl_miss_fragment = NULL;
+}
+
+/* Called when f leaves the lookup tables or is freed.  Only the current thread
+ * can hold a record that is about to be consumed, so that is the one we check.
+ */
+static inline void
+fragment_forget_ibl_miss(fragment_t *f)
+{
+    dcontext_t *dcontext = get_thread_private_dcontext();
+    if (dcontext != NULL && dcontext != GLOBAL_DCONTEXT &&
+        dcontext->fragment_field != NULL &&
+        ((per_thread_t *) dcontext->fragment_field)->ibl_miss_fragment == f)
+        fragment_clear_ibl_miss(dcontext);
+}
+
+/* Returns the fragment the IBL miss of the exit dispatch is handling resolved
+ * to, if it is for tag, and consumes the record either way.  Only dispatch's
+ * lookup right after that exit may use this: fragment_clear_ibl_miss() and
+ * fragment_forget_ibl_miss() keep the record from outliving the exit or f.
+ */
+fragment_t *
+fragment_take_ibl_miss(dcontext_t *dcontext, app_pc tag)
+{
+    per_thread_t *pt = (per_thread_t *) dcontext->fragment_field;
+    fragment_t *res = (pt->ibl_miss_tag == tag) ? pt->ibl_miss_fragment : NULL;
+    pt->ibl_miss_tag = NULL;
+    pt->ibl_miss_fragment = NULL;
+    /* a shared fragment is only freed after being marked deleted by a flush */
+    if (res != NULL && TEST(FRAG_WAS_DELETED, res->flags))
+        res = NULL;
+    if (res != NULL)
+        STATS_INC(num_ibt_miss_lookups_reused);
+    return res;
+}
+
 /* IBL targeted fragments per branch type */
 fragment_t *
 fragment_add_ibl_target(dcontext_t *dcontext, app_pc tag,
@@ -4255,7 +4345,9 @@ fragment_add_ibl_target(dcontext_t *dcontext, app_pc tag,
 
     if (SHARED_BB_ONLY_IB_TARGETS()) {
         f = fragment_lookup_bb(dcontext, tag);
-        if (f == NULL) {
+        if (f != NULL)
+            fragment_record_ibl_miss(pt, tag, f);
+        else {
             f = fragment_coarse_lookup_wrapper(dcontext, tag, &wrapper);
             if (f != NULL) {
 #if defined(RETURN_AFTER_CALL) || defined(RCT_IND_BRANCH)
@@ -4298,6 +4390,11 @@ fragment_add_ibl_target(dcontext_t *dcontext, app_pc tag,
         if (f == NULL && DYNAMO_OPTION(bb_ibl_targets)) {
             /* Populate with bb's that are not trace heads */
             f = fragment_lookup_bb(dcontext, tag);
+            /* Record the target before we filter out trace heads below:
+             * dispatch wants it regardless of whether it goes in the table.
+             */
+            if (f != NULL)
+                fragment_record_ibl_miss(pt, tag, f);
             /* We don't add trace heads OR when a trace is targetting a BB. In the
              * latter case, the BB will shortly be marked as a trace head and
              * removed from the IBT table so we don't needlessly add it.
@@ -4309,7 +4406,8 @@ fragment_add_ibl_target(dcontext_t *dcontext, app_pc tag,
                 f = NULL; /* ignore fragment */
                 STATS_INC(num_ib_th_target); /* counted in num_ibt_cold_misses */
             }
-        }
+        } else if (f != NULL)
+            fragment_record_ibl_miss(pt, tag, f);
     }
 
     LOG(THREAD, LOG_FRAGMENT, 3,
@@ -4328,18 +4426,23 @@ fragment_add_ibl_target(dcontext_t *dcontext, app_pc tag,
          * only during an IBL miss, since that's the first time that
          * accessing the old table inflicted a cost (a context switch).
          */
-        /* NOTE We could be more aggressive and update the private ptrs for
-         * all tables, not just the one being added to, by calling
-         * update_all_private_ibt_table_ptrs(). We could be even more
-         * aggressive by updating all ptrs on every cache exit in
+        /* NOTE If this table was stale we also update the private ptrs for
+         * all other tables via update_all_private_ibt_table_ptrs(). We could
+         * be more aggressive by updating all ptrs on every cache exit in
          * enter_couldbelinking() but that could also prove to be more
          * expensive by invoking the update logic when an IBL miss didn't
          * occur. However, more frequent updates could lead to old tables
          * being freed earlier. We can revisit this if we see old tables
          * piling up and not being freed in a timely manner.
          */
-        update_private_ibt_table_ptrs(dcontext, ibl_table
-                                      _IF_DEBUG(&orig_lookuptable));
+        if (update_private_ibt_table_ptrs(dcontext, ibl_table
+                                          _IF_DEBUG(&orig_lookuptable))) {
+            /* Shared tables tend to be resized in bursts (e.g., at startup or
+             * a new module load), so pick up the other branch types' new
+             * tables now instead of taking a separate miss for each.
+             */
+            update_all_private_ibt_table_ptrs(dcontext, pt);
+        }
 
         /* We can't place a private fragment into a thread-shared table.
          * Nothing prevents a sandboxed or ignore syscalls frag from being
@@ -7606,7 +7709,9 @@ static app_to_cache_t a2c_sentinel = { /*assume invalid*/(app_pc)PTR_UINT_MINUS_
 
 static void
 hashtable_coarse_init_internal_custom(dcontext_t *dcontext, coarse_table_t *htable)
-{ /* nothing */
+{
+    htable->mph_disp = NULL;
+    htable->mph_buckets = 0;
 }
 
 static void
@@ -7657,6 +7762,217 @@ hashtable_coarse_free_entry(dcontext_t *dcontext, coarse_table_t *htable,
  * we only avoid exit stub overhead for trace heads when the base
  * matches).
  */
+
+/* Minimal perfect hashing for finalized frozen tables.
+ * Frozen units never change, so once freezing (or merging) completes we
+ * replace the open-address table with a dense array of exactly entries
+ * slots, using hash-and-displace: each key hashes to a bucket, and each
+ * bucket holds the seed that maps all of its keys to distinct slots.
+ * Single-key buckets instead hold their slot directly (MPH_DIRECT), which
+ * lets us fill the last free slots without searching for a seed.
+ * A lookup is thus two hashes plus one slot comparison, with no probing,
+ * and the persisted table carries no empty slots.
+ */
+#define MPH_KEYS_PER_BUCKET 2
+#define MPH_DIRECT 0x80000000
+/* we give up and keep the open-address table if a bucket needs more */
+#define MPH_MAX_SEED (1 << 20)
+
+static inline uint
+coarse_mph_hash(ptr_uint_t key, uint seed)
+{
+    /* 64-bit finalizer from MurmurHash3 */
+    uint64 h = (uint64)key ^ ((uint64)seed * 0x9e3779b97f4a7c15ULL);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return (uint)h;
+}
+
+/* maps a hash into [0, n) without a divide */
+#define MPH_REDUCE(h, n) ((uint)(((uint64)(h) * (n)) >> 32))
+
+static inline uint
+coarse_mph_slot(coarse_table_t *table, ptr_uint_t key)
+{
+    uint disp = table->mph_disp[coarse_mph_hash(key, 0) & (table->mph_buckets - 1)];
+    if (TEST(MPH_DIRECT, disp))
+        return disp & ~MPH_DIRECT;
+    return MPH_REDUCE(coarse_mph_hash(key, disp + 1), table->capacity);
+}
+
+/* Looks up a raw (persist-time) key in either form of table */
+static inline app_to_cache_t
+coarse_lookup_raw(dcontext_t *dcontext, ptr_uint_t key, coarse_table_t *table)
+{
+    if (table->mph_buckets != 0) {
+        app_to_cache_t a2c = table->table[coarse_mph_slot(table, key)];
+        if ((ptr_uint_t)a2c.app == key)
+            return a2c;
+        return a2c_empty;
+    }
+    return hashtable_coarse_lookup(dcontext, key, table);
+}
+
+/* Returns false if no displacement was found, leaving htable untouched */
+static bool
+coarse_mph_build(dcontext_t *dcontext, coarse_table_t *htable)
+{
+    uint n = htable->entries;
+    uint old_capacity = htable->capacity;
+    uint num_buckets, num_used, num_words, i, j, k, b, seed, max_size;
+    uint *bucket_of, *bucket_size, *bucket_start, *members, *order, *used, *disp;
+    uint *slots;
+    app_to_cache_t *dense, *dense_unaligned;
+    size_t dense_size;
+    bool ok = true;
+    if (n == 0 || n >= MPH_DIRECT)
+        return false;
+    num_buckets = 1;
+    while (num_buckets * MPH_KEYS_PER_BUCKET < n)
+        num_buckets <<= 1;
+    num_words = (n + 31) / 32;
+
+    bucket_of = HEAP_ARRAY_ALLOC(dcontext, uint, old_capacity, ACCT_FRAG_TABLE,
+                                 UNPROTECTED);
+    bucket_size = HEAP_ARRAY_ALLOC(dcontext, uint, num_buckets, ACCT_FRAG_TABLE,
+                                   UNPROTECTED);
+    bucket_start = HEAP_ARRAY_ALLOC(dcontext, uint, num_buckets + 1, ACCT_FRAG_TABLE,
+                                    UNPROTECTED);
+    members = HEAP_ARRAY_ALLOC(dcontext, uint, n, ACCT_FRAG_TABLE, UNPROTECTED);
+    order = HEAP_ARRAY_ALLOC(dcontext, uint, num_buckets, ACCT_FRAG_TABLE, UNPROTECTED);
+    used = HEAP_ARRAY_ALLOC(dcontext, uint, num_words, ACCT_FRAG_TABLE, UNPROTECTED);
+    disp = HEAP_ARRAY_ALLOC(GLOBAL_DCONTEXT, uint, num_buckets, ACCT_FRAG_TABLE,
+                            PROTECTED);
+    memset(bucket_size, 0, num_buckets * sizeof(uint));
+    memset(used, 0, num_words * sizeof(uint));
+    memset(disp, 0, num_buckets * sizeof(uint));
+
+    /* bucket the keys, then lay out each bucket's members contiguously */
+    max_size = 0;
+    for (i = 0; i < htable->capacity; i++) {
+        if (A2C_ENTRY_IS_REAL(htable->table[i])) {
+            bucket_of[i] = coarse_mph_hash((ptr_uint_t)htable->table[i].app, 0) &
+                (num_buckets - 1);
+            bucket_size[bucket_of[i]]++;
+            if (bucket_size[bucket_of[i]] > max_size)
+                max_size = bucket_size[bucket_of[i]];
+        }
+    }
+    bucket_start[0] = 0;
+    for (b = 0; b < num_buckets; b++)
+        bucket_start[b + 1] = bucket_start[b] + bucket_size[b];
+    ASSERT(bucket_start[num_buckets] == n);
+    for (b = 0; b < num_buckets; b++)
+        bucket_size[b] = 0;
+    for (i = 0; i < htable->capacity; i++) {
+        if (A2C_ENTRY_IS_REAL(htable->table[i])) {
+            b = bucket_of[i];
+            members[bucket_start[b] + bucket_size[b]] = i;
+            bucket_size[b]++;
+        }
+    }
+    /* Largest buckets first, while the most slots are free */
+    k = 0;
+    for (j = max_size; j > 0; j--) {
+        for (b = 0; b < num_buckets; b++) {
+            if (bucket_size[b] == j)
+                order[k++] = b;
+        }
+    }
+    num_used = k;
+    slots = HEAP_ARRAY_ALLOC(dcontext, uint, max_size, ACCT_FRAG_TABLE, UNPROTECTED);
+
+    /* Place multi-key buckets by searching for a seed */
+    for (k = 0; k < num_used; k++) {
+        b = order[k];
+        if (bucket_size[b] < 2)
+            break;
+        for (seed = 0; seed < MPH_MAX_SEED; seed++) {
+            for (j = 0; j < bucket_size[b]; j++) {
+                app_pc key = htable->table[members[bucket_start[b] + j]].app;
+                uint pos = MPH_REDUCE(coarse_mph_hash((ptr_uint_t)key, seed + 1), n);
+                uint m;
+                if (TEST(1U << (pos % 32), used[pos / 32]))
+                    break;
+                for (m = 0; m < j; m++) {
+                    if (slots[m] == pos)
+                        break;
+                }
+                if (m < j)
+                    break;
+                slots[j] = pos;
+            }
+            if (j == bucket_size[b])
+                break;
+        }
+        if (seed == MPH_MAX_SEED) {
+            ok = false;
+            break;
+        }
+        disp[b] = seed;
+        for (j = 0; j < bucket_size[b]; j++)
+            used[slots[j] / 32] |= 1U << (slots[j] % 32);
+    }
+    if (ok) {
+        /* Now fill the remaining slots directly from single-key buckets */
+        j = 0;
+        for (; k < num_used; k++) {
+            b = order[k];
+            ASSERT(bucket_size[b] == 1);
+            while (TEST(1U << (j % 32), used[j / 32]))
+                j++;
+            ASSERT(j < n);
+            disp[b] = MPH_DIRECT | j;
+            used[j / 32] |= 1U << (j % 32);
+        }
+    }
+
+    if (ok) {
+        /* allocate just like hashtable_coarse_init() so hashtable_coarse_free() works */
+        dense_size = hashtable_coarse_table_aligned_size(n, htable->table_flags);
+        dense_unaligned = (app_to_cache_t *) TABLE_MEMOP(htable->table_flags, alloc)
+            (GLOBAL_DCONTEXT, dense_size HEAPACCT(ACCT_FRAG_TABLE));
+        if (TEST(HASHTABLE_ALIGN_TABLE, htable->table_flags)) {
+            dense = (app_to_cache_t *)
+                ALIGN_FORWARD(dense_unaligned, proc_get_cache_line_size());
+        } else
+            dense = dense_unaligned;
+        for (b = 0; b < num_buckets; b++) {
+            for (j = 0; j < bucket_size[b]; j++) {
+                app_to_cache_t a2c = htable->table[members[bucket_start[b] + j]];
+                uint pos = TEST(MPH_DIRECT, disp[b]) ? (disp[b] & ~MPH_DIRECT) :
+                    MPH_REDUCE(coarse_mph_hash((ptr_uint_t)a2c.app, disp[b] + 1), n);
+                dense[pos] = a2c;
+            }
+        }
+        hashtable_coarse_free_table(GLOBAL_DCONTEXT, htable->table_unaligned,
+                                    htable->table_flags, htable->capacity);
+        htable->table_unaligned = dense_unaligned;
+        htable->table = dense;
+        htable->capacity = n;
+        htable->mph_disp = disp;
+        htable->mph_buckets = num_buckets;
+    } else {
+        HEAP_ARRAY_FREE(GLOBAL_DCONTEXT, disp, uint, num_buckets, ACCT_FRAG_TABLE,
+                        PROTECTED);
+    }
+
+    HEAP_ARRAY_FREE(dcontext, slots, uint, max_size, ACCT_FRAG_TABLE, UNPROTECTED);
+    HEAP_ARRAY_FREE(dcontext, used, uint, num_words, ACCT_FRAG_TABLE, UNPROTECTED);
+    HEAP_ARRAY_FREE(dcontext, order, uint, num_buckets, ACCT_FRAG_TABLE, UNPROTECTED);
+    HEAP_ARRAY_FREE(dcontext, members, uint, n, ACCT_FRAG_TABLE, UNPROTECTED);
+    HEAP_ARRAY_FREE(dcontext, bucket_start, uint, num_buckets + 1, ACCT_FRAG_TABLE,
+                    UNPROTECTED);
+    HEAP_ARRAY_FREE(dcontext, bucket_size, uint, num_buckets, ACCT_FRAG_TABLE,
+                    UNPROTECTED);
+    HEAP_ARRAY_FREE(dcontext, bucket_of, uint, old_capacity, ACCT_FRAG_TABLE,
+                    UNPROTECTED);
+    return ok;
+}
+
 static inline app_to_cache_t
 coarse_lookup_internal(dcontext_t *dcontext, app_pc tag, coarse_table_t *table)
 {
@@ -7664,7 +7980,7 @@ coarse_lookup_internal(dcontext_t *dcontext, app_pc tag, coarse_table_t *table)
      * this is a table for this module only
      */
     app_to_cache_t a2c =
-        hashtable_coarse_lookup(dcontext, (ptr_uint_t)(tag + table->mod_shift), table);
+        coarse_lookup_raw(dcontext, (ptr_uint_t)(tag + table->mod_shift), table);
     if (table->mod_shift != 0 && A2C_ENTRY_IS_REAL(a2c))
         a2c.app -= table->mod_shift;
     return a2c;
@@ -7772,6 +8088,39 @@ fragment_coarse_htable_merge_helper(dcontext_t *dcontext,
     DODEBUG({ dtable->is_local = false; });
 }
 
+/* Like hashtable_coarse_num_unique_entries() but handles finalized tables */
+static uint
+coarse_htable_num_unique_entries(dcontext_t *dcontext, coarse_table_t *src1,
+                                 coarse_table_t *src2)
+{
+    coarse_table_t *big, *small;
+    uint unique, i;
+    app_to_cache_t a2c;
+    if (src1->entries >= src2->entries) {
+        big = src1;
+        small = src2;
+    } else {
+        big = src2;
+        small = src1;
+    }
+    unique = big->entries;
+    /* see hashtable_coarse_num_unique_entries() on why we can't take both locks */
+    ASSERT(dynamo_all_threads_synched);
+    DODEBUG({ big->is_local = true; });
+    TABLE_RWLOCK(small, read, lock);
+    for (i = 0; i < small->capacity; i++) {
+        a2c = small->table[i];
+        if (A2C_ENTRY_IS_REAL(a2c)) {
+            if (A2C_ENTRY_IS_EMPTY(coarse_lookup_raw(dcontext, (ptr_uint_t)a2c.app,
+                                                     big)))
+                unique++;
+        }
+    }
+    TABLE_RWLOCK(small, read, unlock);
+    DODEBUG({ big->is_local = false; });
+    return unique;
+}
+
 /* Merges the main and th htables from info1 and info2 into new htables for dst.
  * If !add_info2, makes room for but does not add entries from info2.
  * If !add_th_htable, creates but does not add entries to dst->th_htable.
@@ -7801,7 +8150,7 @@ fragment_coarse_htable_merge(dcontext_t *dcontext, coarse_info_t *dst,
      * collision asserts.  FIXME: should we shrink afterward instead?
      * Or just ignore collision asserts until at full size?
      */
-    merged_entries = hashtable_coarse_num_unique_entries(dcontext, ht1, ht2);
+    merged_entries = coarse_htable_num_unique_entries(dcontext, ht1, ht2);
     STATS_ADD(coarse_merge_dups, ht1->entries + ht2->entries - merged_entries);
     LOG(THREAD, LOG_FRAGMENT, 2, "Merging %s: %d + %d => %d (%d unique) entries\n",
         info1->module, ht1->entries, ht2->entries, ht1->entries + ht2->entries,
@@ -7856,15 +8205,18 @@ study_and_free_coarse_htable(coarse_info_t *info, coarse_table_t *htable,
 {
     LOG(GLOBAL, LOG_FRAGMENT, 1, "Coarse %s %s hashtable stats:\n",
         info->module, name);
-    DOLOG(1, LOG_FRAGMENT|LOG_STATS, {
-        hashtable_coarse_load_statistics(GLOBAL_DCONTEXT, htable);
-    });
-    DODEBUG({
-        hashtable_coarse_study(GLOBAL_DCONTEXT, htable, 0/*table consistent*/);
-    });
-    DOLOG(3, LOG_FRAGMENT, {
-        hashtable_coarse_dump_table(GLOBAL_DCONTEXT, htable);
-    });
+    /* a finalized table is not laid out by the generic hash so skip the study */
+    if (htable->mph_buckets == 0) {
+        DOLOG(1, LOG_FRAGMENT|LOG_STATS, {
+            hashtable_coarse_load_statistics(GLOBAL_DCONTEXT, htable);
+        });
+        DODEBUG({
+            hashtable_coarse_study(GLOBAL_DCONTEXT, htable, 0/*table consistent*/);
+        });
+        DOLOG(3, LOG_FRAGMENT, {
+            hashtable_coarse_dump_table(GLOBAL_DCONTEXT, htable);
+        });
+    }
 #ifdef CLIENT_INTERFACE
     /* Only raise deletion events if client saw creation events: so no persisted
      * units
@@ -7876,6 +8228,7 @@ study_and_free_coarse_htable(coarse_info_t *info, coarse_table_t *htable,
         dcontext_t *dcontext = get_thread_private_dcontext();
         cache_pc body = NULL;
         TABLE_RWLOCK(htable, read, lock);
+        instrument_fragment_delete_batch_start(info->base_pc, info->end_pc);
         for (i = 0; i < htable->capacity; i++) {
             a2c = htable->table[i];
             if (A2C_ENTRY_IS_REAL(a2c)) {
@@ -7891,6 +8244,7 @@ study_and_free_coarse_htable(coarse_info_t *info, coarse_table_t *htable,
                 }
             }
         }
+        instrument_fragment_delete_batch_end();
         TABLE_RWLOCK(htable, read, unlock);
     }
 #endif
@@ -7899,13 +8253,22 @@ study_and_free_coarse_htable(coarse_info_t *info, coarse_table_t *htable,
         /* ensure won't try to free (part of mmap) */
         ASSERT(htable->table_unaligned == NULL);
     }
+    /* a resurrected table's displacements live in the mmapped file */
+    if (htable->mph_disp != NULL && !TEST(HASHTABLE_READ_ONLY, htable->table_flags)) {
+        HEAP_ARRAY_FREE(GLOBAL_DCONTEXT, htable->mph_disp, uint, htable->mph_buckets,
+                        ACCT_FRAG_TABLE, PROTECTED);
+    }
     hashtable_coarse_free(GLOBAL_DCONTEXT, htable);
     NONPERSISTENT_HEAP_TYPE_FREE(GLOBAL_DCONTEXT, htable, coarse_table_t, ACCT_FRAG_TABLE);
 }
 
+static void
+coarse_pclookup_array_free(coarse_info_t *info);
+
 void
 fragment_coarse_free_entry_pclookup_table(dcontext_t *dcontext, coarse_info_t *info)
 {
+    coarse_pclookup_array_free(info);
     if (info->pclookup_htable != NULL) {
         ASSERT(DYNAMO_OPTION(coarse_pclookup_table));
         study_and_free_coarse_htable(info, (coarse_table_t *) info->pclookup_htable,
@@ -7922,6 +8285,7 @@ fragment_coarse_htable_free(coarse_info_t *info)
         /* lazily initialized, so common to have empty units */
         ASSERT(info->th_htable == NULL);
         ASSERT(info->pclookup_htable == NULL);
+        ASSERT(info->pclookup_array == NULL);
         return;
     }
     study_and_free_coarse_htable(info, (coarse_table_t *) info->htable, false
@@ -7994,6 +8358,8 @@ fragment_coarse_add(dcontext_t *dcontext, coarse_info_t *info,
             ASSERT(f == NULL || TEST(FRAG_IS_TRACE, f->flags));
         }
     });
+    /* a finalized table has no room to grow */
+    ASSERT(htable->mph_buckets == 0);
     TABLE_RWLOCK(htable, write, lock);
     /* Table is not an ibl table so we ignore resize return value */
     hashtable_coarse_add(dcontext, a2c, htable);
@@ -8279,7 +8645,8 @@ fragment_t *
 fragment_lookup_fine_and_coarse(dcontext_t *dcontext, app_pc tag,
                                 fragment_t *wrapper, linkstub_t *last_exit)
 {
-    fragment_t *res = fragment_lookup(dcontext, tag);
+    fragment_t *res;
+    res = fragment_lookup(dcontext, tag);
     if (DYNAMO_OPTION(coarse_units)) {
         ASSERT(wrapper != NULL);
         if (res == NULL) {
@@ -8386,6 +8753,7 @@ fragment_coarse_replace(dcontext_t *dcontext, coarse_info_t *info, app_pc tag,
     bool res = false;
     ASSERT(info != NULL && info->htable != NULL);
     htable = (coarse_table_t *) info->htable;
+    ASSERT(htable->mph_buckets == 0);
     TABLE_RWLOCK(htable, read, lock);
     res = hashtable_coarse_replace(old_entry, new_entry, info->htable);
     TABLE_RWLOCK(htable, read, unlock);
@@ -8419,6 +8787,136 @@ pclookup_last_free(pclookup_last_t *last)
     HEAP_TYPE_FREE(GLOBAL_DCONTEXT, last, pclookup_last_t, ACCT_FRAG_TABLE, PROTECTED);
 }
 
+/* For frozen units the body layout never changes, so in place of the reverse
+ * htable we keep every body sorted by cache offset.  That serves both exact
+ * entry lookups and the containing-body lookups of fragment_coarse_pclookup()
+ * with a binary search, and costs no more than one app_to_cache_t per body.
+ * We store raw htable tags and cache offsets so that the array survives
+ * the unit moving (merging) and needs no mod_shift adjustment until lookup.
+ */
+typedef struct _coarse_pclookup_array_t {
+    uint num;
+    app_to_cache_t *entries; /* sorted by cache offset */
+} coarse_pclookup_array_t;
+
+static void
+coarse_pclookup_array_sift(app_to_cache_t *a, uint root, uint num)
+{
+    uint child;
+    app_to_cache_t tmp;
+    while ((child = 2 * root + 1) < num) {
+        if (child + 1 < num && a[child + 1].cache > a[child].cache)
+            child++;
+        if (a[root].cache >= a[child].cache)
+            return;
+        tmp = a[root];
+        a[root] = a[child];
+        a[child] = tmp;
+        root = child;
+    }
+}
+
+/* heapsort: we have no qsort in the core and want no worst-case recursion */
+static void
+coarse_pclookup_array_sort(app_to_cache_t *a, uint num)
+{
+    uint i;
+    app_to_cache_t tmp;
+    if (num < 2)
+        return;
+    for (i = num / 2; i > 0; i--)
+        coarse_pclookup_array_sift(a, i - 1, num);
+    for (i = num - 1; i > 0; i--) {
+        tmp = a[0];
+        a[0] = a[i];
+        a[i] = tmp;
+        coarse_pclookup_array_sift(a, 0, i);
+    }
+}
+
+static void
+coarse_pclookup_array_create(dcontext_t *dcontext, coarse_info_t *info)
+{
+    coarse_table_t *main_htable = (coarse_table_t *) info->htable;
+    coarse_pclookup_array_t *array;
+    uint i, num = 0;
+    ASSERT(info->frozen);
+    mutex_lock(&info->lock);
+    if (info->pclookup_array == NULL) {
+        array = HEAP_TYPE_ALLOC(GLOBAL_DCONTEXT, coarse_pclookup_array_t,
+                                ACCT_FRAG_TABLE, PROTECTED);
+        TABLE_RWLOCK(main_htable, read, lock);
+        array->entries = HEAP_ARRAY_ALLOC(GLOBAL_DCONTEXT, app_to_cache_t,
+                                          main_htable->entries, ACCT_FRAG_TABLE,
+                                          PROTECTED);
+        for (i = 0; i < main_htable->capacity; i++) {
+            /* must check for sentinel */
+            if (A2C_ENTRY_IS_REAL(main_htable->table[i])) {
+                ASSERT(num < main_htable->entries);
+                /* frozen htable only holds body offsets */
+                array->entries[num++] = main_htable->table[i];
+            }
+        }
+        TABLE_RWLOCK(main_htable, read, unlock);
+        ASSERT(num == main_htable->entries);
+        array->num = num;
+        coarse_pclookup_array_sort(array->entries, num);
+        STATS_INC(coarse_pclookup_arrays);
+        /* Only when fully initialized can we set it, as we hold no lock for it */
+        info->pclookup_array = (void *) array;
+    }
+    mutex_unlock(&info->lock);
+}
+
+static void
+coarse_pclookup_array_free(coarse_info_t *info)
+{
+    coarse_pclookup_array_t *array = (coarse_pclookup_array_t *) info->pclookup_array;
+    if (array == NULL)
+        return;
+    HEAP_ARRAY_FREE(GLOBAL_DCONTEXT, array->entries, app_to_cache_t, array->num,
+                    ACCT_FRAG_TABLE, PROTECTED);
+    HEAP_TYPE_FREE(GLOBAL_DCONTEXT, array, coarse_pclookup_array_t,
+                   ACCT_FRAG_TABLE, PROTECTED);
+    info->pclookup_array = NULL;
+}
+
+/* Returns the tag of the body beginning at pc, or if !exact of the last body
+ * beginning at or before pc, along with that body's start in body_out.
+ */
+static app_pc
+coarse_pclookup_array_find(dcontext_t *dcontext, coarse_info_t *info, cache_pc pc,
+                           bool exact, /*OUT*/cache_pc *body_out)
+{
+    coarse_pclookup_array_t *array;
+    app_pc offs;
+    uint lo, hi, mid;
+    if (info->pclookup_array == NULL)
+        coarse_pclookup_array_create(dcontext, info);
+    array = (coarse_pclookup_array_t *) info->pclookup_array;
+    ASSERT(array != NULL);
+    *body_out = NULL;
+    if (pc < info->cache_start_pc)
+        return NULL;
+    offs = (app_pc) (pc - info->cache_start_pc);
+    /* find the first entry whose offset is > offs */
+    lo = 0;
+    hi = array->num;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (array->entries[mid].cache <= offs)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == 0)
+        return NULL;
+    if (exact && array->entries[lo - 1].cache != offs)
+        return NULL;
+    *body_out = info->cache_start_pc + (ptr_uint_t) array->entries[lo - 1].cache;
+    return array->entries[lo - 1].app - ((coarse_table_t *) info->htable)->mod_shift;
+}
+
 /* Returns the tag for the coarse fragment whose body contains pc.
  * If that returned tag != NULL, also returns the body pc in the optional OUT param.
  * FIXME: verify not called too often: watch the kstat.
@@ -8441,6 +8939,16 @@ fragment_coarse_pclookup(dcontext_t *dcontext, coarse_info_t *info, cache_pc pc,
     KSTART(coarse_pclookup);
     htable = (coarse_table_t *) info->htable;
 
+    if (info->frozen && DYNAMO_OPTION(coarse_pclookup_table)) {
+        closest = coarse_pclookup_array_find(dcontext, info, pc, false/*containing*/,
+                                             &body_pc);
+        if (body_out != NULL)
+            *body_out = body_pc;
+        KSTOP(coarse_pclookup);
+        LOG(THREAD, LOG_FRAGMENT, 4, "%s: "PFX" => "PFX"\n", __FUNCTION__, pc, closest);
+        return closest;
+    }
+
     if (info->pclookup_last_htable == NULL) {
         /* lazily allocate table of all pclookups to avoid htable walk
          * on frequent codemod instrs (i#658).
@@ -8534,7 +9042,8 @@ fragment_coarse_pclookup(dcontext_t *dcontext, coarse_info_t *info, cache_pc pc,
 
 /* Creates a reverse lookup table.  For a non-frozen unit, the caller should only
  * do this while all threads are suspended, and should free the table before
- * resuming other threads.
+ * resuming other threads.  For a frozen unit this is a sorted array rather than
+ * an htable.
  */
 void
 fragment_coarse_create_entry_pclookup_table(dcontext_t *dcontext, coarse_info_t *info)
@@ -8548,6 +9057,11 @@ fragment_coarse_create_entry_pclookup_table(dcontext_t *dcontext, coarse_info_t
     ASSERT(info != NULL);
     if (info->htable == NULL)
         return;
+    if (info->frozen) {
+        if (info->pclookup_array == NULL)
+            coarse_pclookup_array_create(dcontext, info);
+        return;
+    }
     if (info->pclookup_htable == NULL) {
         mutex_lock(&info->lock);
         if (info->pclookup_htable == NULL) {
@@ -8640,6 +9154,13 @@ fragment_coarse_entry_pclookup(dcontext_t *dcontext, coarse_info_t *info, cache_
     }
     KSTART(coarse_pclookup);
 
+    if (info->frozen) {
+        res = coarse_pclookup_array_find(dcontext, info, pc, true/*exact*/, &body_pc);
+        KSTOP(coarse_pclookup);
+        LOG(THREAD, LOG_FRAGMENT, 4, "%s: "PFX" => "PFX"\n", __FUNCTION__, pc, res);
+        return res;
+    }
+
     if (info->pclookup_htable == NULL) {
         fragment_coarse_create_entry_pclookup_table(dcontext, info);
     }
@@ -8877,6 +9398,30 @@ fragment_coarse_unit_freeze(dcontext_t *dcontext, coarse_freeze_info_t *freeze_i
             "htable post-freezing %s\n", freeze_info->src_info->module);
         hashtable_coarse_study(dcontext, frozen_htable, 0/*clean state*/);
     });
+    /* No further adds to a frozen unit's main table */
+    fragment_coarse_htable_finalize(dcontext, freeze_info->dst_info);
+}
+
+void
+fragment_coarse_htable_finalize(dcontext_t *dcontext, coarse_info_t *info)
+{
+    coarse_table_t *htable = (coarse_table_t *) info->htable;
+    ASSERT(info->frozen);
+    if (htable == NULL || htable->mph_buckets != 0 || htable->entries == 0)
+        return;
+    /* Any reverse table must be rebuilt from the new layout: not expected */
+    ASSERT(info->pclookup_htable == NULL);
+    TABLE_RWLOCK(htable, write, lock);
+    if (coarse_mph_build(dcontext, htable)) {
+        STATS_INC(coarse_htable_mph);
+        LOG(THREAD, LOG_FRAGMENT, 2, "Coarse %s: %d entries in perfect hash w/ %d "
+            "buckets\n", info->module, htable->entries, htable->mph_buckets);
+    } else {
+        STATS_INC(coarse_htable_mph_fail);
+        LOG(THREAD, LOG_FRAGMENT, 1, "Coarse %s: no perfect hash for %d entries\n",
+            info->module, htable->entries);
+    }
+    TABLE_RWLOCK(htable, write, unlock);
 }
 
 uint
@@ -8885,7 +9430,11 @@ fragment_coarse_htable_persist_size(dcontext_t *dcontext, coarse_info_t *info,
 {
     coarse_table_t *htable = (coarse_table_t *)
         (cache_table ? info->htable : info->th_htable);
-    return hashtable_coarse_persist_size(dcontext, htable);
+    if (htable == NULL)
+        return 0;
+    /* the displacements follow the table */
+    return hashtable_coarse_persist_size(dcontext, htable) +
+        htable->mph_buckets * sizeof(uint);
 }
 
 /* Returns true iff all writes succeeded. */
@@ -8895,8 +9444,16 @@ fragment_coarse_htable_persist(dcontext_t *dcontext,  coarse_info_t *info,
 {
     coarse_table_t *htable = (coarse_table_t *)
         (cache_table ? info->htable : info->th_htable);
+    uint size;
     ASSERT(fd != INVALID_FILE);
-    return hashtable_coarse_persist(dcontext, htable, fd);
+    if (!hashtable_coarse_persist(dcontext, htable, fd))
+        return false;
+    if (htable->mph_buckets != 0) {
+        size = htable->mph_buckets * sizeof(uint);
+        if (os_write(fd, htable->mph_disp, size) != (int)size)
+            return false;
+    }
+    return true;
 }
 
 void
@@ -8913,6 +9470,12 @@ fragment_coarse_htable_resurrect(dcontext_t *dcontext,  coarse_info_t *info,
                                                    "persisted cache htable" :
                                                    "persisted stub htable"));
     (*htable)->mod_shift = info->mod_shift;
+    if ((*htable)->mph_buckets != 0) {
+        (*htable)->mph_disp = (uint *)
+            (mapped_table + sizeof(coarse_table_t) +
+             (*htable)->capacity * sizeof(app_to_cache_t));
+    } else
+        (*htable)->mph_disp = NULL;
     /* generally want to keep basic alignment */
     ASSERT_CURIOSITY(ALIGNED((*htable)->table, sizeof(app_pc)));
 }
@@ -494,6 +494,14 @@ typedef struct _per_thread_t {
      */
     bool           at_syscall_at_flush;
 
+    /* The fragment an IBL miss was resolved to by fragment_add_ibl_target(),
+     * handed to the dispatch lookup for the same exit so it need not repeat
+     * the table walk.  Cleared on each cache exit, on dispatch paths that skip
+     * that lookup, and when the fragment is removed, replaced, or deleted.
+     */
+    app_pc         ibl_miss_tag;
+    fragment_t    *ibl_miss_fragment;
+
 #ifdef PROFILE_LINKCOUNT
     uint tracedump_num_below_threshold;
     linkcount_type_t tracedump_count_below_threshold;
@@ -678,6 +686,10 @@ fragment_lookup_shared_bb(dcontext_t *dcontext, app_pc tag);
 fragment_t *
 fragment_lookup_trace(dcontext_t *dcontext, app_pc tag);
 
+/* returns the number of traces in dcontext's private trace table */
+uint
+fragment_private_trace_count(dcontext_t *dcontext);
+
 fragment_t *
 fragment_lookup_same_sharing(dcontext_t *dcontext, app_pc tag, uint flags);
 
@@ -827,7 +839,13 @@ typedef struct _app_to_cache_t {
 #define ENTRY_TYPE app_to_cache_t
 /* not defining HASHTABLE_USE_LOOKUPTABLE */
 #define CUSTOM_FIELDS \
-    ssize_t mod_shift;
+    ssize_t mod_shift; \
+    /* Minimal perfect hash for finalized frozen tables: when mph_buckets \
+     * is non-zero, table holds exactly capacity==entries entries placed \
+     * per mph_disp and must be accessed via coarse_lookup_internal(). \
+     */ \
+    uint *mph_disp; \
+    uint mph_buckets;
 #define HASHTABLEX_HEADER 1
 #include "hashtablex.h"
 #undef HASHTABLEX_HEADER
@@ -848,6 +866,12 @@ fragment_coarse_htable_merge(dcontext_t *dcontext, coarse_info_t *dst,
                              coarse_info_t *info1, coarse_info_t *info2,
                              bool add_info2, bool add_th_htable);
 
+/* Converts the main htable of a frozen unit, which must not change afterward,
+ * to a minimal perfect hash.
+ */
+void
+fragment_coarse_htable_finalize(dcontext_t *dcontext, coarse_info_t *info);
+
 uint
 fragment_coarse_num_entries(coarse_info_t *info);
 
@@ -891,6 +915,13 @@ fragment_t *
 fragment_lookup_fine_and_coarse(dcontext_t *dcontext, app_pc tag,
                                 fragment_t *wrapper, linkstub_t *last_exit);
 
+/* The IBL miss record left by fragment_add_ibl_target(), for dispatch only */
+fragment_t *
+fragment_take_ibl_miss(dcontext_t *dcontext, app_pc tag);
+
+void
+fragment_clear_ibl_miss(dcontext_t *dcontext);
+
 fragment_t *
 fragment_lookup_fine_and_coarse_sharing(dcontext_t *dcontext, app_pc tag,
                                         fragment_t *wrapper, linkstub_t *last_exit,
@@ -410,6 +410,8 @@ typedef struct _client_data_t {
     bool           invoke_another_syscall;
     /* flag for dr_get_mcontext (i#117/PR 395156) */
     bool           mcontext_in_dcontext;
+    /* buffered tags for the batched fragment deletion event, lazily allocated */
+    struct _delete_batch_t *delete_batch;
 } client_data_t;
 #else
 # define IS_CLIENT_THREAD(dcontext) false
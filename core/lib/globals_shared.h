@@ -1203,6 +1203,8 @@ enum {
     NUDGE_DEF(client, "Client nudge")                                           \
     /* security testing */                                                      \
     NUDGE_DEF(violation, "Simulate a security violation")                       \
+    /* profiling */                                                             \
+    NUDGE_DEF(lock_prof, "Dump -prof_locks lock profile to stderr")             \
     /* ADD NEW NUDGE_DEFs only immediately above this line  */                  \
     /* Since these are used as a bitmask only 32 types can be supported:
      * but on Linux only 28.  If we want more we can simply use the client_arg
@@ -387,6 +387,13 @@
     STATS_DEF("Fragments generated, bb and trace", num_fragments)
     RSTATS_DEF("Basic block fragments generated", num_bbs)
     RSTATS_DEF("Trace fragments generated", num_traces)
+    RSTATS_DEF("Trace fragments optimized", num_traces_optimized)
+    RSTATS_DEF("Trace opt stack_adjust: adjustments removed", opt_stack_adjust_removed)
+    RSTATS_DEF("Trace opt peephole: inc/dec replaced by add/sub", opt_incs_replaced)
+    RSTATS_DEF("Trace opt peephole: leave instrs expanded", opt_leaves_expanded)
+#ifdef CLIENT_INTERFACE
+    STATS_DEF("Basic block fragments prepopulated", num_bbs_prepopulated)
+#endif
 #ifdef X64
     STATS_DEF("32-bit basic block fragments generated", num_32bit_bbs)
     STATS_DEF("32-bit trace fragments generated", num_32bit_traces)
@@ -396,6 +403,7 @@
     STATS_DEF("Trace fragments aborted: shared race", num_aborted_traces_race)
     STATS_DEF("Trace fragments aborted: client bad mod", num_aborted_traces_client)
     STATS_DEF("Trace building aborted: shared race", num_trace_building_race)
+    RSTATS_DEF("Trace building skipped: thread budget", num_trace_budget_skips)
     STATS_DEF("Trace building truncated: next bb deleted", num_trace_next_bb_deleted)
     STATS_DEF("Trace building reset: no trace head",
               num_reset_trace_no_trace_head)
@@ -412,6 +420,7 @@
     STATS_DEF("Shadowed trace head deleted", shadowed_trace_head_deleted)
     STATS_DEF("Trace head counters reset on trace deletion", th_counter_reset)
     STATS_DEF("Trace heads re-marked", trace_head_remark)
+    STATS_DEF("Trace head counter index resizes", th_counter_index_resizes)
     STATS_DEF("Future fragments generated", num_future_fragments)
     STATS_DEF("Shared fragments generated", num_shared_fragments)
     STATS_DEF("Shared bbs generated", num_shared_bbs)
@@ -462,6 +471,7 @@
     STATS_DEF("BBs that write no arithmetic flags", bbs_eflags_writes_none)
     STATS_DEF("BBs that write no arithmetic flags, end in ib", bbs_eflags_writes_none_ind)
     STATS_DEF("Cbrs sharing a single exit stub", num_cbr_single_stub)
+    STATS_DEF("Cold instr runs moved out of line", num_cold_runs_moved)
     STATS_DEF("Fragments requiring post_linkstub offs", num_fragment_post_linkstub)
     STATS_DEF("Fragments smaller than minimum fcache slot size", num_fragment_too_small)
     STATS_DEF("Fragments final size < minimum fcache slot size", num_final_fragment_too_small)
@@ -518,6 +528,7 @@
     STATS_DEF("BB fragments targeted by IBL", num_bbs_ibl_targets)
     STATS_DEF("Exits due to IBL cold misses", num_ibt_cold_misses)
     STATS_DEF("Exits due to IB targeting TH", num_ib_th_target)
+    STATS_DEF("IBL misses dispatched w/o re-lookup", num_ibt_miss_lookups_reused)
     STATS_DEF("Exits preventable if IB targeted bbs", num_ibt_bb_preventable)
     STATS_DEF("Extra exits due to trace building", num_ibt_exit_trace_building)
     STATS_DEF("Extra exits due to IBL sentinel leaks, BAD", num_ibt_leaks_likely_sentinel)
@@ -605,6 +616,7 @@
     STATS_DEF("Coarse grain units persisted: attempts", coarse_units_persist_try)
     STATS_DEF("Coarse grain units persist-at-unload attempts", persist_unload_try)
     STATS_DEF("Coarse grain units persisted: success", coarse_units_persist)
+    STATS_DEF("Coarse grain units persisted: position-indep", coarse_units_persist_pic)
     STATS_DEF("Coarse grain fragments frozen", coarse_fragments_frozen)
     STATS_DEF("Coarse grain code persisted (bytes)", coarse_code_persisted)
     STATS_DEF("Coarse grain units not persisted: too small", persist_too_small)
@@ -642,6 +654,9 @@
     STATS_DEF("Coarse units executed while invalid", coarse_executed_invalid)
     STATS_DEF("Coarse region merged with IAT post-rebind", coarse_merge_IAT)
     STATS_DEF("Coarse pclookup cached entries", coarse_pclookup_cached)
+    STATS_DEF("Coarse pclookup sorted arrays built", coarse_pclookup_arrays)
+    STATS_DEF("Coarse htables finalized to perfect hash", coarse_htable_mph)
+    STATS_DEF("Coarse htables left open-addressed", coarse_htable_mph_fail)
 
     STATS_DEF("Hotpatch match requiring persisted cache flush", hotp_persist_flush)
 
@@ -658,6 +673,7 @@
     STATS_DEF("Persisted cache load error: md5 mismatch", perscache_md5_mismatch)
     STATS_DEF("Persisted cache load error: modinfo mismatch", perscache_modinfo_mismatch)
     STATS_DEF("Persisted cache load error: modbase mismatch", perscache_base_mismatch)
+    STATS_DEF("Persisted caches used at a different modbase", perscache_rebased)
     STATS_DEF("Persisted cache load error: region mismatch", perscache_region_mismatch)
     STATS_DEF("Persisted cache load error: tls offs mismatch", perscache_tls_mismatch)
     STATS_DEF("Persisted cache load error: no trace support", perscache_trace_mismatch)
@@ -1200,3 +1216,5 @@
     /* i#107 handle application using same segment register */
     STATS_DEF("App reference with FS/GS seg being mangled", app_seg_refs_mangled)
     STATS_DEF("App access FS/GS seg being mangled", app_mov_seg_mangled)
+    STATS_DEF("Scalable reader-writer locks", num_scalable_rwlocks)
+    STATS_DEF("Scalable rwlock reads that waited for a writer", num_scalable_rwlock_read_waits)
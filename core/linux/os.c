@@ -8768,31 +8768,51 @@ mutex_notify_released_lock(mutex_t *lock)
 }
 
 /* read_write_lock_t implementation doesn't expect the contention path
-   helpers to guarantee the lock is held (unlike mutexes) so simple
-   yields are still acceptable.
+   helpers to guarantee the lock is held (unlike mutexes) so spurious
+   wakeups are fine: callers re-check and loop.  Without futex(2) we
+   fall back to yielding.
 */
 void
 rwlock_wait_contended_writer(read_write_lock_t *rwlock)
 {
-    thread_yield();
+    /* Any reader leaving changes num_readers, so we only sleep if none has
+     * since we looked; the last one out calls rwlock_notify_writer().
+     */
+    int readers = rwlock->num_readers;
+    if (kernel_futex_support && readers > 0)
+        futex_wait(&rwlock->num_readers, readers);
+    else
+        thread_yield();
 }
 
 void
 rwlock_notify_writer(read_write_lock_t *rwlock)
 {
-    /* nothing to do here */
+    if (kernel_futex_support)
+        futex_wake(&rwlock->num_readers);
 }
 
 void
 rwlock_wait_contended_reader(read_write_lock_t *rwlock)
 {
-    thread_yield();
+    /* The caller has already incremented num_pending_readers, so a writer
+     * releasing after our mutex_testlock() bumps writer_releases and we
+     * either see the new value or are woken.
+     */
+    int releases = rwlock->writer_releases;
+    if (!kernel_futex_support)
+        thread_yield();
+    else if (mutex_testlock(&rwlock->lock))
+        futex_wait(&rwlock->writer_releases, releases);
 }
 
 void
 rwlock_notify_readers(read_write_lock_t *rwlock)
 {
-    /* nothing to do here */
+    if (kernel_futex_support) {
+        ATOMIC_INC(int, rwlock->writer_releases);
+        futex_wake_all(&rwlock->writer_releases);
+    }
 }
 
 /***************************************************************************/
@@ -83,6 +83,8 @@ extern bool mangle_trace(dcontext_t *dcontext, instrlist_t *ilist, monitor_data_
 
 #define INIT_COUNTER_TABLE_SIZE 9
 #define COUNTER_TABLE_LOAD 75
+#define INIT_COUNTER_IDS 128
+#define THCOUNTER_NONE UINT_MAX
 /* counters must be in unprotected memory
  * we don't support local unprotected so we use global
  */
@@ -105,6 +107,8 @@ DECLARE_CXTSWPROT_VAR(mutex_t trace_building_lock, INIT_LOCK_FREE(trace_building
  * using a sentinel value to determine whether we've built a trace or not
  */
 #define TH_COUNTER_CREATED_TRACE_VALUE() (INTERNAL_OPTION(trace_threshold) + 1U)
+/* Sentinel for a head this thread skipped for -private_trace_budget */
+#define TH_COUNTER_BUDGET_SKIP_VALUE() (INTERNAL_OPTION(trace_threshold) + 2U)
 
 static void
 delete_private_copy(dcontext_t *dcontext)
@@ -339,6 +343,21 @@ monitor_exit()
     DELETE_LOCK(trace_building_lock);
 }
 
+/* Allocates an empty tag index of 2^bits slots */
+static void
+thcounter_index_init(dcontext_t *dcontext, trace_head_table_t *table, uint bits)
+{
+    table->hash_bits = bits;
+    table->hash_mask = HASH_MASK(table->hash_bits);
+    table->hash_mask_offset = 0;
+    table->capacity = HASHTABLE_SIZE(table->hash_bits);
+    table->entries = 0;
+    table->resize_threshold = table->capacity * table->load_factor_percent / 100;
+    table->index = (uint *)
+        COUNTER_ALLOC(dcontext, table->capacity*sizeof(uint) HEAPACCT(ACCT_THCOUNTER));
+    memset(table->index, 0, table->capacity*sizeof(uint));
+}
+
 void
 monitor_thread_init(dcontext_t *dcontext)
 {
@@ -362,27 +381,21 @@ monitor_thread_init(dcontext_t *dcontext)
     /* trace head counters are thread-private and must be kept in a
      * separate table and not in the fragment_t structure.
      */
-    md->thead_table.hash_bits = INIT_COUNTER_TABLE_SIZE;
-    md->thead_table.hash_mask = HASH_MASK(md->thead_table.hash_bits);
-    md->thead_table.hash_mask_offset = 0;
     md->thead_table.hash_func = (hash_function_t)INTERNAL_OPTION(alt_hash_func);
-    md->thead_table.capacity = HASHTABLE_SIZE(md->thead_table.hash_bits);
-    md->thead_table.entries = 0;
     md->thead_table.load_factor_percent = COUNTER_TABLE_LOAD;
-    md->thead_table.resize_threshold =
-        md->thead_table.capacity * md->thead_table.load_factor_percent / 100;
-    md->thead_table.counter_table = (trace_head_counter_t **)
-        COUNTER_ALLOC(dcontext, md->thead_table.capacity*sizeof(trace_head_counter_t*)
+    thcounter_index_init(dcontext, &md->thead_table, INIT_COUNTER_TABLE_SIZE);
+    md->thead_table.ids_capacity = INIT_COUNTER_IDS;
+    md->thead_table.num_ids = 0;
+    md->thead_table.free_id = THCOUNTER_NONE;
+    md->thead_table.counters = (trace_head_counter_t *)
+        COUNTER_ALLOC(dcontext, md->thead_table.ids_capacity*sizeof(trace_head_counter_t)
                       HEAPACCT(ACCT_THCOUNTER));
-    memset(md->thead_table.counter_table, 0, md->thead_table.capacity*
-           sizeof(trace_head_counter_t*));
 }
 
 /* atexit cleanup */
 void
 monitor_thread_exit(dcontext_t *dcontext)
 {
-    DEBUG_DECLARE(uint i;)
     DEBUG_DECLARE(monitor_data_t *md = (monitor_data_t *) dcontext->monitor_field;)
 
     /* For non-debug we do fast exit path and don't free local heap.
@@ -404,102 +417,123 @@ monitor_thread_exit(dcontext_t *dcontext)
      * FIXME: could set initial sizes to 0 for all configurations, instead
      */
     if (!RUNNING_WITHOUT_CODE_CACHE()) {
-        for (i = 0; i < md->thead_table.capacity; i++) {
-            trace_head_counter_t *e = md->thead_table.counter_table[i];
-            while (e) {
-                trace_head_counter_t *nexte = e->next;
-                COUNTER_FREE(dcontext, e, sizeof(trace_head_counter_t)
-                             HEAPACCT(ACCT_THCOUNTER));
-                e = nexte;
-            }
-            md->thead_table.counter_table[i] = NULL;
-        }
-        COUNTER_FREE(dcontext, md->thead_table.counter_table,
-                     md->thead_table.capacity*sizeof(trace_head_counter_t*)
+        COUNTER_FREE(dcontext, md->thead_table.counters,
+                     md->thead_table.ids_capacity*sizeof(trace_head_counter_t)
                      HEAPACCT(ACCT_THCOUNTER));
+        COUNTER_FREE(dcontext, md->thead_table.index,
+                     md->thead_table.capacity*sizeof(uint) HEAPACCT(ACCT_THCOUNTER));
     }
     heap_free(dcontext, md, sizeof(monitor_data_t) HEAPACCT(ACCT_TRACE));
 #endif
 }
 
-static trace_head_counter_t *
+/* Returns the id of tag's counter, or THCOUNTER_NONE */
+static uint
 thcounter_lookup(dcontext_t *dcontext, app_pc tag)
 {
     monitor_data_t *md = (monitor_data_t *) dcontext->monitor_field;
-    trace_head_counter_t *e;
-    uint hindex = HASH_FUNC((ptr_uint_t)tag, &md->thead_table);
-    for (e = md->thead_table.counter_table[hindex]; e; e = e->next) {
-        if (e->tag == tag)
-            return e;
-    }
-    return NULL;
+    trace_head_table_t *table = &md->thead_table;
+    uint hindex = HASH_FUNC((ptr_uint_t)tag, table);
+    /* linear probing: the index is never full as we resize at the load factor */
+    for (; table->index[hindex] != 0; hindex = (hindex + 1) & (table->capacity - 1)) {
+        uint id = table->index[hindex] - 1;
+        if (table->counters[id].tag == tag)
+            return id;
+    }
+    return THCOUNTER_NONE;
 }
 
-static trace_head_counter_t *
-thcounter_add(dcontext_t *dcontext, app_pc tag)
+static void
+thcounter_index_insert(trace_head_table_t *table, app_pc tag, uint id)
 {
-    monitor_data_t *md = (monitor_data_t *) dcontext->monitor_field;
-    uint hindex;
-    /* counters may be persistent while fragment comes and goes from cache */
-    trace_head_counter_t *e = thcounter_lookup(dcontext, tag);
-    if (e)
-        return e;
-    e = (trace_head_counter_t *)
-        COUNTER_ALLOC(dcontext, sizeof(trace_head_counter_t) HEAPACCT(ACCT_THCOUNTER));
-    e->tag = tag;
-    e->counter = 0;
-    hindex = HASH_FUNC((ptr_uint_t)e->tag, &md->thead_table);
-    e->next = md->thead_table.counter_table[hindex];
-    md->thead_table.counter_table[hindex] = e;
-    return e;
+    uint hindex = HASH_FUNC((ptr_uint_t)tag, table);
+    while (table->index[hindex] != 0)
+        hindex = (hindex + 1) & (table->capacity - 1);
+    table->index[hindex] = id + 1;
+    table->entries++;
 }
 
-#if 0 /* not used */
-/* delete the trace head entry corresponding to tag if it exists */
+/* Replaces the tag index with an empty one of 2^bits slots and inserts every
+ * live counter.  Used both to grow and to drop removed ids, which is simpler
+ * than deleting from the middle of a linear-probing chain.
+ */
 static void
-thcounter_remove(dcontext_t *dcontext, app_pc tag)
+thcounter_index_rebuild(dcontext_t *dcontext, trace_head_table_t *table, uint bits)
+{
+    uint id;
+    COUNTER_FREE(dcontext, table->index, table->capacity*sizeof(uint)
+                 HEAPACCT(ACCT_THCOUNTER));
+    thcounter_index_init(dcontext, table, bits);
+    for (id = 0; id < table->num_ids; id++) {
+        if (table->counters[id].tag != NULL)
+            thcounter_index_insert(table, table->counters[id].tag, id);
+    }
+}
+
+/* Returns the id of tag's counter, adding a zeroed counter if it has none.
+ * May move table->counters: callers must not hold counter pointers across it.
+ */
+static uint
+thcounter_add(dcontext_t *dcontext, app_pc tag)
 {
     monitor_data_t *md = (monitor_data_t *) dcontext->monitor_field;
-    trace_head_counter_t *e, *prev_e = NULL;
-    uint hindex = HASH_FUNC((ptr_uint_t)tag, &md->thead_table);
-    for (e = md->thead_table.counter_table[hindex]; e; prev_e = e, e = e->next) {
-        if (e->tag == tag) {
-            if (prev_e)
-                prev_e->next = e->next;
-            else
-                md->thead_table.counter_table[hindex] = e->next;
-            COUNTER_FREE(dcontext, e, sizeof(trace_head_counter_t) HEAPACCT(ACCT_THCOUNTER));
-            break;
+    trace_head_table_t *table = &md->thead_table;
+    /* counters may be persistent while fragment comes and goes from cache */
+    uint id = thcounter_lookup(dcontext, tag);
+    if (id != THCOUNTER_NONE)
+        return id;
+    if (table->free_id != THCOUNTER_NONE) {
+        id = table->free_id;
+        table->free_id = table->counters[id].counter;
+    } else {
+        if (table->num_ids == table->ids_capacity) {
+            uint new_capacity = table->ids_capacity * 2;
+            trace_head_counter_t *grown = (trace_head_counter_t *)
+                COUNTER_ALLOC(dcontext, new_capacity*sizeof(trace_head_counter_t)
+                              HEAPACCT(ACCT_THCOUNTER));
+            memcpy(grown, table->counters,
+                   table->num_ids*sizeof(trace_head_counter_t));
+            COUNTER_FREE(dcontext, table->counters,
+                         table->ids_capacity*sizeof(trace_head_counter_t)
+                         HEAPACCT(ACCT_THCOUNTER));
+            table->counters = grown;
+            table->ids_capacity = new_capacity;
         }
+        id = table->num_ids++;
     }
+    table->counters[id].tag = tag;
+    table->counters[id].counter = 0;
+    table->counters[id].reached = 0;
+    thcounter_index_insert(table, tag, id);
+    if (table->entries > table->resize_threshold) {
+        thcounter_index_rebuild(dcontext, table, table->hash_bits + 1);
+        STATS_INC(th_counter_index_resizes);
+    }
+    return id;
 }
-#endif
 
 /* Deletes all trace head entries in [start,end) */
 void
 thcounter_range_remove(dcontext_t *dcontext, app_pc start, app_pc end)
 {
     monitor_data_t *md = (monitor_data_t *) dcontext->monitor_field;
-    trace_head_counter_t *e, *prev_e = NULL, *next_e;
-    uint i;
+    trace_head_table_t *table = &md->thead_table;
+    bool removed = false;
+    uint id;
     /* ensure no synch needed */
     ASSERT(dcontext == get_thread_private_dcontext() ||
            is_self_flushing() || is_self_allsynch_flushing());
-    for (i = 0; i < md->thead_table.capacity; i++) {
-        for (e = md->thead_table.counter_table[i], prev_e = NULL;
-             e != NULL; e = next_e) {
-            next_e = e->next;
-            if (e->tag >= start && e->tag < end) {
-                if (prev_e != NULL)
-                    prev_e->next = next_e;
-                else
-                    md->thead_table.counter_table[i] = next_e;
-                COUNTER_FREE(dcontext, e, sizeof(trace_head_counter_t)
-                             HEAPACCT(ACCT_THCOUNTER));
-            } else
-                prev_e = e;
+    for (id = 0; id < table->num_ids; id++) {
+        trace_head_counter_t *e = &table->counters[id];
+        if (e->tag != NULL && e->tag >= start && e->tag < end) {
+            e->tag = NULL;
+            e->counter = table->free_id;
+            table->free_id = id;
+            removed = true;
         }
     }
+    if (removed)
+        thcounter_index_rebuild(dcontext, table, table->hash_bits);
 }
 
 bool
@@ -523,29 +557,82 @@ cur_trace_vmlist(dcontext_t *dcontext)
     return md->trace_vmlist;
 }
 
-static void
-reset_trace_state(dcontext_t *dcontext, bool grab_link_lock)
+#ifdef CLIENT_INTERFACE
+/* Returns the number of times this thread reached the head of the trace
+ * being built before selecting it, or 0 if not called from the trace event.
+ */
+uint
+trace_head_count(dcontext_t *dcontext)
+{
+    monitor_data_t *md = (monitor_data_t *) dcontext->monitor_field;
+    if (!md->in_trace_event)
+        return 0;
+    return md->trace_head_count;
+}
+
+/* Returns the number of bbs in the trace being built and stores up to
+ * max_tags of their tags, in trace order, into tags.
+ */
+uint
+trace_component_tags(dcontext_t *dcontext, app_pc *tags, uint max_tags)
 {
     monitor_data_t *md = (monitor_data_t *) dcontext->monitor_field;
     uint i;
-    /* reset the trace buffer */
-    instrlist_init(&(md->trace));
-#ifdef CLIENT_INTERFACE
-    if (instrlist_first(&md->unmangled_ilist) != NULL)
-        instrlist_clear(dcontext, &md->unmangled_ilist);
-    instrlist_init(&md->unmangled_ilist);
-    if (md->unmangled_bb_ilist != NULL)
-        instrlist_clear_and_destroy(dcontext, md->unmangled_bb_ilist);
-    md->unmangled_bb_ilist = NULL;
-#endif
-    md->trace_buf_top = 0;
-    ASSERT(md->trace_vmlist == NULL);
-    for (i = 0; i < md->num_blks; i++) {
-        vm_area_destroy_list(dcontext, md->blk_info[i].vmlist);
-        md->blk_info[i].vmlist = NULL;
+    if (!md->in_trace_event)
+        return 0;
+    for (i = 0; tags != NULL && i < md->num_blks && i < max_tags; i++)
+        tags[i] = md->blk_info[i].info.tag;
+    return md->num_blks;
+}
+
+/* Stores into count the number of times the index-th bb of the trace being
+ * built took its exit to target (NULL for its indirect exit): 1 or 0 for
+ * the run that selected the trace, plus, with PROFILE_LINKCOUNT and
+ * -prof_counts, the link count from when the bb executed on its own.
+ * Returns false if index is out of range or not called from the trace event.
+ */
+bool
+trace_component_exit_count(dcontext_t *dcontext, uint index, app_pc target,
+                           uint64 *count)
+{
+    monitor_data_t *md = (monitor_data_t *) dcontext->monitor_field;
+    trace_bb_build_t *blk;
+# ifdef PROFILE_LINKCOUNT
+    fragment_t *f;
+    linkstub_t *l;
+# endif
+    if (!md->in_trace_event || index >= md->num_blks || count == NULL)
+        return false;
+    blk = &md->blk_info[index];
+    *count = (target == NULL ? blk->exit_indirect :
+              (!blk->exit_indirect && blk->exit_target == target)) ? 1 : 0;
+# ifdef PROFILE_LINKCOUNT
+    if (!dynamo_options.profile_counts)
+        return true;
+    f = fragment_lookup_bb(dcontext, blk->info.tag);
+    /* coarse-grain bbs have no per-exit data */
+    if (f == NULL || TEST(FRAG_COARSE_GRAIN, f->flags))
+        return true;
+    for (l = FRAGMENT_EXIT_STUBS(f); l != NULL; l = LINKSTUB_NEXT_EXIT(l)) {
+        if (LINKSTUB_DIRECT(l->flags) ?
+            (target != NULL && EXIT_TARGET_TAG(dcontext, f, l) == target) :
+            (target == NULL && LINKSTUB_INDIRECT(l->flags))) {
+            *count += (uint64) l->count;
+            break;
+        }
     }
-    md->num_blks = 0;
+# endif
+    return true;
+}
+#endif /* CLIENT_INTERFACE */
 
+/* Clears FRAG_TRACE_BUILDING on the shared bb md is building a trace from.
+ * md need not be dcontext's: see trace_release_shared_head().
+ */
+static void
+clear_trace_building_flag(dcontext_t *dcontext, monitor_data_t *md,
+                          bool grab_link_lock)
+{
     /* If shared BBs are being used to build a shared trace, we may have
      * FRAG_TRACE_BUILDING set on a shared BB w/the same tag (if there is a
      * BB present -- it could've been deleted for cache management or cache
@@ -596,6 +683,36 @@ reset_trace_state(dcontext_t *dcontext, bool grab_link_lock)
         if (grab_link_lock)
             release_recursive_lock(&change_linking_lock);
     }
+}
+
+static void
+reset_trace_state(dcontext_t *dcontext, bool grab_link_lock)
+{
+    monitor_data_t *md = (monitor_data_t *) dcontext->monitor_field;
+    uint i;
+    /* reset the trace buffer */
+    instrlist_init(&(md->trace));
+    if (instrlist_first(&md->trace_cold) != NULL)
+        instrlist_clear(dcontext, &md->trace_cold);
+    instrlist_init(&md->trace_cold);
+#ifdef CLIENT_INTERFACE
+    if (instrlist_first(&md->unmangled_ilist) != NULL)
+        instrlist_clear(dcontext, &md->unmangled_ilist);
+    instrlist_init(&md->unmangled_ilist);
+    if (md->unmangled_bb_ilist != NULL)
+        instrlist_clear_and_destroy(dcontext, md->unmangled_bb_ilist);
+    md->unmangled_bb_ilist = NULL;
+#endif
+    md->trace_buf_top = 0;
+    ASSERT(md->trace_vmlist == NULL);
+    for (i = 0; i < md->num_blks; i++) {
+        vm_area_destroy_list(dcontext, md->blk_info[i].vmlist);
+        md->blk_info[i].vmlist = NULL;
+    }
+    md->num_blks = 0;
+
+    clear_trace_building_flag(dcontext, md, grab_link_lock);
+
     md->trace_tag = NULL;  /* indicate return to search mode */
     md->trace_flags = 0;
     md->emitted_size = 0;
@@ -759,7 +876,7 @@ mark_trace_head(dcontext_t *dcontext_in, fragment_t *f, fragment_t *src_f,
     ASSERT(!NEED_SHARED_LOCK(f->flags) ||
            self_owns_recursive_lock(&change_linking_lock));
 
-    if (thcounter_lookup(dcontext, f->tag) == NULL) {
+    if (thcounter_lookup(dcontext, f->tag) == THCOUNTER_NONE) {
         protected = local_heap_protected(dcontext);
         if (protected) {
             /* unprotect local heap */
@@ -1249,6 +1366,19 @@ trace_flags_from_trace_head_flags(uint head_flags)
     return trace_flags;
 }
 
+/* For -private_trace_budget: private traces are thread-private copies, so we
+ * bound each thread's to keep the many idle or lukewarm threads of a large
+ * app from each duplicating the same code.
+ */
+static inline bool
+private_trace_budget_reached(dcontext_t *dcontext)
+{
+    return (DYNAMO_OPTION(private_trace_budget) > 0 &&
+            !DYNAMO_OPTION(shared_traces) &&
+            fragment_private_trace_count(dcontext) >=
+            DYNAMO_OPTION(private_trace_budget));
+}
+
 /* Be careful with the case where the current fragment f to be executed
  * has the same tag as the one we're emitting as a trace. 
  */
@@ -1296,8 +1426,11 @@ end_and_emit_trace(dcontext_t *dcontext, fragment_t *cur_f)
         /* PR 299808: we pass the unmangled ilist we've been maintaining to the
          * client, and we have to then re-mangle and re-connect.
          */
-        dr_emit_flags_t emitflags = instrument_trace(dcontext, tag, &md->unmangled_ilist,
-                                                     false/*!recreating*/);
+        dr_emit_flags_t emitflags;
+        md->in_trace_event = true;
+        emitflags = instrument_trace(dcontext, tag, &md->unmangled_ilist,
+                                     false/*!recreating*/);
+        md->in_trace_event = false;
         externally_mangled = true;
         if (TEST(DR_EMIT_STORE_TRANSLATIONS, emitflags)) {
             /* PR 214962: let client request storage instead of recreation */
@@ -1317,12 +1450,22 @@ end_and_emit_trace(dcontext_t *dcontext, fragment_t *cur_f)
     }
 #endif
 
+    /* The blocks' cold tails go after the trace's final exit, as
+     * mangle_cold_instrs() does for a block.  A re-mangled trace already got
+     * them from the unmangled blocks.
+     */
+    if (instrlist_first(&md->trace_cold) != NULL
+        IF_CLIENT_INTERFACE(&& !md->pass_to_client)) {
+        instrlist_append(trace, instrlist_first(&md->trace_cold));
+        instrlist_init(&md->trace_cold);
+    }
+
     if (INTERNAL_OPTION(cbr_single_stub) &&
         final_exit_shares_prev_stub(dcontext, trace, md->trace_flags)) {
         /* while building, we re-add shared stub since not sure if
          * trace will also share -- here we find out and adjust
          */
-        instr_t *last = instrlist_last(trace);
+        instr_t *last = final_hot_instr(trace);
         app_pc target;
         ASSERT(last != NULL && instr_is_exit_cti(last));
         target = opnd_get_pc(instr_get_target(last));
@@ -1404,16 +1547,14 @@ end_and_emit_trace(dcontext_t *dcontext, fragment_t *cur_f)
      * must change recreate_app_state in x86/arch.c as well
      */
     
-#ifdef INTERNAL
     if (dynamo_options.optimize
-#  ifdef SIDELINE
+#ifdef SIDELINE
         && !dynamo_options.sideline
-#  endif
+#endif
         ) {
-        optimize_trace(dcontext, tag, trace);
+        optimize_trace(dcontext, tag, trace, false/*!recreating*/);
         externally_mangled = true;
     }
-#endif /* INTERNAL */
 
 #ifdef PROFILE_RDTSC
     if (dynamo_options.profile_times) {
@@ -1987,6 +2128,7 @@ monitor_cache_enter(dcontext_t *dcontext, fragment_t *f)
     dr_custom_trace_action_t client = CUSTOM_TRACE_DR_DECIDES;
 #endif
     trace_head_counter_t *ctr;
+    uint ctr_id;
     uint add_size = 0, prev_mangle_size = 0; /* NOTE these aren't set if end_trace */
 
     if (DYNAMO_OPTION(disable_traces) || f == NULL) {
@@ -2013,6 +2155,14 @@ monitor_cache_enter(dcontext_t *dcontext, fragment_t *f)
         SELF_PROTECT_LOCAL(dcontext, WRITABLE);
         /* should have restored last fragment on cache exit */
         ASSERT(md->last_fragment == NULL);
+#ifdef CLIENT_INTERFACE
+        /* record the exit the last bb took, whether or not the trace ends here */
+        if (md->num_blks > 0) {
+            md->blk_info[md->num_blks - 1].exit_target = f->tag;
+            md->blk_info[md->num_blks - 1].exit_indirect =
+                LINKSTUB_INDIRECT(dcontext->last_exit->flags);
+        }
+#endif
 #ifdef RETURN_STACK
         if (md->num_blks > 0) {
             if (TEST(FRAG_ENDS_WITH_RETURN, dcontext->last_fragment->flags))
@@ -2261,11 +2411,10 @@ monitor_cache_enter(dcontext_t *dcontext, fragment_t *f)
     }
 
     /* Found a trace head, increment its counter */
-    ctr = thcounter_lookup(dcontext, f->tag);
     /* May not have been added for this thread yet */
-    if (ctr == NULL)
-        ctr = thcounter_add(dcontext, f->tag);
-    ASSERT(ctr != NULL);
+    ctr_id = thcounter_add(dcontext, f->tag);
+    ctr = &md->thead_table.counters[ctr_id];
+    ctr->reached++;
 
     if (ctr->counter == TH_COUNTER_CREATED_TRACE_VALUE()) {
         /* trace_t head counter values are persistent, so we do not remove them on
@@ -2278,6 +2427,15 @@ monitor_cache_enter(dcontext_t *dcontext, fragment_t *f)
          */
         ctr->counter = INTERNAL_OPTION(trace_counter_on_delete);
         STATS_INC(th_counter_reset);
+    } else if (ctr->counter == TH_COUNTER_BUDGET_SKIP_VALUE()) {
+        /* We skipped this head for the budget below: keep skipping it without
+         * recounting, until deleted traces free up room again.
+         */
+        if (private_trace_budget_reached(dcontext)) {
+            dcontext->whereami = WHERE_DISPATCH;
+            return f;
+        }
+        ctr->counter = 0;
     }
 
     ctr->counter++;
@@ -2285,7 +2443,35 @@ monitor_cache_enter(dcontext_t *dcontext, fragment_t *f)
     if (ctr->counter >= INTERNAL_OPTION(trace_threshold)) {
         /* if cannot delete fragment, do not start trace -- wait until
          * can delete it (w/ exceptions, deletion status changes). */
-        if (!TEST(FRAG_CANNOT_DELETE, f->flags)) {
+        if (private_trace_budget_reached(dcontext)) {
+            /* Keep running the bb: the thread's budget already holds its hottest
+             * code.  Trace heads are never linked, though, so leaving a private
+             * f a head would send every execution of it back through dispatch.
+             * Turn it back into a plain bb, as for a too-big head below, so
+             * that it is linked and stays in the cache; FRAG_CANNOT_BE_TRACE
+             * keeps the relink from re-marking it.  A shared bb's flags and
+             * links are shared, though, and other threads may still have room
+             * to trace it, so for those we only mark our own counter.
+             */
+            RSTATS_INC(num_trace_budget_skips);
+            if (TEST(FRAG_SHARED, f->flags) || TEST(FRAG_COARSE_GRAIN, f->flags)) {
+                ctr->counter = TH_COUNTER_BUDGET_SKIP_VALUE();
+                dcontext->whereami = WHERE_DISPATCH;
+                return f;
+            } else {
+                SHARED_FLAGS_RECURSIVE_LOCK(f->flags, acquire, change_linking_lock);
+                f->flags &= ~FRAG_IS_TRACE_HEAD;
+                f->flags |= FRAG_CANNOT_BE_TRACE;
+                link_fragment_incoming(dcontext, f, false/*not new*/);
+                SHARED_FLAGS_RECURSIVE_LOCK(f->flags, release, change_linking_lock);
+                /* the counter is no longer needed (and ctr is invalid after this) */
+                thcounter_range_remove(dcontext, f->tag, f->tag + 1);
+                dcontext->whereami = WHERE_DISPATCH;
+                /* link unprotects on demand, we then re-protect all */
+                SELF_PROTECT_CACHE(dcontext, NULL, READONLY);
+                return f;
+            }
+        } else if (!TEST(FRAG_CANNOT_DELETE, f->flags)) {
             if (!DYNAMO_OPTION(shared_traces))
                 start_trace = true;
             /* FIXME To detect a trace building race w/private BBs at this point,
@@ -2356,7 +2542,12 @@ monitor_cache_enter(dcontext_t *dcontext, fragment_t *f)
     if (start_trace) {
         KSTART(trace_building);
         /* ensure our sentinel counter value for counter clearing will work */
+        /* the counters may have moved while we made the private copy */
+        ctr = &md->thead_table.counters[ctr_id];
         ASSERT(ctr->counter == INTERNAL_OPTION(trace_threshold));
+#ifdef CLIENT_INTERFACE
+        md->trace_head_count = ctr->reached;
+#endif
         ctr->counter = TH_COUNTER_CREATED_TRACE_VALUE();
         /* Found a hot trace head.  Switch this thread into trace
            selection mode, and initialize the instrlist_t for the new
@@ -2508,6 +2699,20 @@ trace_abort(dcontext_t *dcontext)
         enter_nolinking(dcontext, NULL, false/*not a cache transition*/);
 }
 
+/* Clears FRAG_TRACE_BUILDING on the shared trace head abandoned was building
+ * a trace from, so that the trace can still be built.  For a thread whose
+ * state is dropped without trace_abort() (e.g., in a forked child): only
+ * reads abandoned's state.
+ */
+void
+trace_release_shared_head(dcontext_t *dcontext, dcontext_t *abandoned)
+{
+    monitor_data_t *md = (monitor_data_t *) abandoned->monitor_field;
+    if (md->trace_tag == NULL)
+        return; /* NOT in trace selection mode */
+    clear_trace_building_flag(dcontext, md, true/*grab change_linking_lock*/);
+}
+
 #if defined(RETURN_AFTER_CALL) || defined(RCT_IND_BRANCH)
 /* PR 204770: use trace component bb tag for RCT source address */
 app_pc
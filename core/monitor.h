@@ -101,30 +101,54 @@ void trace_abort(dcontext_t *dcontext);
  */
 void trace_abort_and_delete(dcontext_t *dcontext);
 
+/* Clears the shared trace head flag set by a thread whose state is being
+ * abandoned without trace_abort().
+ */
+void trace_release_shared_head(dcontext_t *dcontext, dcontext_t *abandoned);
+
 void
 thcounter_range_remove(dcontext_t *dcontext, app_pc start, app_pc end);
 
 bool
 mangle_trace_at_end(void);
 
+#ifdef CLIENT_INTERFACE
+/* Profile data for the trace being built, for the client trace event */
+uint
+trace_head_count(dcontext_t *dcontext);
+
+uint
+trace_component_tags(dcontext_t *dcontext, app_pc *tags, uint max_tags);
+
+bool
+trace_component_exit_count(dcontext_t *dcontext, uint index, app_pc target,
+                           uint64 *count);
+#endif
+
 /* trace head counters are thread-private and must be kept in a
  * separate table and not in the fragment_t structure.
  * FIXME: may want to do this for non-shared-cache, since persistent counters
  * may mitigate the performance hit of a small bb cache -- but for that
  * we could keep the counters in future_fragment_t when a bb dies and
  * re-initialize to that value when it comes back.
+ *
+ * The counters live in a dense array indexed by a small id that is handed
+ * out the first time a thread sees a head, and an open-address index maps
+ * tags to ids.  An id stays valid when either array grows, so callers hold
+ * ids rather than pointers across anything that might add a counter.
  */
 typedef struct _trace_head_counter_t {
-    app_pc tag;
-    uint   counter;
-    /* FIXME: use open-address to save memory, and share code
-     * w/ fragment.c?
-     */
-    struct _trace_head_counter_t *next;
+    app_pc tag;      /* NULL if this id is on the free list */
+    uint   counter;  /* for a free id, the next free id */
+    uint   reached;  /* times this thread reached the head; never reset */
 } trace_head_counter_t;
 
 typedef struct _trace_head_table_t {
-    trace_head_counter_t **counter_table;
+    trace_head_counter_t *counters; /* indexed by id */
+    uint  num_ids;            /* ids ever handed out */
+    uint  ids_capacity;       /* allocated length of counters */
+    uint  free_id;            /* head of the free id list */
+    uint *index;              /* id+1 per slot, 0 if empty */
     uint  hash_bits;
     ptr_uint_t  hash_mask;
     uint  hash_mask_offset;
@@ -147,6 +171,13 @@ typedef struct _trace_bb_build_t {
      * that need to be mangled.
      */
     bool final_cti;
+#ifdef CLIENT_INTERFACE
+    /* the exit this bb took while the trace was selected, for
+     * dr_trace_component_exit_count()
+     */
+    app_pc exit_target;
+    bool exit_indirect;
+#endif
 } trace_bb_build_t;
 
 typedef struct _monitor_data_t {
@@ -157,6 +188,7 @@ typedef struct _monitor_data_t {
     app_pc         trace_tag;       /* tag of trace head */
     uint           trace_flags;     /* FRAGMENT_ flags for trace */
     instrlist_t      trace;           /* place to build the instruction trace */
+    instrlist_t    trace_cold;      /* cold tails of blocks, kept out of line */
     byte           *trace_buf;      /* place to temporarily store instr bytes */
     uint           trace_buf_size;  /* length of trace_buf in bytes */
     uint           trace_buf_top;   /* index of next free location in trace_buf */
@@ -183,6 +215,12 @@ typedef struct _monitor_data_t {
     instrlist_t    *unmangled_bb_ilist; /* next bb */
     /* cache at start of trace building whether we're going to pass to client */
     bool           pass_to_client;
+    /* times the head was reached before the trace was selected,
+     * for dr_trace_head_count()
+     */
+    uint           trace_head_count;
+    /* set while the trace event runs so the profile queries know md is valid */
+    bool           in_trace_event;
 #endif
     /* Record whether final block ends in syscall or int.
      * FIXME: remove once we have PR 307284.
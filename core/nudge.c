@@ -375,6 +375,10 @@ handle_nudge(dcontext_t *dcontext, nudge_arg_t *arg)
         nudge_action_mask &= ~NUDGE_GENERIC(persist);
         coarse_units_freeze_all(false/*!in-place==persist*/);
     }
+    if (TEST(NUDGE_GENERIC(lock_prof), nudge_action_mask)) {
+        nudge_action_mask &= ~NUDGE_GENERIC(lock_prof);
+        dump_lock_profile();
+    }
 #ifdef CLIENT_INTERFACE
     if (TEST(NUDGE_GENERIC(client), nudge_action_mask)) {
         nudge_action_mask &= ~NUDGE_GENERIC(client);
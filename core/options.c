@@ -1001,6 +1001,55 @@ check_option_compatibility_helper(int recurse_count)
 # endif
 #endif
 
+#ifdef X64
+    /* These trace optimizations are not yet x64-ready (see optimize_trace()).
+     * We warn in release builds too as otherwise the option silently does
+     * nothing.
+     */
+# define OPTIMIZE_OPTION_NOT_X64(name) do {                                     \
+    if (DYNAMO_OPTION(name)) {                                                  \
+        SYSLOG(SYSLOG_WARNING, INTERNAL_SYSLOG_WARNING, 3,                      \
+               get_application_name(), get_application_pid(),                   \
+               "-"#name" is not supported on x64, disabling");                  \
+        SET_DEFAULT_VALUE(name);                                                \
+        changed_options = true;                                                 \
+    }                                                                           \
+} while (0)
+    OPTIMIZE_OPTION_NOT_X64(call_return_matching);
+    OPTIMIZE_OPTION_NOT_X64(unroll_loops);
+    OPTIMIZE_OPTION_NOT_X64(vectorize);
+    OPTIMIZE_OPTION_NOT_X64(prefetch);
+    OPTIMIZE_OPTION_NOT_X64(rlr);
+    OPTIMIZE_OPTION_NOT_X64(remove_unnecessary_zeroing);
+    OPTIMIZE_OPTION_NOT_X64(constant_prop);
+    OPTIMIZE_OPTION_NOT_X64(remove_dead_code);
+# undef OPTIMIZE_OPTION_NOT_X64
+#endif
+
+    /* -optimize is synthetic: every pass option sets it when parsed, even in
+     * its -no_ form, so turn it back off if no pass is left on.
+     */
+    if (DYNAMO_OPTION(optimize)) {
+        bool any_pass =
+            DYNAMO_OPTION(prefetch) || DYNAMO_OPTION(rlr) ||
+            DYNAMO_OPTION(vectorize) || DYNAMO_OPTION(unroll_loops) ||
+            DYNAMO_OPTION(instr_counts) || INTERNAL_OPTION(stack_adjust) ||
+            DYNAMO_OPTION(remove_dead_code) != 0 || DYNAMO_OPTION(constant_prop) != 0 ||
+            DYNAMO_OPTION(call_return_matching) ||
+            DYNAMO_OPTION(remove_unnecessary_zeroing) || DYNAMO_OPTION(peephole);
+#ifdef IA32_ON_IA64
+        any_pass = any_pass || DYNAMO_OPTION(test_ia64);
+#endif
+#ifdef LOAD_TO_CONST
+        any_pass = any_pass || DYNAMO_OPTION(loads_to_const) ||
+            DYNAMO_OPTION(safe_loads_to_const);
+#endif
+        if (!any_pass) {
+            dynamo_options.optimize = false;
+            changed_options = true;
+        }
+    }
+
     /* Manipulate all of the options needed for -shared_traces. */
     if (DYNAMO_OPTION(shared_traces)) {
         if (!DYNAMO_OPTION(private_ib_in_tls)) {
@@ -246,6 +246,11 @@
     OPTION_INTERNAL(bool, bbdump_tags, "dump tags, sizes, and sharedness of all bbs")
     OPTION_INTERNAL(bool, gendump, "dump generated code")
     OPTION_DEFAULT(bool, global_rstats, true, "enable global release-build statistics")
+    OPTION_DEFAULT(bool, rstats_to_stderr, false,
+        "print global release-build statistics to stderr at exit")
+    OPTION_DEFAULT(bool, prof_locks, false,
+        "count lock acquisitions, contention, and wait time per lock, printed to "
+        "stderr at exit or on a lock_prof nudge")
 
     /* this takes precedence over the DYNAMORIO_VAR_LOGDIR config var */
     OPTION_DEFAULT(pathstring_t, logdir, EMPTY_STRING,
@@ -608,6 +613,12 @@
      * to an app crash. */
     OPTION_DEFAULT(bool, avoid_dlclose, true, "Avoid calling dlclose from DynamoRIO.")
 
+    /* For fork servers: leave the parent's other threads' state in place
+     * (copy-on-write) in the child rather than tearing it down.
+     */
+    OPTION_DEFAULT(bool, fork_skip_thread_cleanup, false,
+                   "On fork, do not clean up the parent's other threads in the child.")
+
     /* PR 304708: we intercept all signals for a better client interface */
     OPTION_DEFAULT(bool, intercept_all_signals, true, "intercept all signals")
 
@@ -740,6 +751,11 @@
         IF_NOT_X64(IF_WINDOWS(options->shared_fragment_shared_syscalls =
                               (options->shared_traces && options->shared_syscalls);))
      }, "use thread-shared traces", STATIC, OP_PCACHE_GLOBAL)
+    /* With -shared_bbs -no_shared_traces only threads that run code hot build
+     * (private) traces; this bounds how many each such thread may hold.
+     */
+    OPTION_DEFAULT(uint, private_trace_budget, 0,
+                   "max live private traces per thread, 0 = unlimited")
 
     /* PR 361894: if no TLS available, we fall back to thread-private */
     OPTION_COMMAND(bool, thread_private, IF_HAVE_TLS_ELSE(false, true),
@@ -836,6 +852,13 @@
     /* Default FALSE since not supported for shared_traces (which is on by default) */
     OPTION_DEFAULT(bool, inline_trace_ibl, false, "inline head of ibl routine in traces")
 
+    /* popf is microcoded and expensive: when the app's eflags hold nothing but
+     * the arithmetic flags we set and clear them with cheaper instructions on
+     * every context switch between DR and the cache.
+     */
+    OPTION_DEFAULT_INTERNAL(bool, fcache_fast_eflags, true,
+        "avoid popf in fcache_enter and fcache_return when possible")
+
     OPTION_DEFAULT(bool, shared_bb_ibt_tables, false,
         "use thread-shared BB IBT tables")
 
@@ -1037,6 +1060,11 @@
 
      /* FIXME: remove this once we are happy with new rwlocks */
     OPTION_DEFAULT_INTERNAL(bool, spin_yield_rwlock, false, "use old spin-yield rwlock implementation")
+    /* Readers of a scalable rwlock each increment a counter on their own cache
+     * line instead of the single num_readers, at the cost of a writer scan.
+     */
+    OPTION_DEFAULT(bool, scalable_rwlocks, false,
+        "use per-thread reader counters for read-mostly vm area and fragment table locks")
 
     OPTION_INTERNAL(bool, simulate_contention, "simulate lock contention for testing purposes only")
 
@@ -1995,6 +2023,8 @@ IF_RCT_IND_BRANCH(options->rct_ind_jump = OPTION_DISABLED;)
     OPTION_DEFAULT(bool, persist_trust_textrel, true,
         "if textrel flag is not set, assume module has no text relocs")
 #endif
+    OPTION_DEFAULT(bool, persist_rebase_pic, true,
+        "use position-independent persisted caches at any module base")
     /* the DYNAMORIO_VAR_PERSCACHE_ROOT config var takes precedence over this */
     OPTION_DEFAULT(pathstring_t, persist_dir, EMPTY_STRING,
         "base per-user directory for persistent caches")
@@ -2613,36 +2643,42 @@ IF_RCT_IND_BRANCH(options->rct_ind_jump = OPTION_DISABLED;)
         "skip thread exit events at process exit")
 #endif
 
-#ifdef EXPOSE_INTERNAL_OPTIONS
+    /* trace optimizations: available in all builds, off by default */
     OPTION_NAME(bool, optimize, " synthethic", "set if ANY opts are on")
 
 #define OPTIMIZE_OPTION(type, name) OPTION_COMMAND(type, name, 0, #name, {      \
     options->optimize = true;                                             \
 }, "optimization", STATIC, OP_PCACHE_NOP)
+/* for passes whose rewrites cannot yet be translated back on a fault */
+#define OPTIMIZE_OPTION_INTERNAL(type, name)                                  \
+    OPTION_COMMAND_INTERNAL(type, name, 0, #name, {                           \
+        options->optimize = true;                                             \
+    }, "optimization", STATIC, OP_PCACHE_NOP)
 
-# ifdef SIDELINE
+#ifdef SIDELINE
     OPTION(bool, sideline, "use sideline thread for optimization")
-# endif
+#endif
     /* optimizations */
 
-# if 0 /* this flag does nothing yet...disable so people don't try to use it */
+#if 0 /* this flag does nothing yet...disable so people don't try to use it */
     OPTION(uint, aggressiveness, "level of aggressiveness in optimizations")
-# endif
+#endif
 
-# ifdef IA32_ON_IA64
+#ifdef IA32_ON_IA64
     OPTIMIZE_OPTION(bool, test_ia64)
-# endif
+#endif
     OPTIMIZE_OPTION(bool, prefetch)
     OPTIMIZE_OPTION(bool, rlr)
     OPTIMIZE_OPTION(bool, vectorize)
     OPTIMIZE_OPTION(bool, unroll_loops)
 
     OPTIMIZE_OPTION(bool, instr_counts)
-    OPTIMIZE_OPTION(bool, stack_adjust)
-# ifdef LOAD_TO_CONST
+    /* a fault between two merged adjustments recreates the wrong xsp */
+    OPTIMIZE_OPTION_INTERNAL(bool, stack_adjust)
+#ifdef LOAD_TO_CONST
     OPTIMIZE_OPTION(bool, loads_to_const)
     OPTIMIZE_OPTION(bool, safe_loads_to_const)
-# endif
+#endif
 
     OPTIMIZE_OPTION(uint, remove_dead_code)             /* aggressiveness level */
     OPTIMIZE_OPTION(uint, constant_prop)                /* aggressiveness level */
@@ -2655,8 +2691,8 @@ IF_RCT_IND_BRANCH(options->rct_ind_jump = OPTION_DISABLED;)
     OPTIMIZE_OPTION(bool, call_return_matching)
     OPTIMIZE_OPTION(bool, remove_unnecessary_zeroing) // FIXME: unnecessarily long option
     OPTIMIZE_OPTION(bool, peephole)
-# undef OPTIMIZE_OPTION
-#endif /* EXPOSE_INTERNAL_OPTIONS */
+#undef OPTIMIZE_OPTION
+#undef OPTIMIZE_OPTION_INTERNAL
 #ifdef HOT_PATCHING_INTERFACE
     OPTION_DEFAULT(bool, hot_patching, false, "enable hot patching")
 
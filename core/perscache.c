@@ -225,6 +225,7 @@ coarse_unit_free(dcontext_t *dcontext, coarse_info_t *info)
     ASSERT(info->htable == NULL);
     ASSERT(info->th_htable == NULL);
     ASSERT(info->pclookup_htable == NULL);
+    ASSERT(info->pclookup_array == NULL);
     ASSERT(info->cache == NULL);
     ASSERT(info->incoming == NULL);
     ASSERT(info->stubs == NULL);
@@ -645,6 +646,7 @@ coarse_replace_unit(dcontext_t *dcontext, coarse_info_t *dst, coarse_info_t *src
         src->htable = NULL;
         src->th_htable = NULL;
         src->pclookup_htable = NULL;
+        src->pclookup_array = NULL;
         src->cache = NULL;
         src->incoming = NULL;
         src->stubs = NULL;
@@ -1837,6 +1839,10 @@ coarse_unit_merge(dcontext_t *dcontext, coarse_info_t *info1, coarse_info_t *inf
         return NULL;
     /* Currently we only do online merging where one unit is live */
     ASSERT(!info1->persisted || !info2->persisted);
+    /* We do not translate tags between module bases */
+    ASSERT(info1->mod_shift == info2->mod_shift);
+    if (info1->mod_shift != info2->mod_shift)
+        return NULL;
 
     /* Much more efficient to merge smaller cache into larger */
     if (fragment_coarse_num_entries(info1) > fragment_coarse_num_entries(info2)) {
@@ -1850,9 +1856,10 @@ coarse_unit_merge(dcontext_t *dcontext, coarse_info_t *info1, coarse_info_t *inf
     /* Ensure the pclookup table is set up for src_sm, to avoid recursive
      * lock issues
      */
-    if (src_sm->pclookup_htable == NULL) { /* read needs no lock */
+    if (src_sm->pclookup_htable == NULL &&
+        src_sm->pclookup_array == NULL) { /* read needs no lock */
         fragment_coarse_entry_pclookup(dcontext, src_sm, NULL);
-        ASSERT(src_sm->pclookup_htable != NULL);
+        ASSERT(src_sm->pclookup_htable != NULL || src_sm->pclookup_array != NULL);
     }
 
     acquire_recursive_lock(&change_linking_lock);
@@ -2024,6 +2031,8 @@ coarse_unit_merge(dcontext_t *dcontext, coarse_info_t *info1, coarse_info_t *inf
     /* Set cache bounds after we've potentially moved the initial cache */
     fcache_coarse_init_frozen(dcontext, merged, merged->cache_start_pc,
                               merged->fcache_return_prefix - merged->cache_start_pc);
+    /* All entries are now in place */
+    fragment_coarse_htable_finalize(dcontext, merged);
 
     /* Currently we only do online merging where at least one unit is live,
      * and we expect that to be info1
@@ -2596,9 +2605,13 @@ coarse_unit_merge_with_disk(dcontext_t *dcontext, coarse_info_t *info,
                 info->module, filename);
             /* Case 8640: allow merging with a smaller on-disk file, to avoid
              * being forever stuck at that size by prior cores with no IAT merging
-             * or other features */
+             * or other features.
+             * We can't merge a position-independent file persisted at another
+             * module base: we simply replace it.
+             */
             if (merge_with->base_pc >= info->base_pc &&
-                merge_with->end_pc <= info->end_pc) {
+                merge_with->end_pc <= info->end_pc &&
+                merge_with->mod_shift == 0) {
                 /* If want in-place merging, need to arrange for ibl invalidation:
                  * case 11057 */
                 postmerge = coarse_unit_merge(dcontext, info, merge_with,
@@ -2909,6 +2922,70 @@ pad_persist_file(dcontext_t *dcontext, file_t fd, size_t bytes, coarse_info_t *i
     return true;
 }
 
+static bool
+persist_opnd_refs_module(opnd_t opnd, app_pc modbase, size_t modsize)
+{
+    ptr_uint_t addr;
+    if (opnd_is_immed_int(opnd))
+        addr = (ptr_uint_t) opnd_get_immed_int(opnd);
+    else if (opnd_is_base_disp(opnd)) {
+        /* includes absolute addresses and tables indexed by a register */
+        addr = (ptr_uint_t)(ptr_int_t) opnd_get_disp(opnd);
+    }
+#ifdef X64
+    else if (opnd_is_abs_addr(opnd) || opnd_is_rel_addr(opnd))
+        addr = (ptr_uint_t) opnd_get_addr(opnd);
+#endif
+    else if (opnd_is_pc(opnd))
+        addr = (ptr_uint_t) opnd_get_pc(opnd);
+    else
+        return false;
+    return (addr >= (ptr_uint_t)modbase && addr < (ptr_uint_t)modbase + modsize);
+}
+
+/* Returns whether info's cache contains no absolute references into the
+ * module at modbase.  Tags and stub targets are already translated by
+ * mod_shift, and the cache reaches its stubs and prefixes only via relative
+ * jmps within the file, so such a cache can be mapped unchanged (and thus
+ * shared) wherever the module is loaded.  A constant that merely looks like
+ * a module address makes us conservatively return false.
+ */
+static bool
+coarse_unit_is_position_independent(dcontext_t *dcontext, coarse_info_t *info,
+                                    app_pc modbase, size_t modsize)
+{
+    cache_pc pc = info->cache_start_pc;
+    instr_t *instr;
+    bool res = true;
+    int i;
+    ASSERT(info->frozen);
+    instr = instr_create(dcontext);
+    while (res && pc < info->cache_end_pc) {
+        instr_reset(dcontext, instr);
+        pc = decode(dcontext, pc, instr);
+        if (pc == NULL || !instr_valid(instr)) {
+            res = false;
+            break;
+        }
+        for (i = 0; res && i < instr_num_srcs(instr); i++) {
+            if (persist_opnd_refs_module(instr_get_src(instr, i), modbase, modsize))
+                res = false;
+        }
+        for (i = 0; res && i < instr_num_dsts(instr); i++) {
+            if (persist_opnd_refs_module(instr_get_dst(instr, i), modbase, modsize))
+                res = false;
+        }
+        DOLOG(2, LOG_CACHE, {
+            if (!res) {
+                LOG(THREAD, LOG_CACHE, 2, "  module reference in cache @"PFX"\n",
+                    pc);
+            }
+        });
+    }
+    instr_destroy(dcontext, instr);
+    return res;
+}
+
 /* Fills in pers with data from info */
 static void
 coarse_unit_set_persist_data(dcontext_t *dcontext, coarse_info_t *info,
@@ -3081,6 +3158,18 @@ coarse_unit_set_persist_data(dcontext_t *dcontext, coarse_info_t *info,
 #endif
     pers->data_len += pers->instrument_rw_len;
 
+    /* RCT and RAC tables hold absolute addresses, and we can't know whether
+     * client data does, so we only consider plain caches.
+     */
+    if (pers->rct_htable_len == 0 && pers->rac_htable_len == 0 &&
+        pers->instrument_ro_len == 0 && pers->instrument_rx_len == 0 &&
+        pers->instrument_rw_len == 0 &&
+        coarse_unit_is_position_independent(dcontext, info, modbase,
+                                             (size_t) pers->modinfo.image_size)) {
+        pers->flags |= PERSCACHE_POSITION_INDEPENDENT;
+        STATS_INC(coarse_units_persist_pic);
+    }
+
     /* We always write the footer regardless of whether we calculate the
      * MD5.  Otherwise we'd need a new flag; not really worth it.
      * Plus, we have our magic field as an always-on extra check.
@@ -3959,7 +4048,14 @@ coarse_unit_load(dcontext_t *dcontext, app_pc start, app_pc end,
     }
 
     /* modinfo cmp checks all but base, which is separate for reloc support */
-    if (modbase != pers->modinfo.base) {
+    if (modbase != pers->modinfo.base &&
+        TEST(PERSCACHE_POSITION_INDEPENDENT, pers->flags) &&
+        DYNAMO_OPTION(persist_rebase_pic)) {
+        /* Tags and stub targets are translated via info->mod_shift below */
+        LOG(THREAD, LOG_CACHE, 1, "  module base mismatch "PFX" vs persisted "PFX
+            ", but position-independent so ok\n", modbase, pers->modinfo.base);
+        STATS_INC(perscache_rebased);
+    } else if (modbase != pers->modinfo.base) {
 #ifdef LINUX
         /* for linux, we can trust lack of textrel flag as guaranteeing no text relocs */
         if (DYNAMO_OPTION(persist_trust_textrel) &&
@@ -125,6 +125,8 @@ struct _coarse_info_t {
     size_t mmap_size;
     /* Performance optimization for frozen units (critical for trace building) */
     void *pclookup_htable; /* opaque htable mapping cache entry point -> app pc */
+    /* replaces pclookup_htable for frozen units: opaque array sorted by cache pc */
+    void *pclookup_array;
     /* end frozen-only fields */
 
     /* Fields for persisted units */
@@ -317,7 +319,7 @@ coarse_unit_merge(dcontext_t *dcontext, coarse_info_t *info1, coarse_info_t *inf
 
 enum {
     PERSISTENT_CACHE_MAGIC = 0x244f4952, /* RIO$ */
-    PERSISTENT_CACHE_VERSION = 10,
+    PERSISTENT_CACHE_VERSION = 11,
 };
 
 /* Global flags we need to process if present in a persisted cache */
@@ -360,6 +362,12 @@ enum {
      * Xref case 10601.
      */
     PERSCACHE_CODE_INVALID       = 0x00000400,
+
+    /* Cache contains no absolute references into the module, so with tags
+     * and stub targets translated via mod_shift the file can be used
+     * unmodified at any module base.
+     */
+    PERSCACHE_POSITION_INDEPENDENT = 0x00000800,
 };
 
 /* Consistency and security checking options */
@@ -37,7 +37,9 @@
  * These are generally unoptimized because they aren't on DR's critical path.
  * Clients use a privately loaded libc.  If one of these shows up in a profile,
  * we should probably avoid calling it rather than trying to optimize these
- * routines.
+ * routines.  The exceptions are strlen, strchr, and memcmp, which are called
+ * on every module and option string and so scan a word at a time.  memcpy and
+ * memset are in x86.asm.
  */
 
 #include "globals.h"
@@ -57,14 +59,29 @@
 # error "Don't include <string.h> in string.c"
 #endif
 
+/* A word has a zero byte iff (w - 0x01..01) & ~w & 0x80..80 is non-zero.
+ * Aligned word reads never cross a page boundary, so reading the bytes past a
+ * terminator in the same word cannot fault.
+ */
+#define WORD_ONES (((ptr_uint_t)-1) / 0xff)
+#define WORD_HIGHS (WORD_ONES * 0x80)
+#define WORD_HAS_ZERO(w) ((((w) - WORD_ONES) & ~(w) & WORD_HIGHS) != 0)
+
 /* Private strlen. */
 size_t
 strlen(const char *str)
 {
     const char *cur = str;
-    while (*cur != '\0') {
+    const ptr_uint_t *word;
+    while (!ALIGNED(cur, sizeof(ptr_uint_t))) {
+        if (*cur == '\0')
+            return cur - str;
         cur++;
     }
+    for (word = (const ptr_uint_t *) cur; !WORD_HAS_ZERO(*word); word++)
+        ; /* nothing */
+    for (cur = (const char *) word; *cur != '\0'; cur++)
+        ; /* nothing */
     return cur - str;
 }
 
@@ -86,6 +103,20 @@ wcslen(const wchar_t *str)
 char *
 strchr(const char *str, int c)
 {
+    ptr_uint_t pattern = WORD_ONES * (byte) c;
+    const ptr_uint_t *word;
+    while (!ALIGNED(str, sizeof(ptr_uint_t))) {
+        if (*str == (char) c)
+            return (char *) str;
+        if (*str == '\0')
+            return NULL;
+        str++;
+    }
+    /* Skip words that contain neither c nor the terminator. */
+    for (word = (const ptr_uint_t *) str;
+         !WORD_HAS_ZERO(*word) && !WORD_HAS_ZERO(*word ^ pattern); word++)
+        ; /* nothing */
+    str = (const char *) word;
     while (true) {
         if (*str == c)
             return (char *) str;
@@ -139,8 +170,17 @@ memmove(void *dst, const void *src, size_t n)
     ssize_t i;
     byte *dst_b = (byte *) dst;
     const byte *src_b = (const byte *) src;
-    if (dst < src)
-        return memcpy(dst, src, n);
+    if (dst < src) {
+        /* memcpy's SSE2 path re-reads src after its first, unaligned store to
+         * dst, so it is only safe for regions that do not overlap.
+         */
+        if (src_b >= dst_b + n)
+            return memcpy(dst, src, n);
+        for (i = 0; i < (ssize_t) n; i++) {
+            dst_b[i] = src_b[i];
+        }
+        return dst;
+    }
     /* FIXME: Could use reverse DF and rep movs. */
     for (i = n - 1; i >= 0; i--) {
         dst_b[i] = src_b[i];
@@ -207,8 +247,12 @@ memcmp(const void *left_v, const void *right_v, size_t n)
     /* Use unsigned comparisons. */
     const byte *left = left_v;
     const byte *right = right_v;
-    size_t i;
-    for (i = 0; i < n; i++) {
+    size_t i = 0;
+    /* Skip equal words, then find the first differing byte. */
+    while (n - i >= sizeof(ptr_uint_t) &&
+           *(const ptr_uint_t *)(left + i) == *(const ptr_uint_t *)(right + i))
+        i += sizeof(ptr_uint_t);
+    for (; i < n; i++) {
         if (left[i] < right[i])
             return -1;
         if (left[i] > right[i])
@@ -287,6 +331,77 @@ identity(const char *str)
     return str;
 }
 
+/* Fills buf with a pattern that differs at every byte offset. */
+static void
+fill_pattern(byte *buf, size_t n)
+{
+    size_t i;
+    for (i = 0; i < n; i++)
+        buf[i] = (byte) (i * 7 + 1);
+}
+
+/* Returns whether buf[0, n) holds the pattern from fill_pattern() starting at
+ * offset off.
+ */
+static bool
+matches_pattern(const byte *buf, size_t n, size_t off)
+{
+    size_t i;
+    for (i = 0; i < n; i++) {
+        if (buf[i] != (byte) ((off + i) * 7 + 1))
+            return false;
+    }
+    return true;
+}
+
+/* Exercises the SSE2 paths of memcpy and memset, and memmove on top of them,
+ * at misaligned addresses and with overlap in both directions.
+ */
+static void
+test_mem_funcs(void)
+{
+    static const size_t sizes[] = {128, 129, 191, 256, 333};
+    static const size_t offs[] = {0, 1, 7, 15, 16, 33};
+    static const size_t shifts[] = {1, 5, 15, 16, 17, 64, 100};
+    static byte src[512], dst[512];
+    size_t s, o, d;
+    for (s = 0; s < BUFFER_SIZE_ELEMENTS(sizes); s++) {
+        size_t n = sizes[s];
+        for (o = 0; o < BUFFER_SIZE_ELEMENTS(offs); o++) {
+            size_t off = offs[o];
+            /* memcpy, misaligned by off on dst and by off + 3 on src */
+            fill_pattern(src, sizeof(src));
+            memset(dst, 0, sizeof(dst));
+            EXPECT(memcpy(dst + off, src + off + 3, n) == dst + off, true);
+            EXPECT(matches_pattern(dst + off, n, off + 3), true);
+            EXPECT(is_region_memset_to_char(dst, off, 0), true);
+            EXPECT(is_region_memset_to_char(dst + off + n,
+                                            sizeof(dst) - off - n, 0), true);
+
+            /* memset */
+            memset(dst, 0, sizeof(dst));
+            EXPECT(memset(dst + off, 0xab, n) == dst + off, true);
+            EXPECT(is_region_memset_to_char(dst + off, n, 0xab), true);
+            EXPECT(is_region_memset_to_char(dst, off, 0), true);
+            EXPECT(is_region_memset_to_char(dst + off + n,
+                                            sizeof(dst) - off - n, 0), true);
+
+            for (d = 0; d < BUFFER_SIZE_ELEMENTS(shifts); d++) {
+                size_t shift = shifts[d];
+                /* memmove forward: dst below an overlapping src */
+                fill_pattern(src, sizeof(src));
+                EXPECT(memmove(src + off, src + off + shift, n) == src + off, true);
+                EXPECT(matches_pattern(src + off, n, off + shift), true);
+                /* memmove backward: dst above an overlapping src */
+                fill_pattern(src, sizeof(src));
+                EXPECT(memmove(src + off + shift, src + off, n) ==
+                       src + off + shift, true);
+                EXPECT(matches_pattern(src + off + shift, n, off), true);
+            }
+        }
+    }
+}
+
 void
 unit_test_string(void)
 {
@@ -297,12 +412,33 @@ unit_test_string(void)
 
     print_file(STDERR, "testing string\n");
 
+    /* strlen, at every alignment and with the terminator in every byte of
+     * a word
+     */
+    for (num = 0; num < 2 * sizeof(ptr_uint_t); num++) {
+        size_t len;
+        for (len = 0; len < 3 * sizeof(ptr_uint_t); len++) {
+            memset(buf, 'x', sizeof(buf));
+            buf[num + len] = '\0';
+            EXPECT(strlen(identity(buf + num)), len);
+        }
+    }
+
     /* strchr */
     ret = strchr(identity(test_path), '/');
     EXPECT(ret == test_path, true);
     ret = strchr(identity(test_path), '\0');
     EXPECT(ret != NULL, true);
     EXPECT(*ret, '\0');
+    ret = strchr(identity(test_path), 'e');
+    EXPECT(ret == test_path + sizeof(test_path) - 2, true);
+    ret = strchr(identity(test_path), 'z');
+    EXPECT(ret == NULL, true);
+
+    /* memcmp */
+    EXPECT(memcmp(identity("/path/to/filf"), test_path, sizeof(test_path)), 1);
+    EXPECT(memcmp(identity("/path/to/fild"), test_path, sizeof(test_path)), -1);
+    EXPECT(memcmp(identity("/path/to/filf"), test_path, sizeof(test_path) - 2), 0);
 
     /* strrchr */
     ret = strrchr(identity(test_path), '/');
@@ -343,6 +479,9 @@ unit_test_string(void)
     strncpy(buf, "/foo", 4);
     EXPECT(strcmp(buf, "/foo/path/to/file"), 0);
 
+    /* memcpy, memset, memmove at SSE2 sizes */
+    test_mem_funcs();
+
     print_file(STDERR, "done testing string\n");
 }
 
@@ -813,6 +813,161 @@ spinmutex_delete(spin_mutex_t *spin_lock)
     mutex_delete(&spin_lock->lock);
 }
 
+/* -prof_locks: release-build lock profiling.  Locks are aggregated by name,
+ * which for locks created with the INIT_* and ASSIGN_INIT_* macros is the
+ * variable name plus file and line, so all per-thread or per-unit instances
+ * of a lock share one entry.  Acquisitions cost one atomic increment; the
+ * contended path also reads the timestamp counter and takes a spin lock to
+ * update the entry's contention and wait-time totals.
+ * A handoff is an acquisition by a different thread than the previous one:
+ * each moves the lock's cache line, and usually the data it guards, between
+ * cores, so handoffs approximate the cross-core traffic a lock causes even
+ * when it is never contended.
+ */
+typedef struct _lock_prof_site_t {
+    const char *name;
+    volatile ptr_uint_t acquired;
+    volatile ptr_uint_t handoffs;
+    ptr_uint_t contended;
+    uint64 wait_ticks;
+    uint64 max_wait_ticks;
+} lock_prof_site_t;
+
+/* Entries are updated by whichever threads use their locks, so we pad each
+ * to its own cache line to keep unrelated locks from sharing one.
+ */
+#define LOCK_PROF_SITE_STRIDE 64
+typedef union ALIGN_VAR(LOCK_PROF_SITE_STRIDE) _lock_prof_padded_site_t {
+    lock_prof_site_t site;
+    byte pad[LOCK_PROF_SITE_STRIDE];
+} lock_prof_padded_site_t;
+
+#define LOCK_PROF_MAX_SITES 512
+#define LOCK_PROF_TOP_SITES 32
+
+static lock_prof_padded_site_t lock_prof_sites[LOCK_PROF_MAX_SITES];
+static uint lock_prof_num_sites;
+/* for unnamed locks and for names beyond LOCK_PROF_MAX_SITES */
+static lock_prof_padded_site_t lock_prof_other = {{"<other>",}};
+/* a spin lock, since a mutex_t here would profile itself */
+static volatile int lock_prof_table_lock;
+
+static inline uint64
+lock_prof_ticks(void)
+{
+    uint64 ticks;
+    RDTSC_LL(ticks);
+    return ticks;
+}
+
+static void
+lock_prof_table_acquire(void)
+{
+    while (atomic_swap(&lock_prof_table_lock, 1) != 0)
+        SPINLOCK_PAUSE();
+}
+
+static void
+lock_prof_table_release(void)
+{
+    lock_prof_table_lock = 0;
+}
+
+static lock_prof_site_t *
+lock_prof_site(mutex_t *lock)
+{
+    lock_prof_site_t *site = lock->prof_site;
+    uint i;
+    if (site != NULL)
+        return site;
+    site = &lock_prof_other.site;
+    if (lock->name != NULL) {
+        lock_prof_table_acquire();
+        for (i = 0; i < lock_prof_num_sites; i++) {
+            if (strcmp(lock_prof_sites[i].site.name, lock->name) == 0)
+                break;
+        }
+        if (i < lock_prof_num_sites)
+            site = &lock_prof_sites[i].site;
+        else if (lock_prof_num_sites < LOCK_PROF_MAX_SITES) {
+            site = &lock_prof_sites[lock_prof_num_sites++].site;
+            site->name = lock->name;
+        }
+        lock_prof_table_release();
+    }
+    /* Racing readers of an rwlock may both store this: they store the same value. */
+    lock->prof_site = site;
+    return site;
+}
+
+/* Records an acquisition of lock.  wait_start is 0 if the acquisition was
+ * uncontended, else the lock_prof_ticks() value when contention was noticed.
+ */
+static void
+lock_prof_acquired(mutex_t *lock, uint64 wait_start)
+{
+    lock_prof_site_t *site = lock_prof_site(lock);
+    thread_id_t tid = get_thread_id();
+    ATOMIC_ADD_PTR(ptr_uint_t, site->acquired, 1);
+    if (lock->prof_last_tid != tid) {
+        if (lock->prof_last_tid != INVALID_THREAD_ID)
+            ATOMIC_ADD_PTR(ptr_uint_t, site->handoffs, 1);
+        lock->prof_last_tid = tid;
+    }
+    if (wait_start != 0) {
+        uint64 wait = lock_prof_ticks() - wait_start;
+        lock_prof_table_acquire();
+        site->contended++;
+        site->wait_ticks += wait;
+        if (wait > site->max_wait_ticks)
+            site->max_wait_ticks = wait;
+        lock_prof_table_release();
+    }
+}
+
+/* Prints the -prof_locks entries with the most total wait time to stderr.
+ * Called at exit and for NUDGE_DR_lock_prof.
+ */
+void
+dump_lock_profile(void)
+{
+    bool printed[LOCK_PROF_MAX_SITES + 1];
+    uint i, num_sites, num_printed;
+    if (!DYNAMO_OPTION(prof_locks))
+        return;
+    memset(printed, 0, sizeof(printed));
+    /* Entries are only ever appended, so a racy snapshot of the count is fine. */
+    num_sites = lock_prof_num_sites;
+    print_file(STDERR, "(Begin) Lock profile: %u names, by total wait ticks:\n",
+               num_sites);
+    print_file(STDERR, "\t%12s %12s %12s %16s %16s  %s\n",
+               "acquired", "handoffs", "contended", "wait ticks", "max wait", "name");
+    for (num_printed = 0; num_printed < LOCK_PROF_TOP_SITES; num_printed++) {
+        /* index num_sites is lock_prof_other */
+        lock_prof_site_t *best = NULL;
+        uint best_idx = 0;
+        for (i = 0; i <= num_sites; i++) {
+            lock_prof_site_t *site = (i == num_sites) ? &lock_prof_other.site :
+                &lock_prof_sites[i].site;
+            if (printed[i] || site->acquired == 0)
+                continue;
+            if (best == NULL || site->wait_ticks > best->wait_ticks ||
+                (site->wait_ticks == best->wait_ticks &&
+                 site->acquired > best->acquired)) {
+                best = site;
+                best_idx = i;
+            }
+        }
+        if (best == NULL)
+            break;
+        printed[best_idx] = true;
+        print_file(STDERR, "\t%12"SZFC" %12"SZFC" %12"SZFC" %16"UINT64_FORMAT_CODE
+                   " %16"UINT64_FORMAT_CODE"  %s\n", best->acquired, best->handoffs,
+                   best->contended, best->wait_ticks, best->max_wait_ticks, best->name);
+    }
+    print_file(STDERR, "(End) Lock profile\n");
+}
+
 #ifdef DEADLOCK_AVOIDANCE
 static bool
 mutex_ownable(mutex_t *lock)
@@ -833,6 +988,7 @@ void
 mutex_lock(mutex_t *lock)
 {
     bool acquired;
+    uint64 wait_start = 0; /* for -prof_locks */
 #ifdef DEADLOCK_AVOIDANCE
     bool ownable = mutex_ownable(lock);
 #endif
@@ -845,13 +1001,21 @@ mutex_lock(mutex_t *lock)
     /* we may want to first spin the lock for a while if we are on a multiprocessor machine */
     /* option is external only so that we can set it to 0 on a uniprocessor */
     if (spinlock_count) {
-        uint i;
+        uint i, max_spins;
+        int sample, delta;
         /* in the common case we'll just get it */
         if (mutex_trylock(lock))
             return;
 
         /* otherwise contended, we should spin for some time */
-        i = spinlock_count;
+        if (DYNAMO_OPTION(prof_locks))
+            wait_start = lock_prof_ticks();
+        /* Adaptive spinning, as in glibc's adaptive mutexes: spin at most
+         * about twice as long as it has recently taken for this lock to be
+         * released, rather than always spinlock_count, before parking.
+         */
+        max_spins = MIN(spinlock_count, 2 * (uint)lock->spin_average + 10);
+        i = max_spins;
         /* while spinning we are PAUSEing and reading without LOCKing the bus in the spin loop */
         do {
             /* hint we are spinning */
@@ -871,6 +1035,19 @@ mutex_lock(mutex_t *lock)
             }
             i--;
         } while (i>0);
+        /* Released while spinning, or we ran out of spins: move the average
+         * toward what would have sufficed.  If other threads are already
+         * parked, the lock is oversubscribed and spinning only burns the
+         * core, so move toward zero.  Racy updates are harmless.
+         * We round the step away from zero so that truncation can't leave
+         * the average stuck up to 7 away from a steady sample.
+         */
+        if (lock->lock_requests > LOCK_SET_STATE)
+            sample = 0;
+        else
+            sample = (int)(max_spins - i);
+        delta = sample - lock->spin_average;
+        lock->spin_average += (delta + (delta < 0 ? -7 : 7)) / 8;
     }
 
     /* we have strong intentions to grab this lock, increment requests */
@@ -878,6 +1055,8 @@ mutex_lock(mutex_t *lock)
     DEADLOCK_AVOIDANCE_LOCK(lock, acquired, ownable);
 
     if (!acquired) {
+        if (DYNAMO_OPTION(prof_locks) && wait_start == 0)
+            wait_start = lock_prof_ticks();
         mutex_wait_contended_lock(lock);
 #       ifdef DEADLOCK_AVOIDANCE
         DEADLOCK_AVOIDANCE_LOCK(lock, true, ownable); /* now we got it  */
@@ -886,6 +1065,8 @@ mutex_lock(mutex_t *lock)
             lock->max_contended_requests = (uint)lock->lock_requests;
 #       endif
     }
+    if (DYNAMO_OPTION(prof_locks))
+        lock_prof_acquired(lock, wait_start);
 }
 
 /* try once to grab the lock, return whether or not successful */
@@ -909,6 +1090,8 @@ mutex_trylock(mutex_t *lock)
        so we should return false
      */
     DEADLOCK_AVOIDANCE_LOCK(lock, acquired, ownable);
+    if (acquired && DYNAMO_OPTION(prof_locks))
+        lock_prof_acquired(lock, 0);
     return acquired;
 }
 
@@ -1076,13 +1259,128 @@ self_owns_recursive_lock(recursive_lock_t *lock)
    rwlock primitives. It also lets the Linux implementation just yield.  
 */
 
-void read_lock(read_write_lock_t *rw)
+/* Scalable rwlocks: each reader increments one of RWLOCK_READER_SLOTS
+ * counters, chosen by thread id and each on its own cache line, so that
+ * readers on different cores do not bounce a shared line.  A writer takes
+ * the mutex and then waits for every counter to drain.  Readers increment
+ * and then test the mutex while writers lock the mutex and then read the
+ * counters, both with locked instructions, so one of them always sees the
+ * other.  Writers are rare for the locks this is used for, so both sides
+ * simply spin and then yield rather than using the contention events.
+ */
+#define RWLOCK_READER_SLOT_BITS 5
+#define RWLOCK_READER_SLOTS (1 << RWLOCK_READER_SLOT_BITS)
+#define RWLOCK_SLOT_STRIDE (64 / sizeof(int)) /* a cache line apart */
+#define RWLOCK_SLOTS_SIZE (RWLOCK_READER_SLOTS * RWLOCK_SLOT_STRIDE * sizeof(int))
+#define RWLOCK_SPINS_BEFORE_YIELD 64
+
+static inline volatile int *
+rwlock_reader_slot(read_write_lock_t *rw, thread_id_t tid)
+{
+    /* Windows thread ids are multiples of 4, so hash rather than mask */
+    uint idx = ((uint)tid * 2654435761U) >> (32 - RWLOCK_READER_SLOT_BITS);
+    return &rw->reader_slots[idx * RWLOCK_SLOT_STRIDE];
+}
+
+void
+rwlock_make_scalable(read_write_lock_t *rw)
+{
+    volatile int *slots;
+    ASSERT(rw->reader_slots == NULL);
+    ASSERT(rw->num_readers == 0 && !mutex_testlock(&rw->lock));
+    /* readers write here even when our own data is read-only */
+    slots = (volatile int *) global_unprotected_heap_alloc(RWLOCK_SLOTS_SIZE
+                                                           HEAPACCT(ACCT_OTHER));
+    memset((void *)slots, 0, RWLOCK_SLOTS_SIZE);
+    rw->reader_slots = slots;
+    STATS_INC(num_scalable_rwlocks);
+}
+
+int
+rwlock_num_readers(read_write_lock_t *rw)
+{
+    int i, sum = 0;
+    if (rw->reader_slots == NULL)
+        return rw->num_readers;
+    for (i = 0; i < RWLOCK_READER_SLOTS; i++)
+        sum += rw->reader_slots[i * RWLOCK_SLOT_STRIDE];
+    return sum;
+}
+
+void
+rwlock_delete(read_write_lock_t *rw)
+{
+    if (rw->reader_slots != NULL) {
+        ASSERT(rwlock_num_readers(rw) == 0);
+        global_unprotected_heap_free((void *)rw->reader_slots, RWLOCK_SLOTS_SIZE
+                                     HEAPACCT(ACCT_OTHER));
+        rw->reader_slots = NULL;
+    }
+    mutex_delete(&rw->lock);
+}
+
+static inline void
+rwlock_scalable_spin(uint *spins)
+{
+    if (++(*spins) < RWLOCK_SPINS_BEFORE_YIELD)
+        SPINLOCK_PAUSE();
+    else
+        thread_yield();
+}
+
+static void
+read_lock_scalable(read_write_lock_t *rw)
+{
+    thread_id_t tid = get_thread_id();
+    volatile int *slot = rwlock_reader_slot(rw, tid);
+    uint spins = 0;
+    do {
+        ATOMIC_INC(int, *slot);
+        if (!mutex_testlock(&rw->lock))
+            break;
+        /* as in read_lock, a writer may also read, without an acquire */
+        if (rw->writer == tid)
+            return;
+        /* back off so the writer's scan can complete */
+        ATOMIC_DEC(int, *slot);
+        STATS_INC(num_scalable_rwlock_read_waits);
+        while (mutex_testlock(&rw->lock)) {
+            DEADLOCK_AVOIDANCE_LOCK(&rw->lock, false, LOCK_NOT_OWNABLE);
+            rwlock_scalable_spin(&spins);
+        }
+    } while (true);
+    DEADLOCK_AVOIDANCE_LOCK(&rw->lock, true, LOCK_NOT_OWNABLE);
+}
+
+static void read_lock_internal(read_write_lock_t *rw);
+
+void
+read_lock(read_write_lock_t *rw)
+{
+    uint64 wait_start = 0;
+    if (!DYNAMO_OPTION(prof_locks)) {
+        read_lock_internal(rw);
+        return;
+    }
+    /* a writer reading its own lock is not contention */
+    if (mutex_testlock(&rw->lock) && rw->writer != get_thread_id())
+        wait_start = lock_prof_ticks();
+    read_lock_internal(rw);
+    lock_prof_acquired(&rw->lock, wait_start);
+}
+
+static void
+read_lock_internal(read_write_lock_t *rw)
 {
     /* wait for writer here if lock is held 
      * FIXME: generalize DEADLOCK_AVOIDANCE to both detect
      * order violations and gather contention stats for
      * this mutex-less synch
      */
+    if (rw->reader_slots != NULL) {
+        read_lock_scalable(rw);
+        return;
+    }
     if (INTERNAL_OPTION(spin_yield_rwlock)) {
         do {
             while (mutex_testlock(&rw->lock)) {
@@ -1199,6 +1497,17 @@ void write_lock(read_write_lock_t *rw)
      * a loop because that would be unfair to writers -- first guy
      * in this implementation gets to write
      */
+    if (rw->reader_slots != NULL) {
+        uint spins = 0;
+        mutex_lock(&rw->lock);
+        while (rwlock_num_readers(rw) > 0) {
+            /* contended write */
+            DEADLOCK_AVOIDANCE_LOCK(&rw->lock, false, LOCK_NOT_OWNABLE);
+            rwlock_scalable_spin(&spins);
+        }
+        rw->writer = get_thread_id();
+        return;
+    }
     if (INTERNAL_OPTION(spin_yield_rwlock)) {
         mutex_lock(&rw->lock);
         while (rw->num_readers > 0) {
@@ -1227,6 +1536,14 @@ bool write_trylock(read_write_lock_t *rw)
 {
     if (mutex_trylock(&rw->lock)) {
         ASSERT_NOT_TESTED();
+        if (rw->reader_slots != NULL) {
+            if (rwlock_num_readers(rw) == 0) {
+                rw->writer = get_thread_id();
+                return true;
+            }
+            mutex_unlock(&rw->lock);
+            return false;
+        }
         if (rw->num_readers == 0) {
             rw->writer = get_thread_id();
             return true;
@@ -1247,6 +1564,11 @@ bool write_trylock(read_write_lock_t *rw)
 
 void read_unlock(read_write_lock_t *rw)
 {
+    if (rw->reader_slots != NULL) {
+        ATOMIC_DEC(int, *rwlock_reader_slot(rw, get_thread_id()));
+        DEADLOCK_AVOIDANCE_UNLOCK(&rw->lock, LOCK_NOT_OWNABLE);
+        return;
+    }
     if (INTERNAL_OPTION(spin_yield_rwlock)) {
         ATOMIC_DEC(int, rw->num_readers);
         DEADLOCK_AVOIDANCE_UNLOCK(&rw->lock, LOCK_NOT_OWNABLE);
@@ -1290,7 +1612,7 @@ void write_unlock(read_write_lock_t *rw)
     ASSERT(rw->writer == rw->lock.owner);
 #endif
     rw->writer = INVALID_THREAD_ID;
-    if (INTERNAL_OPTION(spin_yield_rwlock)) {
+    if (rw->reader_slots != NULL || INTERNAL_OPTION(spin_yield_rwlock)) {
         mutex_unlock(&rw->lock);
         return;
     }
@@ -3104,6 +3426,31 @@ print_timestamp(file_t logfile)
 
 #endif /* DEBUG */
 
+/* For -rstats_to_stderr: lets an external driver such as tools/drtune
+ * read the statistics of a release build, which has no log files.
+ * The raw format matches dump_global_stats(true).
+ */
+void
+dump_global_rstats_to_stderr(void)
+{
+    if (!GLOBAL_STATS_ON())
+        return;
+    print_file(STDERR, "(Begin) Release statistics:\n");
+#define RSTATS_PRINT(desc, stat) if (GLOBAL_STAT(stat)) {                   \
+        print_file(STDERR, "\t%s\t= "SSZFMT"\n", #stat, GLOBAL_STAT(stat)); \
+    }
+#ifdef DEBUG
+# define STATS_DEF RSTATS_PRINT
+#else
+# define RSTATS_DEF RSTATS_PRINT
+#endif
+#include "statsx.h"
+#undef STATS_DEF
+#undef RSTATS_DEF
+#undef RSTATS_PRINT
+    print_file(STDERR, "(End) Release statistics\n");
+}
+
 static void 
 dump_buffer_as_ascii(file_t logfile, char *buffer, size_t len)
 {
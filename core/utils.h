@@ -259,7 +259,15 @@ typedef struct _mutex_t {
 #  define MAX_MUTEX_CALLSTACK 0 /* cannot use */
 #endif /* MUTEX_CALLSTACK */
     bool deleted;  /* this lock has been deleted at least once */
+#else
+    const char *name;            /* for -prof_locks */
 #endif /* DEADLOCK_AVOIDANCE */
+    /* -prof_locks entry for this lock's name, filled in lazily */
+    struct _lock_prof_site_t *prof_site;
+    /* -prof_locks: last acquirer, to count cross-thread handoffs */
+    thread_id_t prof_last_tid;
+    /* Recent average of spins before release, for mutex_lock's adaptive spin */
+    int spin_average;
     /* Any new field needs to be initialized with INIT_LOCK_NO_TYPE */
 } mutex_t;
 
@@ -294,6 +302,14 @@ typedef struct _read_write_lock_t {
     volatile int num_pending_readers;       /* readers that have contended with a writer */
     contention_event_t writer_waiting_readers; /* event object for writer to wait on */
     contention_event_t readers_waiting_writer; /* event object for readers to wait on */
+    /* If non-NULL, readers count themselves here instead of in num_readers:
+     * see rwlock_make_scalable().
+     */
+    volatile int *reader_slots;
+    /* Linux futex that readers blocked on a writer wait on: bumped by
+     * rwlock_notify_readers()
+     */
+    volatile int writer_releases;
     /* make sure to update the two INIT_READWRITE_LOCK cases if you add new fields  */
 } read_write_lock_t;
 
@@ -588,8 +604,9 @@ bool thread_owns_first_or_both_locks_only(dcontext_t *dcontext, mutex_t *lock1,
                                          name, rank,                    \
                                          INVALID_THREAD_ID,}
 #else
-/* Ignore the arguments */
-#  define INIT_LOCK_NO_TYPE(name, rank) {LOCK_FREE_STATE, CONTENTION_EVENT_NOT_CREATED}
+/* Ignore the rank, but keep the name for -prof_locks */
+#  define INIT_LOCK_NO_TYPE(name, rank) {LOCK_FREE_STATE, CONTENTION_EVENT_NOT_CREATED, \
+                                         name}
 #endif /* DEADLOCK_AVOIDANCE */
 
 /* Structure assignments and initialization don't work the same in gcc and cl
@@ -637,7 +654,8 @@ bool thread_owns_first_or_both_locks_only(dcontext_t *dcontext, mutex_t *lock1,
        LOCK_RANK(lock)),                                                \
        0, INVALID_THREAD_ID,                                            \
        0,                                                               \
-       CONTENTION_EVENT_NOT_CREATED, CONTENTION_EVENT_NOT_CREATED       \
+       CONTENTION_EVENT_NOT_CREATED, CONTENTION_EVENT_NOT_CREATED,      \
+       NULL, 0                                                          \
    }
 
 #define ASSIGN_INIT_READWRITE_LOCK_FREE(var, lock) do {                 \
@@ -647,7 +665,8 @@ bool thread_owns_first_or_both_locks_only(dcontext_t *dcontext, mutex_t *lock1,
                                                  LOCK_RANK(lock)),      \
        0, INVALID_THREAD_ID,                                            \
        0,                                                               \
-       CONTENTION_EVENT_NOT_CREATED, CONTENTION_EVENT_NOT_CREATED       \
+       CONTENTION_EVENT_NOT_CREATED, CONTENTION_EVENT_NOT_CREATED,      \
+       NULL, 0                                                          \
       };                                                                \
      var = initializer_##lock;                                          \
    } while (0)
@@ -667,9 +686,10 @@ bool thread_owns_first_or_both_locks_only(dcontext_t *dcontext, mutex_t *lock1,
 #define DELETE_LOCK(lock) mutex_delete(&lock)
 #define DELETE_SPINMUTEX(spinmutex) spinmutex_delete(&spinmutex)
 #define DELETE_RECURSIVE_LOCK(rec_lock) mutex_delete(&(rec_lock).lock)
-#define DELETE_READWRITE_LOCK(rwlock) mutex_delete(&(rwlock).lock)
+#define DELETE_READWRITE_LOCK(rwlock) rwlock_delete(&(rwlock))
 /* mutexes need to release any kernel objects that were created */
 void mutex_delete(mutex_t *lock); 
+void rwlock_delete(read_write_lock_t *rw);
 
 /* basic synchronization functions */
 void mutex_lock(mutex_t *mutex);
@@ -719,6 +739,13 @@ bool write_trylock(read_write_lock_t *rw);
 void read_unlock(read_write_lock_t *rw);
 void write_unlock(read_write_lock_t *rw);
 bool self_owns_write_lock(read_write_lock_t *rw);
+/* Switches a not-yet-used rwlock to per-thread reader counters, which keeps
+ * readers on different cores from contending on one cache line but makes
+ * writers scan all the counters.  Meant for read-mostly locks.
+ */
+void rwlock_make_scalable(read_write_lock_t *rw);
+/* number of readers currently holding rw */
+int rwlock_num_readers(read_write_lock_t *rw);
 
 /* a broadcast event wakes all waiting threads when signalled */
 struct _broadcast_event_t;
@@ -762,8 +789,8 @@ void unintend_wait_broadcast_event_helper(broadcast_event_t *be);
 void wait_broadcast_event_helper(broadcast_event_t *be);
 
 /* test whether locks are held at all */
-#define WRITE_LOCK_HELD(rw) (mutex_testlock(&(rw)->lock) && ((rw)->num_readers == 0))
-#define READ_LOCK_HELD(rw) ((rw)->num_readers > 0)
+#define WRITE_LOCK_HELD(rw) (mutex_testlock(&(rw)->lock) && (rwlock_num_readers(rw) == 0))
+#define READ_LOCK_HELD(rw) (rwlock_num_readers(rw) > 0)
 
 /* test whether current thread owns locks
  * for non-DEADLOCK_AVOIDANCE, cannot tell who owns it, so we bundle
@@ -1938,6 +1965,12 @@ print_symbolic_address(app_pc tag, char *buf, int max_chars, bool exact_only);
 
 #endif /* DEBUG */
 
+/* prints the global statistics available in this build to stderr */
+void dump_global_rstats_to_stderr(void);
+
+/* prints the -prof_locks lock profile to stderr */
+void dump_lock_profile(void);
+
 bool
 under_internal_exception(void);
 
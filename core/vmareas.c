@@ -324,11 +324,11 @@ static app_pc tamper_resistant_region_start, tamper_resistant_region_end;
 static thread_data_t *shared_data; /* set in vm_areas_reset_init() */
 
 typedef struct _pending_delete_t {
-#ifdef DEBUG
-    /* record bounds of original deleted region, for debugging only */
+    /* record bounds of original deleted region, for debugging and for the
+     * batched client deletion event (NULL if not from a single region)
+     */
     app_pc start;
     app_pc end;
-#endif
     /* list of unlinked fragments that are waiting to be deleted */
     fragment_t *frags;
     /* ref count and timestamp to determine when it's safe to delete them */
@@ -1558,6 +1558,9 @@ vm_areas_init()
      */
     VMVECTOR_ALLOC_VECTOR(executable_areas, GLOBAL_DCONTEXT, VECTOR_SHARED,
                           executable_areas);
+    /* read for every new block, written only on module and protection changes */
+    if (DYNAMO_OPTION(scalable_rwlocks))
+        rwlock_make_scalable(&executable_areas->lock);
     VMVECTOR_ALLOC_VECTOR(pretend_writable_areas, GLOBAL_DCONTEXT, VECTOR_SHARED,
                           pretend_writable_areas);
     VMVECTOR_ALLOC_VECTOR(patch_proof_areas, GLOBAL_DCONTEXT, VECTOR_SHARED,
@@ -8675,17 +8678,14 @@ vm_area_remove_fragment(dcontext_t *dcontext, fragment_t *f)
  */
 static void
 add_to_pending_list(dcontext_t *dcontext, fragment_t *f,
-                    uint refcount, uint flushtime
-                    _IF_DEBUG(app_pc start) _IF_DEBUG(app_pc end))
+                    uint refcount, uint flushtime, app_pc start, app_pc end)
 {
     pending_delete_t *pend;
     ASSERT_OWN_MUTEX(true, &shared_delete_lock);
     pend = HEAP_TYPE_ALLOC(GLOBAL_DCONTEXT, pending_delete_t,
                            ACCT_VMAREAS, PROTECTED);
-    DODEBUG({
-        pend->start = start;
-        pend->end = end;
-    });
+    pend->start = start;
+    pend->end = end;
     pend->frags = f;
     if (DYNAMO_OPTION(shared_deletion)) {
         /* Set up ref count and timestamp for delayed deletion */
@@ -8816,8 +8816,7 @@ move_lazy_list_to_pending_delete(dcontext_t *dcontext)
                             /* we do count this thread, as we aren't checking the
                              * pending list here or inc-ing our flushtime
                              */
-                            get_num_threads(), flushtime_global
-                            _IF_DEBUG(NULL) _IF_DEBUG(NULL));
+                            get_num_threads(), flushtime_global, NULL, NULL);
         todelete->lazy_delete_list = NULL;
         todelete->lazy_delete_tail = NULL;
         todelete->lazy_delete_count = 0;
@@ -9011,8 +9010,7 @@ unlink_fragments_for_deletion(dcontext_t *dcontext, fragment_t *list,
     mutex_lock(&shared_delete_lock);
     /* add area's fragments as a new entry in the pending deletion list */
     add_to_pending_list(dcontext, list,
-                        pending_delete_threads, flushtime_global
-                        _IF_DEBUG(NULL) _IF_DEBUG(NULL));
+                        pending_delete_threads, flushtime_global, NULL, NULL);
     mutex_unlock(&shared_delete_lock);
     STATS_ADD(list_entries_unlinked_for_deletion, num);
     return num;
@@ -9180,9 +9178,9 @@ vm_area_unlink_fragments(dcontext_t *dcontext, app_pc start, app_pc end,
                 if (data->areas.buf[i].custom.frags != NULL) {
                     /* add area's fragments as a new entry in the pending deletion list */
                     add_to_pending_list(dcontext, data->areas.buf[i].custom.frags,
-                                        pending_delete_threads, flushtime_global
-                                        _IF_DEBUG(data->areas.buf[i].start)
-                                        _IF_DEBUG(data->areas.buf[i].end));
+                                        pending_delete_threads, flushtime_global,
+                                        data->areas.buf[i].start,
+                                        data->areas.buf[i].end);
                     /* frags are moved over completely */
                     data->areas.buf[i].custom.frags = NULL;
                     STATS_INC(num_shared_flush_regions);
@@ -9405,6 +9403,9 @@ vm_area_check_shared_pending(dcontext_t *dcontext, fragment_t *was_I_flushed)
             "\tdeleting all fragments in region "PFX".."PFX" flushtime %u\n",
             pend->start, pend->end, pend->flushtime_deleted);
         ASSERT(pend->frags != NULL);
+#ifdef CLIENT_INTERFACE
+        instrument_fragment_delete_batch_start(pend->start, pend->end);
+#endif
         for (entry = pend->frags; entry != NULL; entry = next) {
             next = FRAG_NEXT(entry);
             LOG(THREAD, LOG_FRAGMENT|LOG_VMAREAS, 5,
@@ -9428,6 +9429,9 @@ vm_area_check_shared_pending(dcontext_t *dcontext, fragment_t *was_I_flushed)
             STATS_INC(num_fragments_deleted_consistency);
             num++;
         }
+#ifdef CLIENT_INTERFACE
+        instrument_fragment_delete_batch_end();
+#endif
 
         ASSERT(todelete->shared_delete_count > 0);
         todelete->shared_delete_count--;
@@ -9496,6 +9500,9 @@ vm_area_flush_fragments(dcontext_t *dcontext, fragment_t *was_I_flushed)
             LOG(THREAD, LOG_FRAGMENT|LOG_VMAREAS, 2,
                 "\tdeleting all fragments in region "PFX".."PFX"\n",
                 v->buf[i].start, v->buf[i].end);
+#ifdef CLIENT_INTERFACE
+            instrument_fragment_delete_batch_start(v->buf[i].start, v->buf[i].end);
+#endif
             for (entry = v->buf[i].custom.frags; entry != NULL; entry = next) {
                 next = FRAG_NEXT(entry);
                 LOG(THREAD, LOG_FRAGMENT|LOG_VMAREAS, 5,
@@ -9523,6 +9530,9 @@ vm_area_flush_fragments(dcontext_t *dcontext, fragment_t *was_I_flushed)
                 STATS_INC(num_fragments_deleted_consistency);
                 num++;
             }
+#ifdef CLIENT_INTERFACE
+            instrument_fragment_delete_batch_end();
+#endif
             v->buf[i].custom.frags = NULL;
             /* could just remove flush region...but we flushed entire vm region 
              * ASSUMPTION: remove_vm_area, given exact bounds, simply shifts later
@@ -9978,8 +9988,10 @@ vm_area_coarse_region_freeze(dcontext_t *dcontext, coarse_info_t *info,
         unfrozen_info->cache != NULL /*skip empty units*/ &&
         !TEST(PERSCACHE_CODE_INVALID, unfrozen_info->flags) &&
          /* we only freeze a unit in presence of a frozen unit if we're merging
-          * (we don't support side-by-side frozen units) */
-        (DYNAMO_OPTION(coarse_freeze_merge) || frozen_info == NULL)) {
+          * (we don't support side-by-side frozen units), and we can't merge
+          * with a position-independent unit loaded at another module base */
+        (frozen_info == NULL ||
+         (DYNAMO_OPTION(coarse_freeze_merge) && frozen_info->mod_shift == 0))) {
         if (in_place || coarse_region_should_persist(dcontext, info)) {
             coarse_info_t *frozen;
             coarse_info_t *premerge;
@@ -111,6 +111,14 @@ struct vm_area_vector_t {
      * If non-NULL, the free_payload_func will NOT be called.
      */
     void *(*merge_payload_func)(void *dst, void *src);
+
+    /* Readers write the lock, and the shared vectors are allocated back to
+     * back at init time: without this, the next vector's lock shares a cache
+     * line with the end of ours (in a 64-bit release build our lock ends 32
+     * bytes before the end of the struct, and the next lock starts 24 bytes
+     * into it), so readers of the two vectors would keep moving that line.
+     */
+    byte pad_lock_line[64];
 }; /* typedef-ed in globals.h */
 
 /* vm_area_vectors should NOT be declared statically if their locks need to be
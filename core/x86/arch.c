@@ -2943,6 +2943,27 @@ recreate_app_state_from_info(dcontext_t *tdcontext, const translation_info_t *in
     return res;
 }
 
+/* For a run of cold instrs that mangle moved out of line after the final
+ * exit cti, returns the translation of the app instr its jmp back returns
+ * to, or NULL if there is no such jmp.
+ */
+static app_pc
+cold_instr_resume_pc(instr_t *inst)
+{
+    instr_t *in;
+    while (!instr_is_ubr(inst) && instr_get_next(inst) != NULL &&
+           instr_is_cold(instr_get_next(inst)))
+        inst = instr_get_next(inst);
+    if (!instr_is_ubr(inst) || !opnd_is_instr(instr_get_target(inst)))
+        return NULL;
+    for (in = opnd_get_instr(instr_get_target(inst)); in != NULL;
+         in = instr_get_next(in)) {
+        if (instr_get_translation(in) != NULL)
+            return instr_get_translation(in);
+    }
+    return NULL;
+}
+
 /* Returns a success code, but makes a best effort regardless.
  * If just_pc is true, only recreates pc.
  * Modifies mc with the recreated state.
@@ -3072,7 +3093,13 @@ recreate_app_state_from_ilist(dcontext_t *tdcontext, instrlist_t *ilist,
                                       "field and handle fault!");
                     }
                 });
-                if (prev_ok == NULL) {
+                if (instr_is_cold(inst) && cold_instr_resume_pc(inst) != NULL) {
+                    /* prev_ok is the final exit, not where the run came from */
+                    answer = cold_instr_resume_pc(inst);
+                    LOG(THREAD_GET, LOG_INTERP, 2,
+                        "recreate_app -- WARNING: guessing cold code resume pc "
+                        PFX"\n", answer);
+                } else if (prev_ok == NULL) {
                     answer = start_app;
                     LOG(THREAD_GET, LOG_INTERP, 2,
                         "recreate_app -- WARNING: guessing start pc "PFX"\n", answer);
@@ -414,9 +414,18 @@ static inline int64 atomic_add_exchange_int64(volatile int64 *var, int64 value)
                       : "0" (newval), "m" (var))
 
 # define SPINLOCK_PAUSE()   __asm__ __volatile__("pause")
-# define RDTSC_LL(llval)                        \
+# ifdef X64
+/* "=A" is rax or rdx, not edx:eax, on x64 */
+#  define RDTSC_LL(llval) do {                                          \
+        uint rdtsc_lo_, rdtsc_hi_;                                      \
+        __asm__ __volatile__("rdtsc" : "=a" (rdtsc_lo_), "=d" (rdtsc_hi_)); \
+        (llval) = ((uint64)rdtsc_hi_ << 32) | rdtsc_lo_;                \
+    } while (0)
+# else
+#  define RDTSC_LL(llval)                       \
     __asm__ __volatile__                        \
     ("rdtsc" : "=A" (llval))
+# endif
 # define SERIALIZE_INSTRUCTIONS()                                       \
     __asm__ __volatile__                                                \
     ("xor %%eax, %%eax; cpuid" : : : "eax", "ebx", "ecx", "edx");
@@ -1533,7 +1542,8 @@ bool is_observed_call_site(dcontext_t *dcontext, app_pc retaddr);
 #endif
 
 /* in optimize.c */
-void optimize_trace(dcontext_t *dcontext, app_pc tag, instrlist_t *trace);
+void optimize_trace(dcontext_t *dcontext, app_pc tag, instrlist_t *trace,
+                    bool recreating);
 #ifdef DEBUG
 void print_optimization_stats(void); 
 #endif
@@ -3260,6 +3260,14 @@ preinsert_swap_peb(dcontext_t *dcontext, instrlist_t *ilist, instr_t *next,
 # define OPND_ARG1   OPND_CREATE_MEM32(REG_ESP, 4)
 #endif
 
+/* For -fcache_fast_eflags: the eflags bits other than the six arithmetic
+ * flags, IF, and the always-set bit 1.  If none of these is set in the app's
+ * eflags then DR's own state (DF, TF, and AC clear) needs no popf on a
+ * context switch, and the arithmetic flags can be set via sahf.
+ */
+#define EFLAGS_NON_ARITH_MASK \
+    (~(EFLAGS_CF|EFLAGS_PF|EFLAGS_AF|EFLAGS_ZF|EFLAGS_SF|EFLAGS_OF|0x202))
+
 /* Our context switch to and from the fragment cache are arranged such
  * that there is no persistent state kept on the dstack, allowing us to
  * start with a clean slate on exiting the cache.  This eliminates the
@@ -3461,9 +3469,38 @@ emit_fcache_enter_common(dcontext_t *dcontext, generated_code_t *code, byte *pc,
     }
 #endif
     APP(&ilist, RESTORE_FROM_DC(dcontext, REG_XAX, XFLAGS_OFFSET));
-    APP(&ilist, INSTR_CREATE_push(dcontext, opnd_create_reg(REG_XAX)));
-    /* restore eflags temporarily using dstack */
-    APP(&ilist, INSTR_CREATE_RAW_popf(dcontext));
+    if (INTERNAL_OPTION(fcache_fast_eflags)) {
+        /* If only arithmetic flags are set we avoid the popf: OF via
+         * "add al,0x7f" with al holding OF, the rest via sahf.  xcx is
+         * restored below.
+         */
+        instr_t *slow_eflags = INSTR_CREATE_label(dcontext);
+        instr_t *eflags_done = INSTR_CREATE_label(dcontext);
+        APP(&ilist, INSTR_CREATE_test(dcontext, opnd_create_reg(REG_EAX),
+                                      OPND_CREATE_INT32(EFLAGS_NON_ARITH_MASK)));
+        APP(&ilist, INSTR_CREATE_jcc(dcontext, OP_jnz, opnd_create_instr(slow_eflags)));
+        APP(&ilist, INSTR_CREATE_mov_ld(dcontext, opnd_create_reg(REG_ECX),
+                                        opnd_create_reg(REG_EAX)));
+        /* every bit above OF is clear, so this leaves just OF */
+        APP(&ilist, INSTR_CREATE_shr(dcontext, opnd_create_reg(REG_ECX),
+                                     OPND_CREATE_INT8(11)));
+        APP(&ilist, INSTR_CREATE_mov_ld(dcontext, opnd_create_reg(REG_AH),
+                                        opnd_create_reg(REG_AL)));
+        APP(&ilist, INSTR_CREATE_mov_ld(dcontext, opnd_create_reg(REG_AL),
+                                        opnd_create_reg(REG_CL)));
+        APP(&ilist, INSTR_CREATE_add(dcontext, opnd_create_reg(REG_AL),
+                                     OPND_CREATE_INT8(0x7f)));
+        APP(&ilist, INSTR_CREATE_sahf(dcontext));
+        APP(&ilist, INSTR_CREATE_jmp_short(dcontext, opnd_create_instr(eflags_done)));
+        APP(&ilist, slow_eflags);
+        APP(&ilist, INSTR_CREATE_push(dcontext, opnd_create_reg(REG_XAX)));
+        APP(&ilist, INSTR_CREATE_RAW_popf(dcontext));
+        APP(&ilist, eflags_done);
+    } else {
+        APP(&ilist, INSTR_CREATE_push(dcontext, opnd_create_reg(REG_XAX)));
+        /* restore eflags temporarily using dstack */
+        APP(&ilist, INSTR_CREATE_RAW_popf(dcontext));
+    }
     if (preserve_xmm_caller_saved()) {
         /* PR 264138: we must preserve xmm0-5 if on a 64-bit kernel.
          * Rather than try and optimize we save/restore on every cxt
@@ -3937,9 +3974,24 @@ append_fcache_return_common(dcontext_t *dcontext, generated_code_t *code,
     /* clear eflags now to avoid app's eflags (namely an app std)
      * messing up our ENTER_DR_HOOK
      */
-    /* on x64 a push immed is sign-extended to 64-bit */
-    APP(ilist, INSTR_CREATE_push_imm(dcontext, OPND_CREATE_INT8(0)));
-    APP(ilist, INSTR_CREATE_RAW_popf(dcontext));
+    if (INTERNAL_OPTION(fcache_fast_eflags)) {
+        /* the arithmetic flags need no clearing, so skip the popf unless
+         * the app has DF, TF, AC, or another non-arithmetic flag set
+         */
+        instr_t *eflags_clear = INSTR_CREATE_label(dcontext);
+        APP(ilist, INSTR_CREATE_test(dcontext, opnd_create_reg(REG_EBX),
+                                     OPND_CREATE_INT32(EFLAGS_NON_ARITH_MASK)));
+        APP(ilist, INSTR_CREATE_jcc(dcontext, OP_jz, opnd_create_instr(eflags_clear)));
+        /* on x64 a push immed is sign-extended to 64-bit */
+        APP(ilist, INSTR_CREATE_push_imm(dcontext, OPND_CREATE_INT8(0)));
+        APP(ilist, INSTR_CREATE_RAW_popf(dcontext));
+        APP(ilist, eflags_clear);
+        instr_targets = true;
+    } else {
+        /* on x64 a push immed is sign-extended to 64-bit */
+        APP(ilist, INSTR_CREATE_push_imm(dcontext, OPND_CREATE_INT8(0)));
+        APP(ilist, INSTR_CREATE_RAW_popf(dcontext));
+    }
 
     if (ENTER_DR_HOOK != NULL) {
         /* xax is only reg we need to save around the call.
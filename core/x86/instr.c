@@ -2308,6 +2308,23 @@ instr_set_ok_to_emit(instr_t *instr, bool val)
         instr->flags |= INSTR_DO_NOT_EMIT;
 }
 
+bool
+instr_is_cold(instr_t *instr)
+{
+    CLIENT_ASSERT(instr != NULL, "instr_is_cold: passed NULL");
+    return TEST(INSTR_COLD, instr->flags);
+}
+
+void
+instr_set_cold(instr_t *instr, bool val)
+{
+    CLIENT_ASSERT(instr != NULL, "instr_set_cold: passed NULL");
+    if (val)
+        instr->flags |= INSTR_COLD;
+    else
+        instr->flags &= ~INSTR_COLD;
+}
+
 #ifdef CUSTOM_EXIT_STUBS
 /* If instr is not an exit cti, does nothing.  
  * If instr is an exit cti, sets stub to be custom exit stub code
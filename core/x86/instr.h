@@ -1675,9 +1675,13 @@ enum {
                                    INSTR_NI_SYSCALL),
 
     /* instr_t-internal flags (not shared with LINK_) */
+    /* Placed out of line after the final exit cti (see instr_set_cold()).
+     * The LINK_ flags from here up to 0x8000 are never set on an instr.
+     */
+    INSTR_COLD                  = 0x00008000,
     INSTR_OPERANDS_VALID        = 0x00010000,
     /* meta-flag */
-    INSTR_FIRST_NON_LINK_SHARED_FLAG = INSTR_OPERANDS_VALID,
+    INSTR_FIRST_NON_LINK_SHARED_FLAG = INSTR_COLD,
     INSTR_EFLAGS_VALID          = 0x00020000,
     INSTR_EFLAGS_6_VALID        = 0x00040000,
     INSTR_RAW_BITS_VALID        = 0x00080000,
@@ -2051,6 +2055,35 @@ DR_API
 void
 instr_set_ok_to_emit(instr_t *instr, bool val);
 
+DR_API
+/**
+ * Return true iff \p instr has been marked as cold code via
+ * instr_set_cold().
+ */
+bool
+instr_is_cold(instr_t *instr);
+
+DR_API
+/**
+ * Marks \p instr as cold if \p val is true.  Cold instructions must be
+ * meta-instructions (see instr_set_ok_to_mangle()).  When a basic block or
+ * trace is emitted, each run of consecutive cold instructions is moved out
+ * of line, after the fragment's final exit, so that rarely executed
+ * instrumentation such as error paths or guarded clean calls does not
+ * dilute the hot path.  Control flow is preserved: if the instruction
+ * before a run can fall through into it, a jump to the run is left in its
+ * place, and if the run's last instruction can fall through, a jump back
+ * is appended.  Cold runs are therefore best entered only via branches,
+ * with the hot path jumping over them.  Marking is a placement hint only:
+ * fragments that cannot host out-of-line code (e.g., coarse-grain
+ * fragments) keep cold instructions inline.
+ *
+ * To mark a clean call as cold, mark each instruction inserted between
+ * the surrounding instructions after calling dr_insert_clean_call().
+ */
+void
+instr_set_cold(instr_t *instr, bool val);
+
 #ifdef CUSTOM_EXIT_STUBS
 DR_API
 /**
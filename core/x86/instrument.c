@@ -204,6 +204,7 @@ static callback_list_t trace_callbacks = {0,};
 static callback_list_t end_trace_callbacks = {0,};
 #endif
 static callback_list_t fragdel_callbacks = {0,};
+static callback_list_t fragdel_batch_callbacks = {0,};
 static callback_list_t restore_state_callbacks = {0,};
 static callback_list_t restore_state_ex_callbacks = {0,};
 static callback_list_t module_load_callbacks = {0,};
@@ -230,6 +231,20 @@ static callback_list_t persist_rw_callbacks = {0,};
 static callback_list_t resurrect_rw_callbacks = {0,};
 static callback_list_t persist_patch_callbacks = {0,};
 
+/* Per-thread buffer for the batched fragment deletion event.  Nested brackets
+ * each record their range; tags are delivered whenever the range changes.
+ */
+#define DELETE_BATCH_MAX_TAGS 512
+#define DELETE_BATCH_MAX_DEPTH 4
+typedef struct _delete_batch_t {
+    dcontext_t *dcontext; /* owner of buffered tags, NULL for shared */
+    uint num;
+    uint depth;
+    app_pc start[DELETE_BATCH_MAX_DEPTH];
+    app_pc end[DELETE_BATCH_MAX_DEPTH];
+    void *tags[DELETE_BATCH_MAX_TAGS];
+} delete_batch_t;
+
 /* An array of client libraries.  We use a static array instead of a
  * heap-allocated list so we can load the client libs before
  * initializing DR's heap.
@@ -631,6 +646,7 @@ void free_all_callback_lists()
     free_callback_list(&end_trace_callbacks);
 #endif
     free_callback_list(&fragdel_callbacks);
+    free_callback_list(&fragdel_batch_callbacks);
     free_callback_list(&restore_state_callbacks);
     free_callback_list(&restore_state_ex_callbacks);
     free_callback_list(&module_load_callbacks);
@@ -807,6 +823,38 @@ dr_unregister_trace_event(dr_emit_flags_t (*func)
     return remove_callback(&trace_callbacks, (void (*)(void))func, true);
 }
 
+DR_API
+uint
+dr_trace_head_count(void *drcontext)
+{
+    dcontext_t *dcontext = (dcontext_t *) drcontext;
+    CLIENT_ASSERT(drcontext != NULL && drcontext != GLOBAL_DCONTEXT,
+                  "dr_trace_head_count: drcontext is invalid");
+    return trace_head_count(dcontext);
+}
+
+DR_API
+uint
+dr_trace_component_tags(void *drcontext, void **tags, uint max_tags)
+{
+    dcontext_t *dcontext = (dcontext_t *) drcontext;
+    CLIENT_ASSERT(drcontext != NULL && drcontext != GLOBAL_DCONTEXT,
+                  "dr_trace_component_tags: drcontext is invalid");
+    return trace_component_tags(dcontext, (app_pc *) tags, max_tags);
+}
+
+DR_API
+bool
+dr_trace_component_exit_count(void *drcontext, uint index, void *target,
+                              uint64 *count)
+{
+    dcontext_t *dcontext = (dcontext_t *) drcontext;
+    CLIENT_ASSERT(drcontext != NULL && drcontext != GLOBAL_DCONTEXT,
+                  "dr_trace_component_exit_count: drcontext is invalid");
+    CLIENT_ASSERT(count != NULL, "dr_trace_component_exit_count: count is NULL");
+    return trace_component_exit_count(dcontext, index, (app_pc) target, count);
+}
+
 #ifdef CUSTOM_TRACES
 void
 dr_register_end_trace_event(dr_custom_trace_action_t (*func)
@@ -845,6 +893,26 @@ dr_unregister_delete_event(void (*func)(void *drcontext, void *tag))
     return remove_callback(&fragdel_callbacks, (void (*)(void))func, true);
 }
 
+void
+dr_register_delete_batch_event(void (*func)(void *drcontext, void **tags, uint num_tags,
+                                            app_pc start, app_pc end))
+{
+    if (!INTERNAL_OPTION(code_api)) {
+        CLIENT_ASSERT(false, "asking for delete event when code_api is disabled");
+        return;
+    }
+
+    add_callback(&fragdel_batch_callbacks, (void (*)(void))func, true);
+}
+
+bool
+dr_unregister_delete_batch_event(void (*func)(void *drcontext, void **tags,
+                                              uint num_tags, app_pc start,
+                                              app_pc end))
+{
+    return remove_callback(&fragdel_batch_callbacks, (void (*)(void))func, true);
+}
+
 void
 dr_register_restore_state_event(void (*func)
                                 (void *drcontext, void *tag, dr_mcontext_t *mcontext,
@@ -1235,6 +1303,12 @@ instrument_thread_exit(dcontext_t *dcontext)
         flush = next_flush;
     }        
 
+    if (dcontext->client_data->delete_batch != NULL) {
+        ASSERT(dcontext->client_data->delete_batch->depth == 0);
+        HEAP_TYPE_FREE(dcontext, dcontext->client_data->delete_batch, delete_batch_t,
+                       ACCT_CLIENT, UNPROTECTED);
+    }
+
     HEAP_TYPE_FREE(dcontext, dcontext->client_data, client_data_t,
                    ACCT_OTHER, UNPROTECTED);
     dcontext->client_data = NULL; /* for mutex_wait_contended_lock() */
@@ -1257,7 +1331,7 @@ dr_trace_hook_exists(void)
 bool
 dr_fragment_deleted_hook_exists(void)
 {
-    return (fragdel_callbacks.num > 0);
+    return (fragdel_callbacks.num > 0 || fragdel_batch_callbacks.num > 0);
 }
 
 bool
@@ -1496,6 +1570,84 @@ instrument_trace(dcontext_t *dcontext, app_pc tag, instrlist_t *trace,
     return ret;
 }
 
+/* Delivers the buffered tags, if any, to the batched deletion event */
+static void
+delete_batch_deliver(delete_batch_t *batch)
+{
+    ASSERT(batch->depth > 0);
+    if (batch->num == 0)
+        return;
+    call_all(fragdel_batch_callbacks, int (*)(void *, void **, uint, app_pc, app_pc),
+             (void *)batch->dcontext, batch->tags, batch->num,
+             batch->start[batch->depth-1], batch->end[batch->depth-1]);
+    batch->num = 0;
+}
+
+/* Returns the calling thread's deletion batch if one is open, else NULL */
+static delete_batch_t *
+delete_batch_get(void)
+{
+    dcontext_t *dcontext = get_thread_private_dcontext();
+    if (dcontext == NULL || dcontext->client_data == NULL ||
+        dcontext->client_data->delete_batch == NULL ||
+        dcontext->client_data->delete_batch->depth == 0)
+        return NULL;
+    return dcontext->client_data->delete_batch;
+}
+
+/* Rather than raising the batched deletion event once per fragment, callers
+ * that delete many fragments at once (flushes and resets) bracket the deletions
+ * with these routines and all tags deleted by the calling thread in between
+ * are delivered together, along with the region [start, end) being deleted.
+ * Brackets may nest, as when a reset processes a pending flush.
+ */
+void
+instrument_fragment_delete_batch_start(app_pc start, app_pc end)
+{
+    dcontext_t *dcontext;
+    delete_batch_t *batch;
+    if (fragdel_batch_callbacks.num == 0)
+        return;
+    dcontext = get_thread_private_dcontext();
+    /* at exit there may be no thread context: we fall back to single delivery */
+    if (dcontext == NULL || dcontext->client_data == NULL)
+        return;
+    batch = dcontext->client_data->delete_batch;
+    if (batch == NULL) {
+        batch = HEAP_TYPE_ALLOC(dcontext, delete_batch_t, ACCT_CLIENT, UNPROTECTED);
+        batch->num = 0;
+        batch->depth = 0;
+        dcontext->client_data->delete_batch = batch;
+    }
+    ASSERT(batch->depth < DELETE_BATCH_MAX_DEPTH);
+    if (batch->depth >= DELETE_BATCH_MAX_DEPTH) {
+        /* should not happen: just keep accumulating into the innermost range */
+        batch->depth++;
+        return;
+    }
+    if (batch->depth > 0)
+        delete_batch_deliver(batch);
+    batch->start[batch->depth] = start;
+    batch->end[batch->depth] = end;
+    batch->depth++;
+}
+
+void
+instrument_fragment_delete_batch_end(void)
+{
+    dcontext_t *dcontext = get_thread_private_dcontext();
+    delete_batch_t *batch;
+    if (dcontext == NULL || dcontext->client_data == NULL)
+        return;
+    batch = dcontext->client_data->delete_batch;
+    /* the callback may have been registered mid-batch */
+    if (batch == NULL || batch->depth == 0)
+        return;
+    if (batch->depth <= DELETE_BATCH_MAX_DEPTH)
+        delete_batch_deliver(batch);
+    batch->depth--;
+}
+
 /* Notify user when a fragment is deleted from the cache
  * FIXME PR 242544: how does user know whether this is a shadowed copy or the
  * real thing?  The user might free memory that shouldn't be freed!
@@ -1503,7 +1655,7 @@ instrument_trace(dcontext_t *dcontext, app_pc tag, instrlist_t *trace,
 void
 instrument_fragment_deleted(dcontext_t *dcontext, app_pc tag, uint flags)
 {
-    if (fragdel_callbacks.num == 0)
+    if (fragdel_callbacks.num == 0 && fragdel_batch_callbacks.num == 0)
         return;
 
 #ifdef WINDOWS
@@ -1523,6 +1675,24 @@ instrument_fragment_deleted(dcontext_t *dcontext, app_pc tag, uint flags)
 
     call_all(fragdel_callbacks, int (*)(void *, void *),
              (void *)dcontext, (void *)tag);
+
+    if (fragdel_batch_callbacks.num > 0) {
+        delete_batch_t *batch = delete_batch_get();
+        if (batch == NULL) {
+            void *tags[1];
+            tags[0] = (void *) tag;
+            call_all(fragdel_batch_callbacks,
+                     int (*)(void *, void **, uint, app_pc, app_pc),
+                     (void *)dcontext, tags, 1, NULL, NULL);
+        } else {
+            /* a batch holds tags for a single drcontext */
+            if (batch->num == DELETE_BATCH_MAX_TAGS ||
+                (batch->num > 0 && batch->dcontext != dcontext))
+                delete_batch_deliver(batch);
+            batch->dcontext = dcontext;
+            batch->tags[batch->num++] = (void *) tag;
+        }
+    }
 }
 
 bool
@@ -2959,6 +3129,15 @@ dr_rwlock_create(void)
     return rwlock;
 }
 
+DR_API
+void *
+dr_rwlock_create_scalable(void)
+{
+    void *rwlock = dr_rwlock_create();
+    rwlock_make_scalable((read_write_lock_t *)rwlock);
+    return rwlock;
+}
+
 DR_API
 void
 dr_rwlock_destroy(void *rwlock)
@@ -4458,6 +4637,101 @@ dr_insert_clean_call(void *drcontext, instrlist_t *ilist, instr_t *where,
     va_end(ap);
 }
 
+/* Restores the flags and xax saved by the predicate in dr_insert_clean_call_if() */
+static void
+insert_clean_call_if_restore(dcontext_t *dcontext, instrlist_t *ilist, instr_t *where)
+{
+    dr_restore_arith_flags_from_xax(dcontext, ilist, where);
+    MINSERT(ilist, where, instr_create_restore_from_tls
+            (dcontext, REG_XAX, TLS_XAX_SLOT));
+}
+
+DR_API
+void
+dr_insert_clean_call_if(void *drcontext, instrlist_t *ilist, instr_t *where,
+                        opnd_t check, ptr_int_t value, int jcc_opcode,
+                        void *callee, dr_cleancall_save_t save_flags,
+                        uint num_args, ...)
+{
+    dcontext_t *dcontext = (dcontext_t *) drcontext;
+    bool save_aflags = !TEST(DR_CLEANCALL_NOSAVE_FLAGS, save_flags);
+    opnd_size_t size = opnd_get_size(check);
+    instr_t *call_label, *done_label;
+    instr_t *in;
+    opnd_t immed;
+    va_list ap;
+    CLIENT_ASSERT(drcontext != NULL, "dr_insert_clean_call_if: drcontext cannot be NULL");
+    CLIENT_ASSERT(drcontext != GLOBAL_DCONTEXT,
+                  "dr_insert_clean_call_if: drcontext is invalid");
+    CLIENT_ASSERT(opnd_is_reg(check) || opnd_is_memory_reference(check),
+                  "dr_insert_clean_call_if: check must be a register or memory");
+    CLIENT_ASSERT(!opnd_uses_reg(check, REG_XAX) && !opnd_uses_reg(check, REG_XSP),
+                  "dr_insert_clean_call_if: check cannot use xax or xsp");
+    CLIENT_ASSERT(jcc_opcode >= OP_jo && jcc_opcode <= OP_jnle,
+                  "dr_insert_clean_call_if: invalid jcc opcode");
+    CLIENT_ASSERT(size == OPSZ_1 || size == OPSZ_2 || size == OPSZ_4
+                  IF_X64(|| size == OPSZ_8),
+                  "dr_insert_clean_call_if: invalid check size");
+    if (size == OPSZ_1) {
+        CLIENT_ASSERT(CHECK_TRUNCATE_TYPE_sbyte(value) ||
+                      CHECK_TRUNCATE_TYPE_byte(value),
+                      "dr_insert_clean_call_if: value too large");
+        immed = OPND_CREATE_INT8(value);
+    } else if (CHECK_TRUNCATE_TYPE_sbyte(value)) {
+        /* the sign-extended imm8 form is shortest for all larger sizes */
+        immed = OPND_CREATE_INT8(value);
+    } else if (size == OPSZ_2) {
+        CLIENT_ASSERT(CHECK_TRUNCATE_TYPE_short(value) ||
+                      CHECK_TRUNCATE_TYPE_ushort(value),
+                      "dr_insert_clean_call_if: value too large");
+        immed = OPND_CREATE_INT16(value);
+    } else {
+        CLIENT_ASSERT(CHECK_TRUNCATE_TYPE_int(value) ||
+                      (size == OPSZ_4 && CHECK_TRUNCATE_TYPE_uint(value)),
+                      "dr_insert_clean_call_if: value too large");
+        immed = OPND_CREATE_INT32(value);
+    }
+    call_label = INSTR_CREATE_label(dcontext);
+    done_label = INSTR_CREATE_label(dcontext);
+
+    /* Hot path:
+     *   mov xax -> tls           (unless NOSAVE_FLAGS)
+     *   lahf; seto al
+     *   cmp check, value
+     *   jcc call_label
+     *   add al, 0x7f; sahf
+     *   mov tls -> xax
+     *   jmp done_label
+     * Cold path, placed out of line by mangle_cold_instrs() when possible,
+     * which also drops the jmp above:
+     * call_label:
+     *   add al, 0x7f; sahf
+     *   mov tls -> xax
+     *   <clean call>
+     * done_label:
+     */
+    if (save_aflags) {
+        MINSERT(ilist, where, instr_create_save_to_tls(dcontext, REG_XAX, TLS_XAX_SLOT));
+        dr_save_arith_flags_to_xax(drcontext, ilist, where);
+    }
+    MINSERT(ilist, where, INSTR_CREATE_cmp(dcontext, check, immed));
+    MINSERT(ilist, where, INSTR_CREATE_jcc(dcontext, jcc_opcode,
+                                           opnd_create_instr(call_label)));
+    if (save_aflags)
+        insert_clean_call_if_restore(dcontext, ilist, where);
+    MINSERT(ilist, where, INSTR_CREATE_jmp(dcontext, opnd_create_instr(done_label)));
+    MINSERT(ilist, where, call_label);
+    if (save_aflags)
+        insert_clean_call_if_restore(dcontext, ilist, where);
+    va_start(ap, num_args);
+    dr_insert_clean_call_ex_varg(drcontext, ilist, where, callee, save_flags,
+                                 num_args, ap);
+    va_end(ap);
+    for (in = call_label; in != where; in = instr_get_next(in))
+        instr_set_cold(in, true);
+    MINSERT(ilist, where, done_label);
+}
+
 /* Utility routine for inserting a clean call to an instrumentation routine
  * Returns the size of the data stored on the DR stack (in case the caller
  * needs to align the stack pointer).  XSP and XAX are modified by this call.
@@ -5713,6 +5987,58 @@ dr_bb_exists_at(void *drcontext, void *tag)
     return false;
 }
 
+DR_API
+bool
+dr_prepopulate_cache(app_pc *tags, size_t tags_count)
+{
+    dcontext_t *dcontext = get_thread_private_dcontext();
+    fragment_t *f;
+    fragment_t coarse_f;
+    bool waslinking, res = true;
+    size_t i;
+    uint prot;
+    CLIENT_ASSERT(!standalone_library, "API not supported in standalone mode");
+    CLIENT_ASSERT(tags != NULL || tags_count == 0,
+                  "dr_prepopulate_cache: tags cannot be NULL");
+    if (dcontext == NULL || RUNNING_WITHOUT_CODE_CACHE())
+        return false;
+    /* We cannot be called from inside bb building (e.g., from the bb event). */
+    CLIENT_ASSERT(!USE_BB_BUILDING_LOCK() || !OWN_MUTEX(&bb_building_lock),
+                  "dr_prepopulate_cache cannot be called while building a block");
+    waslinking = is_couldbelinking(dcontext);
+    if (!waslinking)
+        enter_couldbelinking(dcontext, NULL, false);
+    for (i = 0; i < tags_count; i++) {
+        /* Unreadable or non-executable tags are skipped rather than faulting
+         * on the client's behalf: there is no app context to deliver a fault
+         * to, and a block from data the app never executes would be useless.
+         */
+        if (!is_readable_without_exception(tags[i], 1) ||
+            !get_memory_info(tags[i], NULL, NULL, &prot) ||
+            !TEST(MEMPROT_EXEC, prot)) {
+            res = false;
+            continue;
+        }
+        /* Same lookup-under-lock-then-build sequence as dispatch(). */
+        SHARED_BB_MUTEX(lock);
+        f = fragment_lookup_fine_and_coarse(dcontext, tags[i], &coarse_f, NULL);
+        if (f == NULL) {
+            SELF_PROTECT_LOCAL(dcontext, WRITABLE);
+            f = build_basic_block_fragment(dcontext, tags[i], 0, true/*link*/,
+                                           true/*visible*/, false/*!for_trace*/, NULL);
+            SELF_PROTECT_LOCAL(dcontext, READONLY);
+            if (f == NULL)
+                res = false;
+            else
+                STATS_INC(num_bbs_prepopulated);
+        }
+        SHARED_BB_MUTEX(unlock);
+    }
+    if (!waslinking)
+        enter_nolinking(dcontext, NULL, false);
+    return res;
+}
+
 DR_API 
 /* Looks up the fragment associated with the application pc tag.
  * If not found, returns 0.
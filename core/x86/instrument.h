@@ -442,6 +442,11 @@ DR_API
  * if a new trace containing that code is created again after
  * deletion.  The deletion event (#dr_register_delete_event()) will be
  * raised at deletion time.
+ *
+ * \note The trace callback can query the profile data that led to
+ * the trace's creation with dr_trace_head_count(),
+ * dr_trace_component_tags(), and dr_trace_component_exit_count(),
+ * for example to place counters only on frequently taken exits.
  */
 void
 dr_register_trace_event(dr_emit_flags_t (*func)
@@ -464,6 +469,63 @@ dr_unregister_trace_event(dr_emit_flags_t (*func)
                           (void *drcontext, void *tag, instrlist_t *trace,
                            bool translating));
 
+DR_API
+/**
+ * Returns the number of times the current thread reached the head of
+ * the trace currently being passed to the trace event callback before
+ * selecting the trace.  This is at least the trace threshold, and is
+ * larger when an earlier trace from the same head was deleted, or
+ * when the head stayed hot while the thread could not build a trace
+ * from it, e.g., when another thread was building the same trace or
+ * the thread had reached -private_trace_budget.
+ * May only be called from a trace event callback
+ * (#dr_register_trace_event()); returns 0 when called at any other time,
+ * including when the callback is invoked with \p translating set.
+ */
+uint
+dr_trace_head_count(void *drcontext);
+
+DR_API
+/**
+ * Returns the number of basic blocks that make up the trace currently
+ * being passed to the trace event callback.  If \p tags is non-NULL,
+ * stores the tags of up to \p max_tags of those blocks into \p tags,
+ * in the order in which they appear in the trace.  The first tag is
+ * the trace head.
+ * May only be called from a trace event callback
+ * (#dr_register_trace_event()); returns 0 when called at any other time,
+ * including when the callback is invoked with \p translating set.
+ */
+uint
+dr_trace_component_tags(void *drcontext, void **tags, uint max_tags);
+
+DR_API
+/**
+ * Stores into \p count the number of times the \p index-th basic
+ * block of the trace currently being passed to the trace event
+ * callback took the exit named by \p target while the trace was
+ * selected.  \p index is the block's position in the list returned
+ * by dr_trace_component_tags().  \p target is the application target
+ * address of a direct exit, or NULL for the block's indirect exit.
+ *
+ * Each block runs once during selection, so the count is 1 for the
+ * exit that led to the next block (or, for the last block, out of the
+ * trace) and 0 for the others.  The last block's count is 0 for every
+ * exit if the trace ended before that block ran, e.g., at a system
+ * call.  When DynamoRIO is built with link count profiling and run
+ * with -prof_counts, the count also includes the times the exit was
+ * taken while the block executed on its own, before the trace was
+ * built; coarse-grain blocks have no such counts.
+ *
+ * Returns false if \p index is out of range.
+ * May only be called from a trace event callback
+ * (#dr_register_trace_event()); returns false at any other time,
+ * including when the callback is invoked with \p translating set.
+ */
+bool
+dr_trace_component_exit_count(void *drcontext, uint index, void *target,
+                              uint64 *count);
+
 #ifdef CUSTOM_TRACES
 /* DR_API EXPORT BEGIN */
 
@@ -545,6 +607,50 @@ DR_API
 bool
 dr_unregister_delete_event(void (*func)(void *drcontext, void *tag));
 
+DR_API
+/**
+ * Registers a callback function for the batched fragment deletion event.
+ * This is an alternative to dr_register_delete_event() for clients whose
+ * per-fragment deletion processing (typically a lock acquisition plus a
+ * table removal) dominates the cost of large flushes and resets.  Rather
+ * than one call per fragment, DR calls \p func with an array of the \p
+ * num_tags tags deleted together, along with the application address range
+ * [\p start, \p end) whose flush caused the deletion.  The same caveats
+ * about deletion timing as for dr_register_delete_event() apply.
+ *
+ * Fragments deleted by a region flush are delivered in one or more calls
+ * per flushed region, each with that region's bounds; a client can thus
+ * use a range removal such as hashtable_remove_range() rather than removing
+ * the tags one at a time.  Fragments deleted by a reset or at exit are
+ * delivered with \p start equal to NULL and \p end equal to the maximum
+ * address.  Fragments deleted for other reasons (e.g., an individual
+ * replacement, or code cache capacity) are delivered with both \p start
+ * and \p end equal to NULL, and in some cases singly.
+ *
+ * \note A fragment's tag can lie outside of [\p start, \p end) when the
+ * fragment's code spans multiple regions.  The \p tags array is
+ * authoritative; the range is provided to enable bulk operations.
+ *
+ * \note The \p tags array is only valid for the duration of the callback.
+ *
+ * \note drcontext may be NULL when thread-shared fragments are being
+ * deleted, as with dr_register_delete_event().
+ */
+void
+dr_register_delete_batch_event(void (*func)(void *drcontext, void **tags, uint num_tags,
+                                            app_pc start, app_pc end));
+
+DR_API
+/**
+ * Unregister a callback function for the batched fragment deletion event.
+ * \return true if unregistration is successful and false if it is not
+ * (e.g., \p func was not registered).
+ */
+bool
+dr_unregister_delete_batch_event(void (*func)(void *drcontext, void **tags,
+                                              uint num_tags, app_pc start,
+                                              app_pc end));
+
 DR_API
 /**
  * Registers a callback function for the machine state restoration event.
@@ -1460,6 +1566,9 @@ dr_custom_trace_action_t instrument_end_trace(dcontext_t *dcontext, app_pc trace
                                            app_pc next_tag);
 #endif
 void instrument_fragment_deleted(dcontext_t *dcontext, app_pc tag, uint flags);
+/* Brackets a series of fragment deletions for the batched deletion event */
+void instrument_fragment_delete_batch_start(app_pc start, app_pc end);
+void instrument_fragment_delete_batch_end(void);
 bool instrument_restore_state(dcontext_t *dcontext, bool restore_memory,
                               dr_restore_state_info_t *info);
 
@@ -2308,6 +2417,17 @@ DR_API
 void *
 dr_rwlock_create(void);
 
+DR_API
+/**
+ * Creates and initializes a read-write lock like dr_rwlock_create(), but
+ * optimized for locks that are acquired for reading far more often than for
+ * writing.  Readers on different processors do not contend on a shared
+ * counter, while acquiring the lock for writing becomes more expensive.
+ * Delete the lock with dr_rwlock_destroy().
+ */
+void *
+dr_rwlock_create_scalable(void);
+
 DR_API
 /** Deletes \p rwlock. */
 void
@@ -4173,6 +4293,43 @@ dr_insert_clean_call_ex(void *drcontext, instrlist_t *ilist, instr_t *where,
                         void *callee, dr_cleancall_save_t save_flags,
                         uint num_args, ...);
 
+DR_API
+/**
+ * Inserts into \p ilist prior to \p where meta-instruction(s) that compare
+ * \p check against the immediate \p value and perform a clean call to \p
+ * callee, exactly as dr_insert_clean_call_ex() would with \p save_flags, \p
+ * num_args, and the trailing arguments, only when the condition holds.  The
+ * condition is the conditional branch opcode \p jcc_opcode (#OP_jz, #OP_jnz,
+ * #OP_jb, #OP_jl, etc.) applied to the flags produced by "cmp check, value":
+ * e.g., #OP_jz calls when \p check equals \p value and #OP_jb calls when
+ * \p check is unsigned-below \p value.
+ *
+ * This is intended for the common "check, then rarely call" pattern, such
+ * as calling a routine only when a buffer pointer in a TLS slot reaches
+ * its end or a sampling counter reaches zero.  The inline check is laid out
+ * so that the not-taken case falls through to the instruction after the
+ * check, while the clean call is marked cold (see instr_set_cold()) and so
+ * is normally emitted out of line, after the fragment's final exit.  This
+ * does not keep the block from becoming part of a trace: there the call is
+ * placed after the trace's final exit.
+ *
+ * The arithmetic flags are preserved around the check using DR_REG_XAX
+ * and the same thread-local spill slot that the clean call itself uses,
+ * unless #DR_CLEANCALL_NOSAVE_FLAGS is passed in \p save_flags, in which
+ * case the flags must be dead at \p where.
+ *
+ * \p check must be a register or memory operand of size 1, 2, 4, or (in
+ * 64-bit mode) 8 bytes that does not reference DR_REG_XAX or DR_REG_XSP
+ * and cannot fault: DR does not translate a fault in the check itself.
+ * \p value must fit in a sign-extended 32-bit immediate (or in the operand
+ * size if smaller).
+ */
+void
+dr_insert_clean_call_if(void *drcontext, instrlist_t *ilist, instr_t *where,
+                        opnd_t check, ptr_int_t value, int jcc_opcode,
+                        void *callee, dr_cleancall_save_t save_flags,
+                        uint num_args, ...);
+
 DR_API
 /**
  * Inserts into \p ilist prior to \p where meta-instruction(s) to set
@@ -4716,6 +4873,30 @@ DR_API
 bool
 dr_bb_exists_at(void *drcontext, void *tag);
 
+DR_API
+/**
+ * Builds basic blocks for each of the \p tags_count application addresses in
+ * \p tags that are not already present in the code cache, invoking the basic
+ * block event (see dr_register_bb_event()) for each one just as though the
+ * application had executed it.  The blocks are linked to any existing
+ * fragments.  Must be called from a client event on an application thread;
+ * it may not be called from the basic block or trace events.
+ *
+ * A client can use this to avoid the warmup cost of code it knows will be
+ * executed, for example from a pre-fork system call event in a fork server,
+ * in which case each child inherits the populated shared cache (see also the
+ * \ref op_fork_skip "-fork_skip_thread_cleanup" runtime option).
+ *
+ * Each tag must point at the start of valid application code: building a
+ * block from a mid-instruction address produces a block that will never be
+ * reached.  Addresses that are unreadable or not in executable memory are
+ * skipped.
+ *
+ * Returns true if every tag is present in the cache upon return.
+ */
+bool
+dr_prepopulate_cache(app_pc *tags, size_t tags_count);
+
 DR_API 
 /**
  * Looks up the fragment with tag \p tag.
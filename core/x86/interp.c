@@ -4728,12 +4728,13 @@ recreate_fragment_ilist(dcontext_t *dcontext, byte *pc,
             }
             if (mangle_at_end)
                 md.blk_info[i].info = t->bbs[i];
-            last = instrlist_last(bb);
+            /* skip any cold code mangle placed after the final exit */
+            last = final_hot_instr(bb);
             ASSERT(last != NULL);
 #ifdef CLIENT_INTERFACE
             if (mangle_at_end) {
                 md.blk_info[i].vmlist = vmlist;
-                md.blk_info[i].final_cti = instr_is_cti(instrlist_last(bb));
+                md.blk_info[i].final_cti = instr_is_cti(last);
             }
 #endif
 
@@ -4801,7 +4802,6 @@ recreate_fragment_ilist(dcontext_t *dcontext, byte *pc,
                 }
             } /* else we mangled one bb at a time up above */
 
-#ifdef INTERNAL
             /* we only optimize traces */
             if (dynamo_options.optimize) {
                 /* re-apply all optimizations to ilist
@@ -4813,13 +4813,12 @@ recreate_fragment_ilist(dcontext_t *dcontext, byte *pc,
 # ifdef SIDELINE
                 if (dynamo_options.sideline) {
                     if (!TEST(FRAG_DO_NOT_SIDELINE, f->flags))
-                        optimize_trace(dcontext, f->tag, ilist);
+                        optimize_trace(dcontext, f->tag, ilist, true/*recreating*/);
                     /* else, never optimized */
                 } else
 # endif
-                    optimize_trace(dcontext, f->tag, ilist);
+                    optimize_trace(dcontext, f->tag, ilist, true/*recreating*/);
             }
-#endif
 
             /* FIXME: case 4718 append_trace_speculate_last_ibl(true)
              * should be called as well 
@@ -5750,7 +5749,8 @@ append_trace_speculate_last_ibl(dcontext_t *dcontext, instrlist_t *trace,
     int added_size = 0;
     ibl_type_t ibl_type;
 
-    instr_t *inst = instrlist_last(trace); /* currently only relevant to last CTI */
+    /* currently only relevant to last CTI, which any cold code follows */
+    instr_t *inst = final_hot_instr(trace);
     instr_t *where = inst;         /* preinsert before last CTI */
 
     instr_t *next = instr_get_next(inst);
@@ -5906,7 +5906,8 @@ append_ib_trace_last_ibl_exit_stat(dcontext_t *dcontext, instrlist_t *trace,
     int added_size = 0;
     ibl_type_t ibl_type;
 
-    instr_t *inst = instrlist_last(trace); /* currently only relevant to last CTI */
+    /* currently only relevant to last CTI, which any cold code follows */
+    instr_t *inst = final_hot_instr(trace);
     instr_t *where = inst;         /* preinsert before exit CTI */
 
     DEBUG_DECLARE(bool ok;)
@@ -5972,6 +5973,39 @@ append_ib_trace_last_ibl_exit_stat(dcontext_t *dcontext, instrlist_t *trace,
 }
 #endif /* HASHTABLE_STATISTICS */
 
+/* The cold runs of earlier blocks, kept in cold (see extend_trace()), jump
+ * back into the trace.  If fixup_last_cti() just deleted the instr one of them
+ * returns to, that return point was in the unused tail of the block, so we
+ * send it to resume, which the caller appends to mark where the next block
+ * starts.  resume must be allocated before the deletion, as we only compare
+ * against the pointers of the deleted instrs.
+ */
+static void
+retarget_cold_returns(dcontext_t *dcontext, instrlist_t *trace, instrlist_t *cold,
+                      instr_t *resume)
+{
+    instr_t *in, *tgt, *live;
+    for (in = instrlist_first(cold); in != NULL; in = instr_get_next(in)) {
+        if (!instr_opcode_valid(in) || !instr_is_cti(in) ||
+            !opnd_is_instr(instr_get_target(in)))
+            continue;
+        tgt = opnd_get_instr(instr_get_target(in));
+        for (live = instrlist_first(trace); live != NULL && live != tgt;
+             live = instr_get_next(live))
+            ; /* nothing */
+        if (live == NULL) {
+            for (live = instrlist_first(cold); live != NULL && live != tgt;
+                 live = instr_get_next(live))
+                ; /* nothing */
+        }
+        if (live == NULL) {
+            LOG(THREAD, LOG_MONITOR, 4,
+                "retarget_cold_returns: return point of cold run was deleted\n");
+            instr_set_target(in, opnd_create_instr(resume));
+        }
+    }
+}
+
 /* Add the fragment f to the end of the trace instrlist_t kept in dcontext
  *
  * Note that recreate_fragment_ilist() is making assumptions about its operation
@@ -5987,6 +6021,7 @@ extend_trace(dcontext_t *dcontext, fragment_t *f, linkstub_t *prev_l)
     fragment_t *prev_f = NULL;
     instrlist_t *trace = &(md->trace);
     instrlist_t *ilist;
+    instr_t *cold;
     uint size;
     uint prev_mangle_size = 0;
     uint num_exits_deleted = 0;
@@ -6018,9 +6053,16 @@ extend_trace(dcontext_t *dcontext, fragment_t *f, linkstub_t *prev_l)
 
     /* insert code to optimize last branch based on new fragment */
     if (instrlist_last(trace) != NULL) {
+        /* allocated up front: see retarget_cold_returns() */
+        instr_t *resume = (instrlist_first(&md->trace_cold) == NULL) ? NULL :
+            INSTR_CREATE_label(dcontext);
         prev_mangle_size = fixup_last_cti(dcontext, trace, f->tag, f->flags,
                                           md->trace_flags, prev_f, prev_l, false,
                                           &num_exits_deleted, NULL, NULL);
+        if (resume != NULL) {
+            retarget_cold_returns(dcontext, trace, &md->trace_cold, resume);
+            instrlist_append(trace, resume);
+        }
     }
     
 #ifdef CUSTOM_TRACES_RET_REMOVAL
@@ -6048,6 +6090,11 @@ extend_trace(dcontext_t *dcontext, fragment_t *f, linkstub_t *prev_l)
                             md->trace_flags, &new_exits_dir, &new_exits_indir);
 
     md->blk_info[md->num_blks].info.tag = f->tag;
+#ifdef CLIENT_INTERFACE
+    /* set once f runs; a trace that ends right after f never takes its exits */
+    md->blk_info[md->num_blks].exit_target = NULL;
+    md->blk_info[md->num_blks].exit_indirect = false;
+#endif
 #if defined(RETURN_AFTER_CALL) || defined(RCT_IND_BRANCH)
     if (md->num_blks > 0)
         md->blk_info[md->num_blks - 1].info.num_exits -= num_exits_deleted;
@@ -6060,6 +6107,23 @@ extend_trace(dcontext_t *dcontext, fragment_t *f, linkstub_t *prev_l)
      * fixup_last_cti etc. */
     process_nops_for_trace(dcontext, ilist, f->flags _IF_DEBUG(false/*!recreating*/));
 
+    /* Keep the cold runs mangle_cold_instrs() placed after f's final exit out
+     * of line, so that fixup_last_cti() and the next block see that exit as
+     * the end of the trace.  end_and_emit_trace() puts them after the
+     * trace's own final exit.
+     */
+    for (cold = instrlist_last(ilist); cold != NULL && !instr_is_exit_cti(cold);
+         cold = instr_get_prev(cold))
+        ; /* nothing */
+    if (cold != NULL) {
+        while (instr_get_next(cold) != NULL) {
+            instr_t *in = instr_get_next(cold);
+            instrlist_remove(ilist, in);
+            instr_set_cold(in, true);
+            instrlist_append(&md->trace_cold, in);
+        }
+    }
+
     DOLOG(5, LOG_MONITOR, {
         LOG(THREAD, LOG_MONITOR, 5, "post-trace-ibl-fixup, ilist is:\n");
         instrlist_disassemble(dcontext, f->tag, ilist, THREAD);
@@ -6538,16 +6602,21 @@ decode_fragment(dcontext_t *dcontext, fragment_t *f, byte *buf, /*IN/OUT*/uint *
             stop_pc = fragment_body_end_pc(dcontext, f);
             if (PAD_FRAGMENT_JMPS(f->flags) && stop_pc != raw_start_pc) {
                 /* We need to adjust stop_pc to account for any padding, only
-                 * way any code could get here is via client interface,
-                 * and there really is no nice way to distinguish it
-                 * from any padding we added.
+                 * way any code could get here is via client interface.
                  * PR 213005: we do not support decode_fragment() for bbs
                  * that have code added beyond the last exit cti (we turn
-                 * off FRAG_COARSE_GRAIN and set FRAG_CANNOT_BE_TRACE).
-                 * Sanity check, make sure it at least looks like there is no
-                 * code here */
-                ASSERT(IS_SET_TO_DEBUG(raw_start_pc, stop_pc - raw_start_pc)); 
-                stop_pc = raw_start_pc;
+                 * off FRAG_COARSE_GRAIN and set FRAG_CANNOT_BE_TRACE), except
+                 * for cold runs (mangle_cold_instrs()).  Those end in a jmp
+                 * back, never in the 1-byte padding instrs, so we stop at the
+                 * first pc past which there is only padding.
+                 */
+                cache_pc end_pc = raw_start_pc;
+                while (end_pc < stop_pc &&
+                       !IS_SET_TO_DEBUG(end_pc, stop_pc - end_pc)) {
+                    end_pc = decode_next_pc(dcontext, end_pc);
+                    ASSERT(end_pc != NULL); /* our own code! */
+                }
+                stop_pc = end_pc;
             }
         }
         IF_X64(ASSERT(TEST(FRAG_FAKE, f->flags) /* no copy made */ ||
@@ -3858,6 +3858,87 @@ mangle_seg_ref(dcontext_t *dcontext, instrlist_t *ilist, instr_t *instr,
 }
 #endif /* LINUX */
 
+/* Returns whether execution can continue from instr to the instr after it */
+static bool
+instr_falls_through(instr_t *instr)
+{
+    int opc = instr_get_opcode(instr);
+    return !(instr_is_ubr(instr) || instr_is_return(instr) || opc == OP_jmp_ind ||
+             opc == OP_jmp_far || opc == OP_jmp_far_ind);
+}
+
+static bool
+instr_is_branch_target(instrlist_t *ilist, instr_t *target)
+{
+    instr_t *in;
+    for (in = instrlist_first(ilist); in != NULL; in = instr_get_next(in)) {
+        if (instr_is_cti(in) && opnd_is_instr(instr_get_target(in)) &&
+            opnd_get_instr(instr_get_target(in)) == target)
+            return true;
+    }
+    return false;
+}
+
+/* Moves each run of cold instrs (see instr_set_cold()) out of line, after
+ * the final exit cti, so that the hot path stays contiguous.  If the run
+ * could be fallen into, a jmp to it is left in its place; if it could fall
+ * out, a jmp back is appended to it.  A meta jmp over the run is removed,
+ * as it would now target the very next instr.
+ */
+static void
+mangle_cold_instrs(dcontext_t *dcontext, instrlist_t *ilist, uint flags)
+{
+    instr_t *instr, *next_instr, *first, *last, *prev, *in;
+    instr_t *final_exit = instrlist_last(ilist);
+    /* coarse-grain fragments may elide their final jmp */
+    if (final_exit == NULL || TEST(FRAG_COARSE_GRAIN, flags) ||
+        !instr_is_exit_cti(final_exit) || !instr_is_ubr(final_exit))
+        return;
+    for (instr = instrlist_first(ilist); instr != final_exit; instr = next_instr) {
+        next_instr = instr_get_next(instr);
+        if (!instr_is_cold(instr))
+            continue;
+        first = instr;
+        last = instr;
+        while (true) {
+            CLIENT_ASSERT(!instr_ok_to_mangle(last), "only meta instrs can be cold");
+            if (instr_get_next(last) == final_exit || !instr_is_cold(instr_get_next(last)))
+                break;
+            last = instr_get_next(last);
+        }
+        next_instr = instr_get_next(last);
+        prev = instr_get_prev(first);
+        if (prev != NULL && instr_is_ubr(prev) && !instr_ok_to_mangle(prev) &&
+            opnd_is_instr(instr_get_target(prev)) &&
+            opnd_get_instr(instr_get_target(prev)) == next_instr &&
+            !instr_is_branch_target(ilist, prev)) {
+            instrlist_remove(ilist, prev);
+            instr_destroy(dcontext, prev);
+        } else if (prev == NULL || instr_falls_through(prev)) {
+            instr_t *label = INSTR_CREATE_label(dcontext);
+            instr_set_cold(label, true);
+            PRE(ilist, first, label);
+            PRE(ilist, label, INSTR_CREATE_jmp(dcontext, opnd_create_instr(label)));
+            first = label;
+        }
+        if (instr_falls_through(last)) {
+            instr_t *label = INSTR_CREATE_label(dcontext);
+            PRE(ilist, next_instr, label);
+            POST(ilist, last, INSTR_CREATE_jmp(dcontext, opnd_create_instr(label)));
+            last = instr_get_next(last);
+            instr_set_cold(last, true);
+        }
+        for (in = first; ; in = instr) {
+            instr = instr_get_next(in);
+            instrlist_remove(ilist, in);
+            instrlist_append(ilist, in);
+            if (in == last)
+                break;
+        }
+        STATS_INC(num_cold_runs_moved);
+    }
+}
+
 /* TOP-LEVEL MANGLE
  * This routine is responsible for mangling a fragment into the form
  * we'd like prior to placing it in the code cache
@@ -4064,6 +4145,11 @@ mangle(dcontext_t *dcontext, instrlist_t *ilist, uint flags,
     }
 #endif
 
+    /* After our own mangling so the jmps it adds look like client code
+     * to recreate_app_state().
+     */
+    mangle_cold_instrs(dcontext, ilist, flags);
+
     /* The following assertion should be guaranteed by fact that all
      * blocks end in some kind of branch, and the code above restores
      * the register state on a branch. */
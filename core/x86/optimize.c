@@ -39,10 +39,6 @@
  * (old offline optimization stuff is in mangle.c)
  */
 
-#include "../globals.h"   /* just to disable warning C4206 about an empty file */
-
-#ifdef INTERNAL /* around whole file */
-
 #include "../globals.h"
 #include "../instrlist.h"
 #include "arch.h"
@@ -74,14 +70,16 @@ static void constant_propagation(dcontext_t *dcontext, app_pc tag, instrlist_t *
 static void call_return_matching(dcontext_t *dcontext, app_pc tag, instrlist_t *trace);
 static void remove_unnecessary_zeroing(dcontext_t *dcontext, app_pc tag,
                                        instrlist_t *trace);
-static void stack_adjust_combiner(dcontext_t *dcontext, app_pc tag, instrlist_t *trace);
+static void stack_adjust_combiner(dcontext_t *dcontext, app_pc tag, instrlist_t *trace,
+                                  bool recreating);
 
 static void prefetch_optimize_trace(dcontext_t *dcontext,
                                     app_pc tag, instrlist_t *trace);
 void remove_redundant_loads(dcontext_t *dcontext, app_pc tag,
                             instrlist_t *trace);
 
-static void peephole_optimize(dcontext_t *dcontext, app_pc tag, instrlist_t *trace);
+static void peephole_optimize(dcontext_t *dcontext, app_pc tag, instrlist_t *trace,
+                              bool recreating);
 
 static void identify_for_loop(dcontext_t *dcontext,
                               app_pc tag, instrlist_t *trace);
@@ -127,12 +125,36 @@ void logtrace(dcontext_t *dcontext, uint level, instrlist_t *trace, const char *
 /****************************************************************************/
 /* master routine */
 
+/* Runs a pass if its option is on.  Passes that are not x64_ready still
+ * assume 32-bit immediates and displacements (un-truncation-checked casts of
+ * opnd_get_immed_int()), the 8 legacy registers, and 4-byte stack slots, so
+ * on x64 check_option_compatibility() turns their options off.
+ */
+#define RUN_PASS(option, x64_ready, call) do {                              \
+    if (dynamo_options.option) {                                            \
+        ASSERT(IF_X64_ELSE(x64_ready, true));                               \
+        call;                                                               \
+    }                                                                       \
+} while (0)
+#define RUN_INTERNAL_PASS(option, x64_ready, call) do {                     \
+    if (INTERNAL_OPTION(option)) {                                          \
+        ASSERT(IF_X64_ELSE(x64_ready, true));                               \
+        call;                                                               \
+    }                                                                       \
+} while (0)
+
+/* recreate_fragment_ilist() reruns the passes to translate a trace pc; only
+ * the first run, when the trace is built, should show up in the stats.
+ */
+#define OPT_RSTATS_INC(recreating, stat) do {  \
+    if (!(recreating))                          \
+        RSTATS_INC(stat);                       \
+} while (0)
+
 void 
-optimize_trace(dcontext_t *dcontext, app_pc tag, instrlist_t *trace)
+optimize_trace(dcontext_t *dcontext, app_pc tag, instrlist_t *trace, bool recreating)
 {
-    /* we have un-truncation-check 32-bit casts for opnd_get_immed_int(), for
-     * one thing, here and in loadtoconst.c */
-    IF_X64(ASSERT_NOT_IMPLEMENTED(false));
+    OPT_RSTATS_INC(recreating, num_traces_optimized);
 
     /* FIXME: this routine is of course not in its final form
      * we are still playing with different optimizations
@@ -152,59 +174,22 @@ optimize_trace(dcontext_t *dcontext, app_pc tag, instrlist_t *trace)
 
 #endif
 
-    if (dynamo_options.instr_counts) {
-        instr_counts(dcontext, tag, trace, true);
-    }
-
-    if (dynamo_options.call_return_matching) {
-        call_return_matching(dcontext, tag, trace);
-    }
-
-    if (dynamo_options.unroll_loops) {
-        unroll_loops(dcontext, tag, trace);
-    }
-
-    if (dynamo_options.vectorize) {
-        identify_for_loop(dcontext, tag, trace);
-    }
-
-    if (dynamo_options.prefetch) {
-        prefetch_optimize_trace(dcontext, tag, trace);
-    }
-
-    if (dynamo_options.rlr) {
-        remove_redundant_loads(dcontext, tag, trace);
-    }
-
-    if (dynamo_options.remove_unnecessary_zeroing) {
-        remove_unnecessary_zeroing(dcontext, tag, trace);
-    }
-
-    if (dynamo_options.constant_prop) {
-        constant_propagation(dcontext, tag, trace);
-    }
-
-    if (dynamo_options.remove_dead_code) {
-        remove_dead_code(dcontext, tag, trace);
-    }
-
-    if (dynamo_options.stack_adjust) {
-        stack_adjust_combiner(dcontext, tag, trace);
-    }
-
-    if (dynamo_options.peephole) {
-        peephole_optimize(dcontext, tag, trace);
-    }
-
+    RUN_PASS(instr_counts, true, instr_counts(dcontext, tag, trace, true));
+    RUN_PASS(call_return_matching, false, call_return_matching(dcontext, tag, trace));
+    RUN_PASS(unroll_loops, false, unroll_loops(dcontext, tag, trace));
+    RUN_PASS(vectorize, false, identify_for_loop(dcontext, tag, trace));
+    RUN_PASS(prefetch, false, prefetch_optimize_trace(dcontext, tag, trace));
+    RUN_PASS(rlr, false, remove_redundant_loads(dcontext, tag, trace));
+    RUN_PASS(remove_unnecessary_zeroing, false,
+             remove_unnecessary_zeroing(dcontext, tag, trace));
+    RUN_PASS(constant_prop, false, constant_propagation(dcontext, tag, trace));
+    RUN_PASS(remove_dead_code, false, remove_dead_code(dcontext, tag, trace));
+    RUN_INTERNAL_PASS(stack_adjust, true, stack_adjust_combiner(dcontext, tag, trace, recreating));
+    RUN_PASS(peephole, true, peephole_optimize(dcontext, tag, trace, recreating));
 #ifdef IA32_ON_IA64
-    if (dynamo_options.test_i64) {
-        test_i64(dcontext, tag, trace);
-    }
+    RUN_PASS(test_i64, false, test_i64(dcontext, tag, trace));
 #endif
-
-    if (dynamo_options.instr_counts) {
-        instr_counts(dcontext, tag, trace, false);
-    }
+    RUN_PASS(instr_counts, true, instr_counts(dcontext, tag, trace, false));
     
 #ifdef DEBUG
     LOG(THREAD, LOG_OPTS, 3, "\nafter optimization:\n");
@@ -3288,15 +3273,15 @@ is_stack_adjustment(instr_t *inst)
     return (
             ((opcode == OP_add || opcode == OP_sub) &&
              opnd_is_reg(instr_get_dst(inst, 0)) &&
-             opnd_get_reg(instr_get_dst(inst, 0)) == REG_ESP &&
+             opnd_get_reg(instr_get_dst(inst, 0)) == REG_XSP &&
              opnd_is_immed_int(instr_get_src(inst, 0))) ||
 
             (opcode == OP_lea && 
-             opnd_get_reg(instr_get_dst(inst, 0)) == REG_ESP && 
-             ((opnd_get_base(instr_get_src(inst, 0)) == REG_ESP && 
+             opnd_get_reg(instr_get_dst(inst, 0)) == REG_XSP && 
+             ((opnd_get_base(instr_get_src(inst, 0)) == REG_XSP && 
                opnd_get_index(instr_get_src(inst, 0)) == REG_NULL ) ||
               (opnd_get_base(instr_get_src(inst, 0)) == REG_NULL &&
-               opnd_get_index(instr_get_src(inst, 0)) == REG_ESP &&
+               opnd_get_index(instr_get_src(inst, 0)) == REG_XSP &&
                opnd_get_scale(instr_get_src(inst, 0)) == 1))));
 }
 
@@ -3304,6 +3289,9 @@ static int
 get_stack_adjustment(instr_t *inst)
 {
     int opcode = instr_get_opcode(inst);
+    /* add/sub of xsp take at most a sign-extended imm32, so the casts
+     * below do not truncate on x64
+     */
     if (opcode == OP_add)
         return (int) opnd_get_immed_int(instr_get_src(inst, 0));
     if (opcode == OP_sub)
@@ -3320,7 +3308,7 @@ set_stack_adjustment(instr_t *inst, int adjust)
     int opcode = instr_get_opcode(inst);
     opnd_t temp_opnd;
     if (opcode == OP_lea) {
-        instr_set_src(inst, 0, opnd_create_base_disp(REG_ESP, REG_NULL, 0, adjust, OPSZ_lea));
+        instr_set_src(inst, 0, opnd_create_base_disp(REG_XSP, REG_NULL, 0, adjust, OPSZ_lea));
         return;
     }
     if (opcode == OP_sub)
@@ -3334,7 +3322,8 @@ set_stack_adjustment(instr_t *inst, int adjust)
         
 
 static void 
-stack_adjust_combiner(dcontext_t *dcontext, app_pc tag, instrlist_t *trace)
+stack_adjust_combiner(dcontext_t *dcontext, app_pc tag, instrlist_t *trace,
+                      bool recreating)
 {
     instr_t *inst, *next, *first_adjust, *last_adjust;
     int opcode, adj, max_off=0, cur_off=0, first_off=0;
@@ -3370,6 +3359,7 @@ stack_adjust_combiner(dcontext_t *dcontext, app_pc tag, instrlist_t *trace)
                     loginst(dcontext, 3, last_adjust, "  removing old last adjustment");
                     opt_stats_t.num_stack_adjust_removed++;
 #endif
+                    OPT_RSTATS_INC(recreating, opt_stack_adjust_removed);
                     ASSERT(cur_off % 4 == 0);
                     remove_inst(dcontext, trace, last_adjust);
                     last_adjust = inst;
@@ -3384,7 +3374,7 @@ stack_adjust_combiner(dcontext_t *dcontext, app_pc tag, instrlist_t *trace)
             /* could mangle pushes and pops instead of restoring, is */
             /* helpfull?, check for store to ecx_off, might mangle indirect */
             /* macro's by inserting a clean up instruction */
-            if (!instr_uses_reg(inst, REG_ESP) && !instr_is_cti(inst) && 
+            if (!instr_uses_reg(inst, REG_XSP) && !instr_is_cti(inst) && 
                 !instr_is_interrupt(inst) && !instr_is_call(inst)) {
                 /* skip writes to constant address, presume that they will never be stack */
                 if ((opcode == OP_mov_st || opcode == OP_mov_imm) && 
@@ -3431,9 +3421,12 @@ stack_adjust_combiner(dcontext_t *dcontext, app_pc tag, instrlist_t *trace)
                         loginst(dcontext, 3, last_adjust, "  curent offset = 0 removing last adjustment");
                     }
 #endif
+                    OPT_RSTATS_INC(recreating, opt_stack_adjust_removed);
                     remove_inst(dcontext, trace, first_adjust);
-                    if (last_adjust != NULL)
+                    if (last_adjust != NULL) {
+                        OPT_RSTATS_INC(recreating, opt_stack_adjust_removed);
                         remove_inst(dcontext, trace, last_adjust); 
+                    }
                 } else {
                     /* change adjustment if necessary */
                     if (first_off != cur_off) {
@@ -3451,6 +3444,7 @@ stack_adjust_combiner(dcontext_t *dcontext, app_pc tag, instrlist_t *trace)
                         opt_stats_t.num_stack_adjust_removed++;
                         loginst(dcontext, 3, last_adjust, "  removing last adjustment");
 #endif
+                        OPT_RSTATS_INC(recreating, opt_stack_adjust_removed);
                         remove_inst(dcontext, trace, last_adjust);
                     } 
                 }
@@ -3845,7 +3839,8 @@ call_return_matching(dcontext_t *dcontext, app_pc tag, instrlist_t *trace)
  *   leave -> mov ebp,esp; pop ebp
  */
 static void
-peephole_optimize(dcontext_t *dcontext, app_pc tag, instrlist_t *trace)
+peephole_optimize(dcontext_t *dcontext, app_pc tag, instrlist_t *trace,
+                  bool recreating)
 {
     bool p4 = (proc_get_family() == FAMILY_PENTIUM_4);
     instr_t *inst, *next_inst;
@@ -3855,13 +3850,11 @@ peephole_optimize(dcontext_t *dcontext, app_pc tag, instrlist_t *trace)
         next_inst = instr_get_next(inst);
         opcode = instr_get_opcode(inst);
         if (p4 && (opcode == OP_inc || opcode == OP_dec)) {
-#ifdef DEBUG
-            opt_stats_t.incs_examined++;
-            if (replace_inc_with_add(dcontext, inst, trace))
-                opt_stats_t.incs_replaced++;
-#else
-            replace_inc_with_add(dcontext, inst, trace);
-#endif
+            DODEBUG({ opt_stats_t.incs_examined++; });
+            if (replace_inc_with_add(dcontext, inst, trace)) {
+                DODEBUG({ opt_stats_t.incs_replaced++; });
+                OPT_RSTATS_INC(recreating, opt_incs_replaced);
+            }
         } else if (opcode == OP_leave) {
             /* on Pentium II and later, complex instructions like
              * enter and leave are slower (though smaller) than
@@ -3873,13 +3866,19 @@ peephole_optimize(dcontext_t *dcontext, app_pc tag, instrlist_t *trace)
              * this makes a difference on microbenchmarks, doesn't
              * seem to show up on spec though
              */
+            /* A fault in the pop restarts the leave, which redoes the
+             * mov from the unchanged xbp.
+             */
             instrlist_preinsert(trace, inst,
-                                INSTR_CREATE_mov_ld(dcontext,
-                                                    opnd_create_reg(REG_ESP),
-                                                    opnd_create_reg(REG_EBP)));
+                                INSTR_XL8(INSTR_CREATE_mov_ld
+                                          (dcontext, opnd_create_reg(REG_XSP),
+                                           opnd_create_reg(REG_XBP)),
+                                          instr_get_translation(inst)));
             instrlist_preinsert(trace, inst,
-                                INSTR_CREATE_pop(dcontext,
-                                                 opnd_create_reg(REG_EBP)));
+                                INSTR_XL8(INSTR_CREATE_pop
+                                          (dcontext, opnd_create_reg(REG_XBP)),
+                                          instr_get_translation(inst)));
+            OPT_RSTATS_INC(recreating, opt_leaves_expanded);
             instrlist_remove(trace, inst);
             instr_destroy(dcontext, inst);
         }
@@ -4499,6 +4498,9 @@ is_dead_reg(dcontext_t *dcontext, instr_t *start_inst, int reg)
 void
 replace_inst(dcontext_t *dcontext, instrlist_t *ilist, instr_t *old, instr_t *new)
 {
+    /* new computes what old did, so a fault in it restarts old */
+    if (instr_get_translation(new) == NULL)
+        instr_set_translation(new, instr_get_translation(old));
     instrlist_preinsert(ilist, old, new);
     instrlist_remove(ilist, old);
     instr_destroy(dcontext, old);
@@ -4683,5 +4685,3 @@ is_nop(instr_t *inst)
     // other cases
     return false;
 }
-
-#endif /* INTERNAL around whole file */
@@ -483,7 +483,7 @@ sideline_run(void *arg)
 static void
 optimize_trace_wrapper(dcontext_t *dcontext, fragment_t *frag, instrlist_t *trace)
 {
-    optimize_trace(dcontext, frag->tag, trace);
+    optimize_trace(dcontext, frag->tag, trace, false/*!recreating*/);
 }
 
 static void 
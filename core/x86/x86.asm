@@ -2120,7 +2120,8 @@ GLOBAL_LABEL(hashlookup_null_handler:)
  * and ~2x faster for 20kb copies on plain x86.  Using SSE is quite complicated,
  * because it means doing cpuid checks and loop unrolling.  Many of our string
  * operations are short anyway.  For safe_read, it also increases the number of
- * potentially faulting PCs.
+ * potentially faulting PCs.  The private memcpy and memset below do use SSE2
+ * for larger sizes on x64.
  */
 #define REP_STRING_OP(funcname, ptr_to_align, string_op) \
         mov     REG_XCX, ptr_to_align                           @N@\
@@ -2184,9 +2185,56 @@ ADDRTAKEN_LABEL(safe_read_asm_recover:)
  * need a reasonably efficient assembly memcpy implementation for safe_read, we
  * go ahead and reuse the code for private memcpy and memset.
  *
- * XXX: See comment on REP_STRING_OP about maybe using SSE instrs.  It's more
- * viable for memcpy and memset than for safe_read_asm.
+ * On x64, where SSE2 is architectural and needs no cpuid check, larger
+ * copies and sets use a 64-byte unrolled SSE2 loop aligned on dst.  safe_read_asm
+ * keeps using REP_STRING_OP so its set of potentially faulting PCs is unchanged.
+ * XXX: 32-bit could dispatch on proc_has_feature(FEATURE_SSE2), but reading a
+ * global flag here needs a PIC base on every call.
  */
+#ifdef X64
+/* Sizes at or above this use the SSE2 loop.  Below it the setup cost of
+ * aligning dst dominates and rep string ops are as fast.
+ */
+# define SSE_MEMFUNC_MIN_SIZE 128
+
+/* Copies or sets XDX >= SSE_MEMFUNC_MIN_SIZE bytes at XDI from XSI or xmm0.
+ * The first 16 bytes are stored unaligned and XDI is then advanced to a 16-byte
+ * boundary, so some bytes may be written twice.  The remaining 0-63 trailing
+ * bytes are handled with a byte-sized string op.  is_copy is 1 for memcpy,
+ * where each block is loaded from XSI into xmm0-3.
+ */
+# define SSE_STRING_OP(funcname, string_op, is_copy) \
+        IF_COPY_##is_copy(movdqu  xmm0, [REG_XSI])                @N@\
+        movdqu  [REG_XDI], xmm0                                 @N@\
+        mov     REG_XCX, REG_XDI                                @N@\
+        neg     REG_XCX                                         @N@\
+        and     REG_XCX, 15                                     @N@\
+        add     REG_XDI, REG_XCX                                @N@\
+        IF_COPY_##is_copy(add     REG_XSI, REG_XCX)               @N@\
+        sub     REG_XDX, REG_XCX                                @N@\
+        mov     REG_XCX, REG_XDX                                @N@\
+        shr     REG_XCX, 6                                      @N@\
+funcname##_sse_loop:                                            @N@\
+        IF_COPY_##is_copy(movdqu  xmm0, [REG_XSI])                @N@\
+        IF_COPY_##is_copy(movdqu  xmm1, [REG_XSI + 16])           @N@\
+        IF_COPY_##is_copy(movdqu  xmm2, [REG_XSI + 32])           @N@\
+        IF_COPY_##is_copy(movdqu  xmm3, [REG_XSI + 48])           @N@\
+        movdqa  [REG_XDI], xmm0                                 @N@\
+        movdqa  [REG_XDI + 16], IF_COPY_ELSE_##is_copy(xmm1, xmm0)  @N@\
+        movdqa  [REG_XDI + 32], IF_COPY_ELSE_##is_copy(xmm2, xmm0)  @N@\
+        movdqa  [REG_XDI + 48], IF_COPY_ELSE_##is_copy(xmm3, xmm0)  @N@\
+        IF_COPY_##is_copy(add     REG_XSI, 64)                    @N@\
+        add     REG_XDI, 64                                     @N@\
+        dec     REG_XCX                                         @N@\
+        jnz     funcname##_sse_loop                             @N@\
+        mov     REG_XCX, REG_XDX                                @N@\
+        and     REG_XCX, 63                                     @N@\
+        rep string_op##b
+# define IF_COPY_1(...) __VA_ARGS__
+# define IF_COPY_0(...)
+# define IF_COPY_ELSE_1(x, y) x
+# define IF_COPY_ELSE_0(x, y) y
+#endif
 
 /* Private memcpy.
  */
@@ -2194,6 +2242,14 @@ ADDRTAKEN_LABEL(safe_read_asm_recover:)
 GLOBAL_LABEL(memcpy:)
         ARGS_TO_XDI_XSI_XDX()           /* dst=xdi, src=xsi, n=xdx */
         mov    REG_XAX, REG_XDI         /* Save dst for return. */
+#ifdef X64
+        cmp     REG_XDX, SSE_MEMFUNC_MIN_SIZE
+        jb      memcpy_rep
+        SSE_STRING_OP(memcpy, movs, 1)
+        RESTORE_XDI_XSI()
+        ret                             /* Return original dst. */
+memcpy_rep:
+#endif
         /* Copy xdx bytes, align on src. */
         REP_STRING_OP(memcpy, REG_XSI, movs)
         RESTORE_XDI_XSI()
@@ -2210,6 +2266,17 @@ GLOBAL_LABEL(memset:)
         jnz     make_val_word_size
         xor     eax, eax
 do_memset:
+#ifdef X64
+        cmp     REG_XDX, SSE_MEMFUNC_MIN_SIZE
+        jb      memset_rep
+        movq    xmm0, rax
+        punpcklqdq xmm0, xmm0
+        SSE_STRING_OP(memset, stos, 0)
+        pop     REG_XAX                 /* Return original dst. */
+        RESTORE_XDI_XSI()
+        ret
+memset_rep:
+#endif
         /* Set xdx bytes, align on dst. */
         REP_STRING_OP(memset, REG_XDI, stos)
         pop     REG_XAX                 /* Return original dst. */
@@ -0,0 +1,407 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* Containers DynamoRIO Extension: DrWorker */
+
+#include "dr_api.h"
+#include "containers_private.h"
+#include "drworker.h"
+#include <string.h> /* memset */
+#ifdef WINDOWS
+# include <intrin.h>
+#endif
+
+#define DRWORKER_MAGIC 0x4b524f57  /* "WORK" */
+/* per-worker deque size: must be a power of 2 */
+#define DEQUE_CAPACITY 1024
+#define DEQUE_MASK (DEQUE_CAPACITY - 1)
+/* number of empty polls an idle worker yields for before it starts sleeping */
+#define IDLE_YIELDS 64
+#define IDLE_SLEEP_MS 1
+
+/* The DR API only exports an atomic add, so we use the compiler's primitives. */
+#ifdef WINDOWS
+# define COMPILER_BARRIER() _ReadWriteBarrier()
+# define MEMORY_BARRIER() _mm_mfence()
+# define ATOMIC_CAS_INT(var, old, new) \
+    (_InterlockedCompareExchange((volatile long *)(var), (long)(new), (long)(old)) \
+     == (long)(old))
+# ifdef X64
+#  define ATOMIC_EXCHANGE_PTR(var, val) \
+    _InterlockedExchangePointer((void *volatile *)(var), (void *)(val))
+# else
+#  define ATOMIC_EXCHANGE_PTR(var, val) \
+    ((void *)(ptr_int_t)_InterlockedExchange((volatile long *)(var), \
+                                             (long)(ptr_int_t)(val)))
+# endif
+#else
+# define COMPILER_BARRIER() __asm__ __volatile__("" : : : "memory")
+# define MEMORY_BARRIER() __sync_synchronize()
+# define ATOMIC_CAS_INT(var, old, new) __sync_bool_compare_and_swap(var, old, new)
+# define ATOMIC_EXCHANGE_PTR(var, val) ((void *)__sync_lock_test_and_set(var, val))
+#endif
+
+typedef struct _task_t {
+    void (*func)(void *);
+    void *arg;
+    struct _task_t *volatile next;   /* for inbox_t */
+} task_t;
+
+/* Intrusive multiple-producer queue.  Producers never block; consumers
+ * take turns via the claimed flag, so each pop sees a single consumer.
+ */
+typedef struct _inbox_t {
+    task_t *volatile head;  /* most recently pushed */
+    task_t *tail;           /* next to pop */
+    volatile uint claimed;
+    task_t stub;
+} inbox_t;
+
+/* Work-stealing deque: the owner pushes and pops at the bottom while
+ * other workers steal from the top.  The indices only ever increase,
+ * so we compare their difference to survive wraparound.
+ */
+typedef struct _deque_t {
+    volatile uint top;
+    volatile uint bottom;
+    task_t *volatile slots[DEQUE_CAPACITY];
+} deque_t;
+
+typedef struct _worker_t {
+    struct _pool_t *pool;
+    uint index;
+    volatile thread_id_t thread_id;   /* 0 until the thread starts */
+    /* Held while finding and running a task, so DR's thread synch never
+     * suspends us with a task in hand.
+     */
+    void *run_lock;
+    inbox_t inbox;  /* tasks submitted from non-worker threads */
+    deque_t deque;  /* tasks submitted by this worker's own tasks */
+} worker_t;
+
+typedef struct _pool_t {
+    uint magic;
+    uint num_workers;
+    worker_t *workers;
+    volatile int pending;     /* submitted but not yet completed */
+    volatile int next_inbox;  /* round-robin inbox selection */
+} pool_t;
+
+/***************************************************************************
+ * QUEUES
+ */
+
+static void
+inbox_init(inbox_t *q)
+{
+    q->stub.next = NULL;
+    q->head = &q->stub;
+    q->tail = &q->stub;
+    q->claimed = 0;
+}
+
+static void
+inbox_push(inbox_t *q, task_t *task)
+{
+    task_t *prev;
+    task->next = NULL;
+    prev = (task_t *) ATOMIC_EXCHANGE_PTR(&q->head, task);
+    /* the consumer sees the queue end at prev until this store */
+    prev->next = task;
+}
+
+/* Caller must have claimed q */
+static task_t *
+inbox_pop(inbox_t *q)
+{
+    task_t *tail = q->tail;
+    task_t *next = tail->next;
+    if (tail == &q->stub) {
+        if (next == NULL)
+            return NULL;
+        q->tail = next;
+        tail = next;
+        next = next->next;
+    }
+    if (next != NULL) {
+        q->tail = next;
+        return tail;
+    }
+    if (tail != q->head)
+        return NULL; /* a push is in progress: we'll get it on a later poll */
+    /* tail is the last entry: re-push the stub so we can unlink it */
+    inbox_push(q, &q->stub);
+    next = tail->next;
+    if (next != NULL) {
+        q->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+static task_t *
+inbox_try_pop(inbox_t *q)
+{
+    task_t *task;
+    if (q->tail == &q->stub && q->head == &q->stub)
+        return NULL; /* empty: avoid the atomic op */
+    if (!ATOMIC_CAS_INT(&q->claimed, 0, 1))
+        return NULL; /* another worker is popping */
+    task = inbox_pop(q);
+    COMPILER_BARRIER();
+    q->claimed = 0;
+    return task;
+}
+
+/* Only called by the owner */
+static bool
+deque_push(deque_t *d, task_t *task)
+{
+    uint b = d->bottom;
+    if ((int)(b - d->top) >= DEQUE_CAPACITY)
+        return false;
+    d->slots[b & DEQUE_MASK] = task;
+    /* the slot must be written before thieves can see it */
+    COMPILER_BARRIER();
+    d->bottom = b + 1;
+    return true;
+}
+
+/* Only called by the owner */
+static task_t *
+deque_pop(deque_t *d)
+{
+    uint b = d->bottom - 1;
+    uint t;
+    task_t *task;
+    d->bottom = b;
+    /* thieves must see the new bottom before we read top */
+    MEMORY_BARRIER();
+    t = d->top;
+    if ((int)(b - t) < 0) {
+        d->bottom = t;
+        return NULL;
+    }
+    task = d->slots[b & DEQUE_MASK];
+    if (b != t)
+        return task;
+    /* last entry: race any thieves for it */
+    if (!ATOMIC_CAS_INT(&d->top, t, t + 1))
+        task = NULL;
+    d->bottom = t + 1;
+    return task;
+}
+
+static task_t *
+deque_steal(deque_t *d)
+{
+    uint t = d->top;
+    uint b;
+    task_t *task;
+    COMPILER_BARRIER();
+    b = d->bottom;
+    if ((int)(b - t) <= 0)
+        return NULL;
+    task = d->slots[t & DEQUE_MASK];
+    if (!ATOMIC_CAS_INT(&d->top, t, t + 1))
+        return NULL; /* lost a race with the owner or another thief */
+    return task;
+}
+
+/***************************************************************************
+ * WORKERS
+ */
+
+/* Prefers w's own tasks, newest first, then submissions in arrival
+ * order, then work stolen from other workers.
+ */
+static task_t *
+worker_find_task(worker_t *w)
+{
+    pool_t *pool = w->pool;
+    task_t *task;
+    uint i;
+    task = deque_pop(&w->deque);
+    if (task != NULL)
+        return task;
+    task = inbox_try_pop(&w->inbox);
+    if (task != NULL)
+        return task;
+    for (i = 1; i < pool->num_workers; i++) {
+        task = deque_steal(&pool->workers[(w->index + i) % pool->num_workers].deque);
+        if (task != NULL)
+            return task;
+    }
+    for (i = 1; i < pool->num_workers; i++) {
+        task = inbox_try_pop(&pool->workers[(w->index + i) % pool->num_workers].inbox);
+        if (task != NULL)
+            return task;
+    }
+    return NULL;
+}
+
+static void
+task_run(pool_t *pool, task_t *task)
+{
+    (*task->func)(task->arg);
+    dr_global_free(task, sizeof(*task));
+    dr_atomic_add32_return_sum(&pool->pending, -1);
+}
+
+static void
+worker_main(void *arg)
+{
+    worker_t *w = (worker_t *) arg;
+    pool_t *pool = w->pool;
+    task_t *task;
+    uint idle = 0;
+    w->thread_id = dr_get_thread_id(dr_get_current_drcontext());
+    /* DR stops us at exit, after which drworker_pool_destroy() finishes our work */
+    while (true) {
+        dr_mutex_lock(w->run_lock);
+        task = worker_find_task(w);
+        if (task != NULL)
+            task_run(pool, task);
+        dr_mutex_unlock(w->run_lock);
+        if (task != NULL)
+            idle = 0;
+        else if (idle < IDLE_YIELDS) {
+            idle++;
+            dr_thread_yield();
+        } else
+            dr_sleep(IDLE_SLEEP_MS);
+    }
+}
+
+/***************************************************************************
+ * INTERFACE
+ */
+
+static void
+pool_free(pool_t *pool)
+{
+    uint i;
+    for (i = 0; i < pool->num_workers; i++)
+        dr_mutex_destroy(pool->workers[i].run_lock);
+    dr_global_free(pool->workers, pool->num_workers * sizeof(pool->workers[0]));
+    pool->magic = 0;
+    dr_global_free(pool, sizeof(*pool));
+}
+
+void *
+drworker_pool_create(uint num_workers)
+{
+    pool_t *pool;
+    uint i, num_started = 0;
+    if (num_workers == 0)
+        return NULL;
+    pool = dr_global_alloc(sizeof(*pool));
+    memset(pool, 0, sizeof(*pool));
+    pool->magic = DRWORKER_MAGIC;
+    pool->num_workers = num_workers;
+    pool->workers = dr_global_alloc(num_workers * sizeof(pool->workers[0]));
+    memset(pool->workers, 0, num_workers * sizeof(pool->workers[0]));
+    for (i = 0; i < num_workers; i++) {
+        worker_t *w = &pool->workers[i];
+        w->pool = pool;
+        w->index = i;
+        w->run_lock = dr_mutex_create();
+        inbox_init(&w->inbox);
+    }
+    /* A worker whose thread fails to start still has its queues served
+     * by the others, so we only give up if there are no threads at all.
+     */
+    for (i = 0; i < num_workers; i++) {
+        if (dr_create_client_thread(worker_main, &pool->workers[i]))
+            num_started++;
+    }
+    if (num_started == 0) {
+        pool_free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+bool
+drworker_submit(void *p, void (*func)(void *arg), void *arg)
+{
+    pool_t *pool = (pool_t *) p;
+    task_t *task;
+    thread_id_t tid;
+    uint i;
+    if (pool == NULL || pool->magic != DRWORKER_MAGIC || func == NULL)
+        return false;
+    task = dr_global_alloc(sizeof(*task));
+    task->func = func;
+    task->arg = arg;
+    dr_atomic_add32_return_sum(&pool->pending, 1);
+    tid = dr_get_thread_id(dr_get_current_drcontext());
+    for (i = 0; i < pool->num_workers; i++) {
+        worker_t *w = &pool->workers[i];
+        if (w->thread_id == tid) {
+            if (deque_push(&w->deque, task))
+                return true;
+            break; /* full: fall back to an inbox */
+        }
+    }
+    i = (uint) dr_atomic_add32_return_sum(&pool->next_inbox, 1) % pool->num_workers;
+    inbox_push(&pool->workers[i].inbox, task);
+    return true;
+}
+
+void
+drworker_pool_flush(void *p)
+{
+    pool_t *pool = (pool_t *) p;
+    if (pool == NULL || pool->magic != DRWORKER_MAGIC)
+        return;
+    while (pool->pending > 0)
+        dr_thread_yield();
+}
+
+void
+drworker_pool_destroy(void *p)
+{
+    pool_t *pool = (pool_t *) p;
+    task_t *task;
+    if (pool == NULL || pool->magic != DRWORKER_MAGIC)
+        return;
+    /* The workers were not running a task when DR stopped them, so
+     * everything that remains is still queued.  worker_find_task()
+     * visits every queue, including those of tasks we run here.
+     */
+    while ((task = worker_find_task(&pool->workers[0])) != NULL)
+        task_run(pool, task);
+    DR_ASSERT_MSG(pool->pending == 0, "drworker tasks were lost");
+    pool_free(pool);
+}
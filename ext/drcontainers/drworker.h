@@ -0,0 +1,101 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* Containers DynamoRIO Extension: DrWorker */
+
+#ifndef _DRWORKER_H_
+#define _DRWORKER_H_ 1
+
+/**
+ * @file drworker.h
+ * @brief Header for DynamoRIO DrWorker Extension
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***************************************************************************
+ * DRWORKER
+ */
+
+/**
+ * \addtogroup drcontainers Container Data Structures
+ */
+/*@{*/ /* begin doxygen group */
+
+/**
+ * Creates a pool of \p num_workers client threads (see
+ * dr_create_client_thread()) that run tasks passed to drworker_submit().
+ * Returns NULL on failure.  Should be called from dr_init().
+ *
+ * Each worker takes tasks from its own queue and steals from the
+ * other workers' queues when its own is empty.  A task is run while its
+ * worker holds a lock, so DR never suspends a worker in the middle of a
+ * task: tasks should thus be short, and a task must not wait on another task.
+ */
+void *
+drworker_pool_create(uint num_workers);
+
+/**
+ * Queues \p func to be called with \p arg on one of the pool's worker
+ * threads.  May be called from any thread, including from a task.
+ * Tasks submitted from a worker are run by that worker unless idle
+ * workers steal them; otherwise, no ordering among tasks is guaranteed.
+ * Returns false on failure.
+ */
+bool
+drworker_submit(void *pool, void (*func)(void *arg), void *arg);
+
+/**
+ * Waits until every task submitted so far, and every task those tasks
+ * submit, has completed.  Must not be called from a task.
+ */
+void
+drworker_pool_flush(void *pool);
+
+/**
+ * Destroys the pool.  Must be called from the process exit event, when
+ * DR has already stopped the worker threads: any tasks they had not yet
+ * started are run on the calling thread first.
+ */
+void
+drworker_pool_destroy(void *pool);
+
+/*@}*/ /* end doxygen group */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _DRWORKER_H_ */
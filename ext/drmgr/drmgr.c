@@ -153,6 +153,9 @@ static cb_entry_t *cblist_instru2instru;
 static uint pair_count;
 static uint quartet_count;
 
+/* Count of drmgr_enable_instru_optimization() requests, protected by bb_cb_lock */
+static uint optimize_count;
+
 /* Priority used for non-_ex events */
 static const drmgr_priority_t default_priority = {
     sizeof(default_priority), "__DEFAULT__", NULL, NULL, 0
@@ -299,12 +302,13 @@ drmgr_init(void)
 
     note_lock = dr_mutex_create();
 
-    bb_cb_lock = dr_rwlock_create();
+    /* read by every new block and system call, written only on registration */
+    bb_cb_lock = dr_rwlock_create_scalable();
     thread_event_lock = dr_rwlock_create();
     tls_lock = dr_mutex_create();
     cls_event_lock = dr_rwlock_create();
-    presys_event_lock = dr_rwlock_create();
-    postsys_event_lock = dr_rwlock_create();
+    presys_event_lock = dr_rwlock_create_scalable();
+    postsys_event_lock = dr_rwlock_create_scalable();
     modload_event_lock = dr_rwlock_create();
     modunload_event_lock = dr_rwlock_create();
 #ifdef LINUX
@@ -394,6 +398,264 @@ drmgr_fix_app_ctis(void *drcontext, instrlist_t *bb)
     }
 }
 
+/***************************************************************************
+ * INSTRU2INSTRU OPTIMIZATION
+ */
+
+/* How many instrs back to look for an identical computation */
+#define OPTIMIZE_CSE_WINDOW 32
+
+/* We only touch straight-line meta code that cannot fault: anything else
+ * ends the run we are looking at.
+ */
+static bool
+opt_is_straight_meta(instr_t *inst)
+{
+    return (inst != NULL && !instr_ok_to_mangle(inst) &&
+            !instr_is_meta_may_fault(inst) &&
+            !instr_is_label(inst) && !instr_is_cti(inst) &&
+            !instr_is_syscall(inst) && !instr_is_interrupt(inst));
+}
+
+/* Matches "mov reg => slot" (is_load false) or "mov slot => reg" (is_load true) */
+static bool
+opt_is_reg_move(instr_t *inst, bool is_load, OUT reg_id_t *reg, OUT opnd_t *slot)
+{
+    opnd_t r, m;
+    if (instr_get_opcode(inst) != (is_load ? OP_mov_ld : OP_mov_st))
+        return false;
+    r = is_load ? instr_get_dst(inst, 0) : instr_get_src(inst, 0);
+    m = is_load ? instr_get_src(inst, 0) : instr_get_dst(inst, 0);
+    if (!opnd_is_reg(r) || !opnd_is_memory_reference(m))
+        return false;
+    *reg = opnd_get_reg(r);
+    *slot = m;
+    /* a slot addressed via reg changes along with reg */
+    return !opnd_uses_reg(m, *reg);
+}
+
+static void
+opt_remove(void *drcontext, instrlist_t *bb, instr_t *inst)
+{
+    instrlist_remove(bb, inst);
+    instr_destroy(drcontext, inst);
+}
+
+/* Removes a spill to the slot just restored from, or a restore from the
+ * slot just spilled to: either way the register and slot already match.
+ */
+static void
+opt_spill_pairs(void *drcontext, instrlist_t *bb)
+{
+    instr_t *inst, *next, *prev;
+    reg_id_t reg1, reg2;
+    opnd_t slot1, slot2;
+    for (inst = instrlist_first(bb); inst != NULL; inst = next) {
+        next = instr_get_next(inst);
+        prev = instr_get_prev(inst);
+        if (!opt_is_straight_meta(inst) || !opt_is_straight_meta(prev))
+            continue;
+        if ((opt_is_reg_move(prev, true, &reg1, &slot1) &&
+             opt_is_reg_move(inst, false, &reg2, &slot2)) ||
+            (opt_is_reg_move(prev, false, &reg1, &slot1) &&
+             opt_is_reg_move(inst, true, &reg2, &slot2))) {
+            if (reg1 == reg2 && opnd_same(slot1, slot2))
+                opt_remove(drcontext, bb, inst);
+        }
+    }
+}
+
+/* Returns whether reg's value on entry to inst is fully overwritten before
+ * anything reads it, within the current run of meta instrs.
+ */
+static bool
+opt_reg_dead_at(instr_t *inst, reg_id_t reg)
+{
+    for (; opt_is_straight_meta(inst); inst = instr_get_next(inst)) {
+        if (instr_reads_from_reg(inst, reg))
+            return false;
+        if (instr_writes_to_exact_reg(inst, reg))
+            return true;
+        /* a partial write leaves the rest of reg live */
+        if (instr_writes_to_reg(inst, reg))
+            return false;
+    }
+    return false;
+}
+
+/* Removes restores whose value is overwritten before being read, typically
+ * by the next component's use of the same scratch register.
+ */
+static void
+opt_dead_restores(void *drcontext, instrlist_t *bb)
+{
+    instr_t *inst, *next;
+    reg_id_t reg;
+    opnd_t slot;
+    for (inst = instrlist_first(bb); inst != NULL; inst = next) {
+        next = instr_get_next(inst);
+        if (opt_is_straight_meta(inst) && opt_is_reg_move(inst, true, &reg, &slot) &&
+            opt_reg_dead_at(next, reg))
+            opt_remove(drcontext, bb, inst);
+    }
+}
+
+static bool
+opt_reads_xax_beyond_al_ah(instr_t *inst)
+{
+    int i;
+    for (i = 0; i < instr_num_srcs(inst); i++) {
+        opnd_t op = instr_get_src(inst, i);
+        if (opnd_is_reg(op) &&
+            (opnd_get_reg(op) == DR_REG_AL || opnd_get_reg(op) == DR_REG_AH))
+            continue;
+        if (opnd_uses_reg(op, DR_REG_XAX))
+            return true;
+    }
+    for (i = 0; i < instr_num_dsts(inst); i++) {
+        opnd_t op = instr_get_dst(inst, i);
+        if (!opnd_is_reg(op) && opnd_uses_reg(op, DR_REG_XAX))
+            return true;
+    }
+    return false;
+}
+
+/* Matches the restore half of the flags preservation, "add 0x7f,%al; sahf;
+ * mov slot => %xax", immediately followed by the save half, "lahf; seto %al",
+ * whose spill of %xax to the same slot opt_spill_pairs() already removed.
+ * Returns the instr after the match, or NULL.
+ */
+static instr_t *
+opt_match_flags_restore_save(instr_t *inst)
+{
+    instr_t *in[5];
+    reg_id_t reg;
+    opnd_t slot;
+    int i;
+    for (i = 0; i < 5; i++, inst = instr_get_next(inst)) {
+        if (!opt_is_straight_meta(inst))
+            return NULL;
+        in[i] = inst;
+    }
+    if (instr_get_opcode(in[0]) != OP_add ||
+        !opnd_is_reg(instr_get_dst(in[0], 0)) ||
+        opnd_get_reg(instr_get_dst(in[0], 0)) != DR_REG_AL ||
+        !opnd_is_immed_int(instr_get_src(in[0], 0)) ||
+        opnd_get_immed_int(instr_get_src(in[0], 0)) != 0x7f ||
+        instr_get_opcode(in[1]) != OP_sahf ||
+        !opt_is_reg_move(in[2], true, &reg, &slot) || reg != DR_REG_XAX ||
+        instr_get_opcode(in[3]) != OP_lahf ||
+        instr_get_opcode(in[4]) != OP_seto ||
+        !opnd_is_reg(instr_get_dst(in[4], 0)) ||
+        opnd_get_reg(instr_get_dst(in[4], 0)) != DR_REG_AL)
+        return NULL;
+    return inst;
+}
+
+/* Merges adjacent flags preservation: dropping the restore-then-save pair
+ * leaves %al and %ah holding the same saved flags and the app flags only
+ * clobbered, so the code that follows must not read the real flags, nor
+ * the rest of %xax, before restoring both.
+ */
+static void
+opt_merge_flags(void *drcontext, instrlist_t *bb)
+{
+    instr_t *inst, *next, *in;
+    for (inst = instrlist_first(bb); inst != NULL; inst = next) {
+        bool flags_written = false, xax_written = false;
+        next = instr_get_next(inst);
+        in = opt_match_flags_restore_save(inst);
+        if (in == NULL)
+            continue;
+        for (; opt_is_straight_meta(in) && !(flags_written && xax_written);
+             in = instr_get_next(in)) {
+            uint aflags = instr_get_arith_flags(in);
+            if (!flags_written && (aflags & EFLAGS_READ_6) != 0)
+                break;
+            if (!xax_written && opt_reads_xax_beyond_al_ah(in))
+                break;
+            if ((aflags & EFLAGS_WRITE_6) == EFLAGS_WRITE_6)
+                flags_written = true;
+            if (instr_writes_to_exact_reg(in, DR_REG_XAX))
+                xax_written = true;
+        }
+        if (flags_written && xax_written) {
+            int i;
+            for (i = 0; i < 5; i++) {
+                next = instr_get_next(inst);
+                opt_remove(drcontext, bb, inst);
+                inst = next;
+            }
+        }
+    }
+}
+
+/* Removes an lea, or a load from a thread-local slot, that repeats an
+ * earlier one into the same register whose inputs are unchanged.
+ */
+static void
+opt_repeated_computations(void *drcontext, instrlist_t *bb)
+{
+    instr_t *inst, *next, *prev;
+    for (inst = instrlist_first(bb); inst != NULL; inst = next) {
+        int opc = instr_get_opcode(inst), count;
+        opnd_t src, dst;
+        bool is_load;
+        next = instr_get_next(inst);
+        if (!opt_is_straight_meta(inst) || (opc != OP_lea && opc != OP_mov_ld))
+            continue;
+        dst = instr_get_dst(inst, 0);
+        src = instr_get_src(inst, 0);
+        is_load = (opc == OP_mov_ld);
+        if (!opnd_is_reg(dst) || opnd_uses_reg(src, opnd_get_reg(dst)))
+            continue;
+        if (is_load && !(opnd_is_far_base_disp(src) &&
+                         (opnd_get_segment(src) == DR_SEG_FS ||
+                          opnd_get_segment(src) == DR_SEG_GS)))
+            continue;
+        for (prev = instr_get_prev(inst), count = 0;
+             opt_is_straight_meta(prev) && count < OPTIMIZE_CSE_WINDOW;
+             prev = instr_get_prev(prev), count++) {
+            if (instr_get_opcode(prev) == opc &&
+                opnd_same(instr_get_dst(prev, 0), dst) &&
+                opnd_same(instr_get_src(prev, 0), src)) {
+                opt_remove(drcontext, bb, inst);
+                break;
+            }
+            if (instr_writes_to_reg(prev, opnd_get_reg(dst)) ||
+                instr_writes_to_reg(prev, opnd_get_base(src)) ||
+                instr_writes_to_reg(prev, opnd_get_index(src)) ||
+                (is_load && instr_writes_memory(prev)))
+                break;
+        }
+    }
+}
+
+static void
+drmgr_optimize_instru(void *drcontext, instrlist_t *bb)
+{
+    opt_spill_pairs(drcontext, bb);
+    opt_dead_restores(drcontext, bb);
+    opt_merge_flags(drcontext, bb);
+    opt_repeated_computations(drcontext, bb);
+}
+
+DR_EXPORT
+bool
+drmgr_enable_instru_optimization(bool enable)
+{
+    bool res = true;
+    dr_rwlock_write_lock(bb_cb_lock);
+    if (enable)
+        optimize_count++;
+    else if (optimize_count > 0)
+        optimize_count--;
+    else
+        res = false;
+    dr_rwlock_write_unlock(bb_cb_lock);
+    return res;
+}
+
 static dr_emit_flags_t
 drmgr_bb_event(void *drcontext, void *tag, instrlist_t *bb,
                bool for_trace, bool translating)
@@ -480,7 +742,11 @@ drmgr_bb_event(void *drcontext, void *tag, instrlist_t *bb,
             res |= (*e->cb.xform_cb)(drcontext, tag, bb, for_trace, translating);
     }
 
-    /* Pass 5: our private pass to support multiple non-meta ctis in app2app phase */
+    /* Pass 5: our optimization of the combined instrumentation, if requested */
+    if (optimize_count > 0)
+        drmgr_optimize_instru(drcontext, bb);
+
+    /* Pass 6: our private pass to support multiple non-meta ctis in app2app phase */
     drmgr_fix_app_ctis(drcontext, bb);
 
     drmgr_set_tls_field(drcontext, tls_idx_bb_phase,
@@ -405,6 +405,34 @@ DR_EXPORT
 drmgr_bb_phase_t
 drmgr_current_bb_phase(void *drcontext);
 
+DR_EXPORT
+/**
+ * Requests (if \p enable is true) or withdraws a prior request (if \p
+ * enable is false) for \p drmgr's own optimization pass, which runs after
+ * every instrumentation-to-instrumentation callback.  The pass is applied
+ * while at least one request is outstanding.  It only examines
+ * straight-line runs of meta-instructions between application instructions
+ * and removes the redundancy left when several components each preserve
+ * state around their own instrumentation:
+ *  - a spill of a register to the slot it was just restored from (or
+ *    a restore from the slot it was just spilled to);
+ *  - a restore of a register that is fully overwritten before it is read;
+ *  - an arithmetic flags restore (dr_restore_arith_flags_from_xax() plus
+ *    the restore of DR_REG_XAX) immediately followed by a flags save
+ *    (dr_save_arith_flags_to_xax()), when the code that follows neither
+ *    reads the arithmetic flags nor reads DR_REG_XAX beyond DR_REG_AL and
+ *    DR_REG_AH before restoring both;
+ *  - a repeated \p lea, such as from drutil_insert_get_mem_addr() of the
+ *    same operand, or a repeated load from a thread-local slot, into the
+ *    same register when neither the register nor the inputs have changed.
+ *
+ * Components relying on this pass should not depend on the exact
+ * instruction sequences they inserted surviving to the code cache.
+ * \return false if \p enable is false and there is no request to withdraw.
+ */
+bool
+drmgr_enable_instru_optimization(bool enable);
+
 /***************************************************************************
  * TLS
  */
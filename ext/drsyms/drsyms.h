@@ -346,6 +346,10 @@ DR_EXPORT
  * DRSYM_DEMANGLE_FULL flag.  Also for Windows PDB, if DRSYM_DEMANGLE is
  * set, \p symbol must include the template arguments.
  *
+ * For other symbol tables, the first lookup with a given set of \p flags
+ * builds a sorted index of the module's names, making subsequent lookups
+ * logarithmic in the number of symbols.
+ *
  * @param[in] modpath The full path to the module to be queried.
  * @param[in] symbol The name of the symbol being queried.
  *   To specify a target module, pass "modulename!symbolname" as the symbol
@@ -474,31 +478,39 @@ DR_EXPORT
 drsym_error_t
 drsym_module_has_symbols(const char *modpath);
 
-#ifdef WINDOWS
 DR_EXPORT
 /**
  * Enumerates all symbol information matching a pattern for a given module.
  * Calls the given callback function for each matching symbol.
  * If the callback returns false, the enumeration will end.
  *
- * This routine is only supported for PDB symbols (DRSYM_PDB).
- *
- * \note drsym_search_symbols() with full=false is significantly
- * faster and uses less memory than drsym_enumerate_symbols(), and is
- * faster than drsym_lookup_symbol(), but requires dbghelp.dll version
+ * For Windows PDB symbols (DRSYM_PDB), \p match is passed to dbghelp.
+ * For all other symbol tables, \p match is a case-sensitive wildcard
+ * pattern, where '*' matches any sequence of characters and '?' any single
+ * character, that is compared against names demangled as with
+ * DRSYM_DEFAULT_FLAGS.  The names are indexed on the first query, so later
+ * queries of the same module do not demangle again, and a pattern that
+ * starts with literal characters only visits the names with that prefix.
+ * Matches are reported in name order.
+ *
+ * \note For PDB symbols, drsym_search_symbols() with full=false is
+ * significantly faster and uses less memory than drsym_enumerate_symbols(),
+ * and is faster than drsym_lookup_symbol(), but requires dbghelp.dll version
  * 6.3 or higher.  If an earlier version is used, this function will
  * use a slower mechanism to perform the search.
  *
  * @param[in] modpath   The full path to the module to be queried.
- * @param[in] match     Regular expression describing the names of the symbols
+ * @param[in] match     Pattern describing the names of the symbols
  *                      to be enumerated.  To specify a target module, use the
- *                      "module_pattern!symbol_pattern" format.
+ *                      "module_pattern!symbol_pattern" format.  The module
+ *                      portion is ignored for non-PDB symbols.
  * @param[in] full      Whether to search all symbols or (the default) just
  *                      functions.  A full search takes significantly
  *                      more time and memory and eliminates the
  *                      performance advantage over other lookup
  *                      methods.  A full search requires dbghelp.dll
- *                      version 6.6 or higher.
+ *                      version 6.6 or higher.  Ignored for non-PDB symbols,
+ *                      where every symbol table entry is searched.
  * @param[in] callback  Function to call for each matching symbol found.
  * @param[in] data      User parameter passed to callback.
  */
@@ -514,21 +526,15 @@ DR_EXPORT
  * drsym_search_symbols()).
  * If the callback returns false, the enumeration will end.
  *
- * This routine is only supported for PDB symbols (DRSYM_PDB).
- *
- * \note The performance note for drsym_search_symbols() applies here
- * as well.
+ * The pattern rules and performance notes for drsym_search_symbols()
+ * apply here as well.
  *
  * @param[in] modpath   The full path to the module to be queried.
- * @param[in] match     Regular expression describing the names of the symbols
+ * @param[in] match     Pattern describing the names of the symbols
  *                      to be enumerated.  To specify a target module, use the
  *                      "module_pattern!symbol_pattern" format.
  * @param[in] full      Whether to search all symbols or (the default) just
- *                      functions.  A full search takes significantly
- *                      more time and memory and eliminates the
- *                      performance advantage over other lookup
- *                      methods.  A full search requires dbghelp.dll
- *                      version 6.6 or higher.
+ *                      functions.  Ignored for non-PDB symbols.
  * @param[in] callback  Function to call for each matching symbol found.
  * @param[in] info_size The size of the drsym_info_t struct to pass to \p callback.
  *                      Enough space for each name will be allocated automatically.
@@ -537,7 +543,6 @@ DR_EXPORT
 drsym_error_t
 drsym_search_symbols_ex(const char *modpath, const char *match, bool full,
                         drsym_enumerate_ex_cb callback, size_t info_size, void *data);
-#endif
 
 DR_EXPORT
 /**
@@ -110,6 +110,33 @@ drsym_enumerate_symbols_local(const char *modpath, drsym_enumerate_cb callback,
     return r;
 }
 
+static drsym_error_t
+drsym_search_symbols_local(const char *modpath, const char *match,
+                           drsym_enumerate_cb callback,
+                           drsym_enumerate_ex_cb callback_ex, size_t info_size,
+                           void *data)
+{
+    void *mod;
+    drsym_error_t r;
+
+    if (modpath == NULL || match == NULL || (callback == NULL && callback_ex == NULL))
+        return DRSYM_ERROR_INVALID_PARAMETER;
+
+    dr_recurlock_lock(symbol_lock);
+    mod = lookup_or_load(modpath);
+    if (mod == NULL) {
+        dr_recurlock_unlock(symbol_lock);
+        return DRSYM_ERROR_LOAD_FAILED;
+    }
+
+    recursive_context = true;
+    r = drsym_unix_search_symbols(mod, match, callback, callback_ex, info_size, data);
+    recursive_context = false;
+
+    dr_recurlock_unlock(symbol_lock);
+    return r;
+}
+
 static drsym_error_t
 drsym_lookup_symbol_local(const char *modpath, const char *symbol,
                           size_t *modoffs OUT, uint flags)
@@ -287,6 +314,32 @@ drsym_enumerate_symbols_ex(const char *modpath, drsym_enumerate_ex_cb callback,
     }
 }
 
+DR_EXPORT
+drsym_error_t
+drsym_search_symbols(const char *modpath, const char *match, bool full,
+                     drsym_enumerate_cb callback, void *data)
+{
+    if (IS_SIDELINE) {
+        return DRSYM_ERROR_NOT_IMPLEMENTED;
+    } else {
+        return drsym_search_symbols_local(modpath, match, callback, NULL,
+                                          sizeof(drsym_info_t), data);
+    }
+}
+
+DR_EXPORT
+drsym_error_t
+drsym_search_symbols_ex(const char *modpath, const char *match, bool full,
+                        drsym_enumerate_ex_cb callback, size_t info_size, void *data)
+{
+    if (IS_SIDELINE) {
+        return DRSYM_ERROR_NOT_IMPLEMENTED;
+    } else {
+        return drsym_search_symbols_local(modpath, match, NULL, callback, info_size,
+                                          data);
+    }
+}
+
 DR_EXPORT
 drsym_error_t
 drsym_get_type(const char *modpath, size_t modoffs, uint levels_to_expand,
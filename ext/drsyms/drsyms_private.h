@@ -122,6 +122,11 @@ drsym_unix_enumerate_symbols(void *moddata, drsym_enumerate_cb callback,
                              drsym_enumerate_ex_cb callback_ex, size_t info_size,
                              void *data, uint flags);
 
+drsym_error_t
+drsym_unix_search_symbols(void *moddata, const char *match, drsym_enumerate_cb callback,
+                          drsym_enumerate_ex_cb callback_ex, size_t info_size,
+                          void *data);
+
 size_t
 drsym_unix_demangle_symbol(char *dst OUT, size_t dst_sz, const char *mangled,
                            uint flags);
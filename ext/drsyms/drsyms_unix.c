@@ -43,6 +43,7 @@
 #include "libdwarf.h"
 
 #include <string.h> /* strlen */
+#include <stdlib.h> /* qsort */
 #include <errno.h>
 
 #include "demangle.h"
@@ -57,6 +58,44 @@
 /* For debugging */
 static bool verbose = false;
 
+/* Each set of demangling flags yields a different set of names */
+enum {
+    NAME_INDEX_MANGLED,
+    NAME_INDEX_DEMANGLED,
+    NAME_INDEX_DEMANGLED_FULL,
+    NAME_INDEX_COUNT,
+};
+
+#define NAME_CHUNK_SIZE (64*1024)
+
+typedef struct _name_chunk_t {
+    struct _name_chunk_t *next;
+    size_t size;    /* capacity of buf */
+    size_t used;
+    char buf[1];
+} name_chunk_t;
+
+typedef struct _sorted_name_t {
+    const char *name;
+    uint idx;
+} sorted_name_t;
+
+/* Symbol names as seen under one set of demangling flags.  Each name is
+ * demangled once and kept until the module is unloaded, so repeated
+ * lookups, searches, and enumerations do not demangle again.
+ */
+typedef struct _name_index_t {
+    uint num_syms;
+    /* By symbol index.  Points into the string table for names that were
+     * not demangled, or into chunks.  NULL if the name could not be read.
+     */
+    const char **names;
+    /* Sorted by name and then by symbol index.  Only built for name queries. */
+    sorted_name_t *sorted;
+    uint num_sorted;
+    name_chunk_t *chunks;
+} name_index_t;
+
 typedef struct _dbg_module_t {
     file_t fd;
     size_t file_size;
@@ -70,6 +109,8 @@ typedef struct _dbg_module_t {
      * while the primary mod has symtab+strtab.
      */
     struct _dbg_module_t *mod_with_dwarf;
+    /* Lazily built by get_name_index(), indexed by name_index_kind() */
+    struct _name_index_t *name_index[NAME_INDEX_COUNT];
 } dbg_module_t;
 
 /******************************************************************************
@@ -77,6 +118,7 @@ typedef struct _dbg_module_t {
  */
 
 static void unload_module(dbg_module_t *mod);
+static void name_index_free(name_index_t *index);
 static bool follow_debuglink(const char * modpath, dbg_module_t *mod,
                              const char *debuglink, char debug_modpath[MAXIMUM_PATH]);
 
@@ -260,6 +302,11 @@ follow_debuglink(const char *modpath, dbg_module_t *mod, const char *debuglink,
 static void
 unload_module(dbg_module_t *mod)
 {
+    uint i;
+    for (i = 0; i < NAME_INDEX_COUNT; i++) {
+        if (mod->name_index[i] != NULL)
+            name_index_free(mod->name_index[i]);
+    }
     if (mod->dwarf_info != NULL)
         drsym_dwarf_exit(mod->dwarf_info);
     if (mod->obj_info != NULL)
@@ -273,87 +320,322 @@ unload_module(dbg_module_t *mod)
     dr_global_free(mod, sizeof(*mod));
 }
 
+/******************************************************************************
+ * Name index
+ */
+
+static uint
+name_index_kind(uint flags)
+{
+    if (!TEST(DRSYM_DEMANGLE, flags))
+        return NAME_INDEX_MANGLED;
+    return TEST(DRSYM_DEMANGLE_FULL, flags) ? NAME_INDEX_DEMANGLED_FULL :
+        NAME_INDEX_DEMANGLED;
+}
+
+static const char *
+name_index_strdup(name_index_t *index, const char *str, size_t len)
+{
+    name_chunk_t *chunk = index->chunks;
+    char *res;
+    if (chunk == NULL || chunk->size - chunk->used < len + 1) {
+        size_t size = (len + 1 > NAME_CHUNK_SIZE) ? len + 1 : NAME_CHUNK_SIZE;
+        chunk = (name_chunk_t *) dr_global_alloc(sizeof(*chunk) + NAME_EXTRA_SZ(size));
+        chunk->size = size;
+        chunk->used = 0;
+        chunk->next = index->chunks;
+        index->chunks = chunk;
+    }
+    res = chunk->buf + chunk->used;
+    memcpy(res, str, len);
+    res[len] = '\0';
+    chunk->used += len + 1;
+    return res;
+}
+
+static void
+name_index_free(name_index_t *index)
+{
+    name_chunk_t *chunk, *next;
+    for (chunk = index->chunks; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        dr_global_free(chunk, sizeof(*chunk) + NAME_EXTRA_SZ(chunk->size));
+    }
+    if (index->sorted != NULL)
+        dr_global_free(index->sorted, index->num_syms * sizeof(index->sorted[0]));
+    dr_global_free(index->names, index->num_syms * sizeof(index->names[0]));
+    dr_global_free(index, sizeof(*index));
+}
+
+static name_index_t *
+name_index_create(dbg_module_t *mod, uint kind)
+{
+    name_index_t *index;
+    uint i;
+    char *buf = NULL;
+    size_t buf_size = 1024;  /* C++ symbols can be quite long. */
+    uint flags = (kind == NAME_INDEX_MANGLED ? 0 : DRSYM_DEMANGLE) |
+        (kind == NAME_INDEX_DEMANGLED_FULL ? DRSYM_DEMANGLE_FULL : 0);
+    uint num_syms = drsym_obj_num_symbols(mod->obj_info);
+    if (num_syms == 0)
+        return NULL;
+
+    index = (name_index_t *) dr_global_alloc(sizeof(*index));
+    memset(index, 0, sizeof(*index));
+    index->num_syms = num_syms;
+    index->names = (const char **) dr_global_alloc(num_syms * sizeof(index->names[0]));
+    if (kind != NAME_INDEX_MANGLED)
+        buf = (char *) dr_global_alloc(buf_size);
+    for (i = 0; i < num_syms; i++) {
+        const char *mangled = drsym_obj_symbol_name(mod->obj_info, i);
+        size_t len;
+        index->names[i] = mangled;
+        if (mangled == NULL || kind == NAME_INDEX_MANGLED)
+            continue;
+        /* Resize until it's big enough. */
+        while ((len = drsym_demangle_symbol(buf, buf_size, mangled, flags)) >
+               buf_size) {
+            dr_global_free(buf, buf_size);
+            buf_size = len;
+            buf = (char *) dr_global_alloc(buf_size);
+        }
+        /* On failure we keep the mangled name, as the enumeration always has. */
+        if (len != 0)
+            index->names[i] = name_index_strdup(index, buf, strlen(buf));
+    }
+    if (buf != NULL)
+        dr_global_free(buf, buf_size);
+    NOTIFY("%s: indexed %u names of kind %u\n", __FUNCTION__, num_syms, kind);
+    return index;
+}
+
+static int
+compare_sorted_names(const void *a_in, const void *b_in)
+{
+    const sorted_name_t *a = (const sorted_name_t *) a_in;
+    const sorted_name_t *b = (const sorted_name_t *) b_in;
+    int res = strcmp(a->name, b->name);
+    if (res != 0)
+        return res;
+    /* Keep symbol table order among equal names: lookups return the first. */
+    return (a->idx < b->idx) ? -1 : (a->idx > b->idx ? 1 : 0);
+}
+
+static void
+name_index_sort(name_index_t *index)
+{
+    uint i;
+    index->sorted = (sorted_name_t *)
+        dr_global_alloc(index->num_syms * sizeof(index->sorted[0]));
+    index->num_sorted = 0;
+    for (i = 0; i < index->num_syms; i++) {
+        if (index->names[i] == NULL || index->names[i][0] == '\0')
+            continue;
+        index->sorted[index->num_sorted].name = index->names[i];
+        index->sorted[index->num_sorted].idx = i;
+        index->num_sorted++;
+    }
+    qsort(index->sorted, index->num_sorted, sizeof(index->sorted[0]),
+          compare_sorted_names);
+}
+
+/* Returns NULL if the module has no symbol table */
+static name_index_t *
+get_name_index(dbg_module_t *mod, uint kind, bool sorted)
+{
+    name_index_t *index = mod->name_index[kind];
+    if (index == NULL) {
+        index = name_index_create(mod, kind);
+        if (index == NULL)
+            return NULL;
+        mod->name_index[kind] = index;
+    }
+    if (sorted && index->sorted == NULL)
+        name_index_sort(index);
+    return index;
+}
+
+/* Compares the first key_len chars of name to key and then, unless next
+ * is -1, name's following char to next.  All names matching under this
+ * comparison are adjacent in the sorted array.
+ */
+static int
+compare_name_key(const char *name, const char *key, size_t key_len, int next)
+{
+    int res = strncmp(name, key, key_len);
+    if (res != 0 || next == -1)
+        return res;
+    return (int)(unsigned char) name[key_len] - next;
+}
+
+/* Returns the first sorted entry that is not below the key */
+static uint
+name_index_lower_bound(name_index_t *index, const char *key, size_t key_len, int next)
+{
+    uint lo = 0, hi = index->num_sorted;
+    while (lo < hi) {
+        uint mid = lo + (hi - lo) / 2;
+        if (compare_name_key(index->sorted[mid].name, key, key_len, next) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Finds the first symbol in symbol table order named sym, or whose name
+ * is sym followed by a parameter list.
+ */
+static bool
+name_index_lookup(name_index_t *index, const char *sym, uint *idx OUT)
+{
+    size_t len = strlen(sym);
+    bool found = false;
+    uint i = name_index_lower_bound(index, sym, len, '\0');
+    if (i < index->num_sorted &&
+        compare_name_key(index->sorted[i].name, sym, len, '\0') == 0) {
+        *idx = index->sorted[i].idx;
+        found = true;
+    }
+    /* Left paren means the beginning of the parameter list.  Since the
+     * parameter list starts where our search string ends, we assume the
+     * user doesn't care about possible overloads.
+     */
+    for (i = name_index_lower_bound(index, sym, len, '(');
+         i < index->num_sorted &&
+             compare_name_key(index->sorted[i].name, sym, len, '(') == 0;
+         i++) {
+        if (!found || index->sorted[i].idx < *idx) {
+            *idx = index->sorted[i].idx;
+            found = true;
+        }
+    }
+    return found;
+}
+
+/* Supports '*' for any sequence and '?' for any single char */
+static bool
+glob_match(const char *pattern, const char *str)
+{
+    const char *star = NULL, *star_str = NULL;
+    while (*str != '\0') {
+        if (*pattern == '*') {
+            star = pattern++;
+            star_str = str;
+        } else if (*pattern == '?' || *pattern == *str) {
+            pattern++;
+            str++;
+        } else if (star != NULL) {
+            /* let the last star absorb one more char */
+            pattern = star + 1;
+            str = ++star_str;
+        } else
+            return false;
+    }
+    while (*pattern == '*')
+        pattern++;
+    return *pattern == '\0';
+}
+
 /******************************************************************************
  * Symbol table parsing
  */
 
+/* Passes symbols to an enumeration or search callback */
+typedef struct _symbol_reporter_t {
+    drsym_enumerate_cb callback;
+    drsym_enumerate_ex_cb callback_ex;
+    size_t info_size;
+    void *data;
+    drsym_info_t *out;  /* for callback_ex */
+    size_t name_size;   /* capacity of out's name */
+} symbol_reporter_t;
+
+static void
+reporter_init(symbol_reporter_t *rep, drsym_enumerate_cb callback,
+              drsym_enumerate_ex_cb callback_ex, size_t info_size, void *data)
+{
+    rep->callback = callback;
+    rep->callback_ex = callback_ex;
+    rep->info_size = info_size;
+    rep->data = data;
+    rep->out = NULL;
+    rep->name_size = 0;
+}
+
+static void
+reporter_exit(symbol_reporter_t *rep)
+{
+    if (rep->out != NULL)
+        dr_global_free(rep->out, rep->info_size + NAME_EXTRA_SZ(rep->name_size));
+}
+
+/* Returns whether to keep searching */
+static bool
+report_symbol(dbg_module_t *mod, symbol_reporter_t *rep, uint idx, const char *name,
+              drsym_error_t *res OUT)
+{
+    drsym_info_t *out;
+    char *name_buf;
+    size_t len;
+    if (rep->callback_ex == NULL) {
+        size_t modoffs = 0;
+        *res = drsym_obj_symbol_offs(mod->obj_info, idx, &modoffs, NULL);
+        if (*res != DRSYM_SUCCESS)
+            return false;
+        return rep->callback(name, modoffs, rep->data);
+    }
+
+    len = strlen(name);
+    if (len + 1 > rep->name_size) {
+        reporter_exit(rep);
+        rep->name_size = (len + 1 > 1024) ? len + 1 : 1024;
+        rep->out = (drsym_info_t *)
+            dr_global_alloc(rep->info_size + NAME_EXTRA_SZ(rep->name_size));
+    }
+    out = rep->out;
+    *res = drsym_obj_symbol_offs(mod->obj_info, idx, &out->start_offs, &out->end_offs);
+    if (*res != DRSYM_SUCCESS)
+        return false;
+    name_buf = (rep->info_size == sizeof(drsym_info_t) ? out->name :
+                ((drsym_info_legacy_t *)out)->name);
+    memcpy(name_buf, name, len + 1);
+    out->struct_size = rep->info_size;
+    out->name_size = rep->name_size;
+    out->name_available_size = len;
+    out->debug_kind = mod->debug_kind;
+    if (rep->info_size == sizeof(drsym_info_t))
+        out->type_id = 0; /* NYI */
+    /* We can't get line information w/o doing a separate addr lookup
+     * which may not be the same symbol as this one (not 1-to-1)
+     */
+    return rep->callback_ex(out, DRSYM_ERROR_LINE_NOT_AVAILABLE, rep->data);
+}
+
 static drsym_error_t
 symsearch_symtab(dbg_module_t *mod, drsym_enumerate_cb callback,
                  drsym_enumerate_ex_cb callback_ex, size_t info_size,
                  void *data, uint flags)
 {
-    int num_syms;
-    int i;
+    uint i;
     bool keep_searching = true;
-    char *symbol_buf;
-    size_t symbol_buf_size = 1024;  /* C++ symbols can be quite long. */
     drsym_error_t res = DRSYM_SUCCESS;
-    drsym_info_t *out;
-
-    num_syms = drsym_obj_num_symbols(mod->obj_info);
-    if (num_syms == 0)
+    symbol_reporter_t rep;
+    name_index_t *index = get_name_index(mod, name_index_kind(flags), false);
+    if (index == NULL)
         return DRSYM_ERROR;
 
-    out = (drsym_info_t *) dr_global_alloc(info_size + NAME_EXTRA_SZ(symbol_buf_size));
-
-    for (i = 0; keep_searching && i < num_syms; i++) {
-        const char *mangled = drsym_obj_symbol_name(mod->obj_info, i);
-        const char *unmangled = mangled;  /* Points at mangled or symbol_buf. */
-        size_t modoffs = 0;
-        if (mangled == NULL) {
+    reporter_init(&rep, callback, callback_ex, info_size, data);
+    for (i = 0; keep_searching && i < index->num_syms; i++) {
+        if (index->names[i] == NULL) {
             res = DRSYM_ERROR;
             break;
         }
-
-        if (callback_ex != NULL) {
-            res = drsym_obj_symbol_offs(mod->obj_info, i, &out->start_offs,
-                                        &out->end_offs);
-        } else
-            res = drsym_obj_symbol_offs(mod->obj_info, i, &modoffs, NULL);
+        keep_searching = report_symbol(mod, &rep, i, index->names[i], &res);
         if (res != DRSYM_SUCCESS)
             break;
-
-        symbol_buf = (info_size == sizeof(drsym_info_t) ? out->name :
-                      ((drsym_info_legacy_t *)out)->name);
-        if (TEST(DRSYM_DEMANGLE, flags)) {
-            size_t len;
-            /* Resize until it's big enough. */
-            while ((len = drsym_demangle_symbol(symbol_buf, symbol_buf_size,
-                                                mangled, flags))
-                   > symbol_buf_size) {
-                dr_global_free(out, info_size + NAME_EXTRA_SZ(symbol_buf_size));
-                symbol_buf_size = len;
-                out = (drsym_info_t *)
-                    dr_global_alloc(info_size + NAME_EXTRA_SZ(symbol_buf_size));
-                symbol_buf = (info_size == sizeof(drsym_info_t) ? out->name :
-                              ((drsym_info_legacy_t *)out)->name);
-            }
-            if (len != 0) {
-                /* Success. */
-                unmangled = symbol_buf;
-            }
-        } else if (callback_ex != NULL) {
-            strncpy(symbol_buf, unmangled, symbol_buf_size);
-            symbol_buf[symbol_buf_size - 1] = '\0';
-        }
-
-        if (callback_ex != NULL) {
-            out->struct_size = info_size;
-            out->name_size = symbol_buf_size;
-            out->name_available_size = strlen(symbol_buf);
-            out->debug_kind = mod->debug_kind;
-            if (info_size == sizeof(drsym_info_t))
-                out->type_id = 0; /* NYI */
-            /* We can't get line information w/o doing a separate addr lookup
-             * which may not be the same symbol as this one (not 1-to-1)
-             */
-            keep_searching = callback_ex(out, DRSYM_ERROR_LINE_NOT_AVAILABLE, data);
-        } else
-            keep_searching = callback(unmangled, modoffs, data);
     }
-
-    dr_global_free(out, info_size + NAME_EXTRA_SZ(symbol_buf_size));
-
+    reporter_exit(&rep);
     return res;
 }
 
@@ -364,6 +646,7 @@ addrsearch_symtab(dbg_module_t *mod, size_t modoffs, drsym_info_t *info INOUT,
     const char *symbol;
     size_t name_len = 0;
     uint idx;
+    name_index_t *index = mod->name_index[name_index_kind(flags)];
     drsym_error_t res = drsym_obj_addrsearch_symtab(mod->obj_info, modoffs, &idx);
 
     if (res != DRSYM_SUCCESS)
@@ -373,7 +656,10 @@ addrsearch_symtab(dbg_module_t *mod, size_t modoffs, drsym_info_t *info INOUT,
     if (symbol == NULL)
         return DRSYM_ERROR;
 
-    if (TEST(DRSYM_DEMANGLE, flags)) {
+    if (index != NULL) {
+        /* A name query already demangled it */
+        symbol = index->names[idx];
+    } else if (TEST(DRSYM_DEMANGLE, flags)) {
         name_len = drsym_demangle_symbol(info->name, info->name_size, symbol, flags);
     }
     if (name_len == 0) {
@@ -429,34 +715,49 @@ drsym_unix_enumerate_symbols(void *mod_in, drsym_enumerate_cb callback,
     return symsearch_symtab(mod, callback, callback_ex, info_size, data, flags);
 }
 
-/* Params to sym_lookup_cb passed through data. */
-typedef struct _sym_lookup_params_t {
-    const char *search_sym;
-    size_t search_sym_len;
-    size_t *modoffs;
-} sym_lookup_params_t;
+drsym_error_t
+drsym_unix_search_symbols(void *mod_in, const char *match, drsym_enumerate_cb callback,
+                          drsym_enumerate_ex_cb callback_ex, size_t info_size,
+                          void *data)
+{
+    dbg_module_t *mod = (dbg_module_t *) mod_in;
+    name_index_t *index;
+    const char *pattern;
+    size_t prefix_len;
+    uint i;
+    bool keep_searching = true;
+    drsym_error_t res = DRSYM_SUCCESS;
+    symbol_reporter_t rep;
+
+    if (info_size != sizeof(drsym_info_t) &&
+        info_size != sizeof(drsym_info_legacy_t))
+        return DRSYM_ERROR_INVALID_SIZE;
+    /* As with lookups, we ignore any module portion of the pattern */
+    pattern = strchr(match, '!');
+    if (pattern != NULL)
+        pattern++;
+    else
+        pattern = match;
 
-/* Symbol enumeration callback for doing a single lookup.
- */
-static bool
-sym_lookup_cb(const char *sym, size_t modoffs, void *data INOUT)
-{
-    sym_lookup_params_t *p = (sym_lookup_params_t*)data;
-
-    if (strncmp(sym, p->search_sym, p->search_sym_len) == 0 &&
-        strlen(sym) >= p->search_sym_len &&
-        (sym[p->search_sym_len] == '\0' ||
-         /* Left paren means the beginning of the parameter list.  Since the
-          * parameter list starts where our search string ends, we assume the
-          * user doesn't care about possible overloads.
-          */
-         sym[p->search_sym_len] == '(')) {
-        NOTIFY("Looked up symbol: %s %s\n", p->search_sym, sym);
-        *p->modoffs = modoffs;
-        /* Stop after the first match. */
-        return false;
+    index = get_name_index(mod, NAME_INDEX_DEMANGLED, true);
+    if (index == NULL)
+        return DRSYM_ERROR;
+    /* Only the names starting with the pattern's literal prefix can match */
+    prefix_len = strcspn(pattern, "*?");
+    i = (prefix_len == 0) ? 0 : name_index_lower_bound(index, pattern, prefix_len, -1);
+    reporter_init(&rep, callback, callback_ex, info_size, data);
+    for (; keep_searching && i < index->num_sorted; i++) {
+        const char *name = index->sorted[i].name;
+        if (prefix_len > 0 && strncmp(name, pattern, prefix_len) != 0)
+            break;
+        if (!glob_match(pattern, name))
+            continue;
+        keep_searching = report_symbol(mod, &rep, index->sorted[i].idx, name, &res);
+        if (res != DRSYM_SUCCESS)
+            break;
     }
-    return true;
+    reporter_exit(&rep);
+    return res;
 }
 
 drsym_error_t
@@ -466,7 +767,6 @@ drsym_unix_lookup_symbol(void *mod_in, const char *symbol, size_t *modoffs OUT,
     dbg_module_t *mod = (dbg_module_t *) mod_in;
     drsym_error_t r;
     const char *sym_no_mod;
-    sym_lookup_params_t params;
 
     if (symbol == NULL) {
         sym_no_mod = NULL;
@@ -497,13 +797,16 @@ drsym_unix_lookup_symbol(void *mod_in, const char *symbol, size_t *modoffs OUT,
     }
 
     if (*modoffs == 0) {
-        params.search_sym = sym_no_mod;
-        params.search_sym_len = strlen(sym_no_mod);
-        params.modoffs = modoffs;
-        r = drsym_unix_enumerate_symbols(mod, sym_lookup_cb, NULL, sizeof(drsym_info_t),
-                                         &params, flags);
-        if (r != DRSYM_SUCCESS)
-            return r;
+        name_index_t *index = get_name_index(mod, name_index_kind(flags), true);
+        uint idx;
+        if (index == NULL)
+            return DRSYM_ERROR;
+        if (name_index_lookup(index, sym_no_mod, &idx)) {
+            NOTIFY("Looked up symbol: %s %s\n", sym_no_mod, index->names[idx]);
+            r = drsym_obj_symbol_offs(mod->obj_info, idx, modoffs, NULL);
+            if (r != DRSYM_SUCCESS)
+                return r;
+        }
     }
     if (*modoffs == 0)
         return DRSYM_ERROR_SYMBOL_NOT_FOUND;
@@ -667,12 +667,12 @@ drsym_search_symbols_local(const char *modpath, const char *match, bool full,
     mod = lookup_or_load(modpath, true/*use dbghelp*/);
     if (mod == NULL)
         res = DRSYM_ERROR_LOAD_FAILED;
-    else if (mod->use_pecoff_symtable)
-        /* pecoff doesn't support search, and the enumerate impl in
-         * drsyms_unix.c doesn't take a pattern
-         */
-        res = DRSYM_ERROR_NOT_IMPLEMENTED;
-    else {
+    else if (mod->use_pecoff_symtable) {
+        recursive_context = true;
+        res = drsym_unix_search_symbols(mod->u.pecoff_data, match, callback,
+                                        callback_ex, info_size, data);
+        recursive_context = false;
+    } else {
         enum_info_t info;
         if (func == NULL) {
             /* if we fail to find it we'll pay the lookup cost every time,
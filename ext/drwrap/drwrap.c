@@ -712,9 +712,6 @@ drwrap_event_bb_insert(void *drcontext, void *tag, instrlist_t *bb, instr_t *ins
 static void
 drwrap_event_module_unload(void *drcontext, const module_data_t *info);
 
-static void
-drwrap_fragment_delete(void *dc/*may be NULL*/, void *tag);
-
 static inline void
 drwrap_in_callee_check_unwind(void *drcontext, per_thread_t *pt, dr_mcontext_t *mc);
 
@@ -785,7 +782,6 @@ drwrap_init(void)
     post_call_rwlock = dr_rwlock_create();
     wrap_lock = dr_recurlock_create();
     drmgr_register_module_unload_event(drwrap_event_module_unload);
-    dr_register_delete_event(drwrap_fragment_delete);
 
     tls_idx = drmgr_register_tls_field();
     if (tls_idx == -1)
@@ -1933,12 +1929,6 @@ drwrap_event_module_unload(void *drcontext, const module_data_t *info)
     dr_rwlock_write_unlock(post_call_rwlock);
 }
 
-static void
-drwrap_fragment_delete(void *dc/*may be NULL*/, void *tag)
-{
-    /* switched to checking consistency at lookup time (DrMemi#673) */
-}
-
 DR_EXPORT
 bool
 drwrap_wrap_ex(app_pc func,
@@ -0,0 +1,140 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Tests dr_insert_clean_call_if().  With the "trace" option, the blocks with
+ * cold code must still become traces, whose cold runs end up after the final
+ * exit of the trace, and a cold call from the trace event is added as well.
+ */
+
+#include "dr_api.h"
+#include <string.h>
+
+static int five = 5;
+static bool trace_mode;
+static bool called_eq, called_ne, called_below, called_cold, called_trace_cold;
+static bool called_cold_in_trace;
+
+static void
+on_eq(void)
+{
+    called_eq = true;
+}
+
+static void
+on_ne(void)
+{
+    called_ne = true;
+}
+
+static void
+on_below(int arg)
+{
+    if (arg == 42)
+        called_below = true;
+}
+
+static void
+on_cold(int in_trace)
+{
+    called_cold = true;
+    if (in_trace)
+        called_cold_in_trace = true;
+}
+
+static void
+on_trace_cold(void)
+{
+    called_trace_cold = true;
+}
+
+static dr_emit_flags_t
+bb_event(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, bool translating)
+{
+    /* Insert before the last instr, which is often a jcc reading the flags
+     * set just before it, to test that the checks preserve them.
+     */
+    instr_t *where = instrlist_last(bb);
+    instr_t *in, *prev;
+    dr_insert_clean_call_if(drcontext, bb, where, OPND_CREATE_ABSMEM(&five, OPSZ_4),
+                            5, OP_jz, (void *) on_eq, 0, 0);
+    dr_insert_clean_call_if(drcontext, bb, where, OPND_CREATE_ABSMEM(&five, OPSZ_4),
+                            5, OP_jnz, (void *) on_ne, 0, 0);
+    dr_insert_clean_call_if(drcontext, bb, where, OPND_CREATE_ABSMEM(&five, OPSZ_1),
+                            6, OP_jb, (void *) on_below, 0, 1, OPND_CREATE_INT32(42));
+    /* An unconditional cold run must still execute once moved out of line. */
+    prev = instr_get_prev(where);
+    dr_insert_clean_call(drcontext, bb, where, (void *) on_cold, false, 1,
+                         OPND_CREATE_INT32(for_trace ? 1 : 0));
+    for (in = instr_get_next(prev); in != where; in = instr_get_next(in))
+        instr_set_cold(in, true);
+    return DR_EMIT_DEFAULT;
+}
+
+static dr_emit_flags_t
+trace_event(void *drcontext, void *tag, instrlist_t *trace, bool translating)
+{
+    /* Trace exit ctis are only mangled after this event, so the cold runs
+     * from the blocks and this one all end up after the trace's final exit.
+     */
+    instr_t *where = instrlist_last(trace);
+    instr_t *in, *prev = instr_get_prev(where);
+    dr_insert_clean_call(drcontext, trace, where, (void *) on_trace_cold, false, 0);
+    for (in = instr_get_next(prev); in != where; in = instr_get_next(in))
+        instr_set_cold(in, true);
+    return DR_EMIT_DEFAULT;
+}
+
+static void
+event_exit(void)
+{
+    dr_fprintf(STDERR, "eq called: %s\n", called_eq ? "yes" : "no");
+    dr_fprintf(STDERR, "ne called: %s\n", called_ne ? "yes" : "no");
+    dr_fprintf(STDERR, "below called: %s\n", called_below ? "yes" : "no");
+    dr_fprintf(STDERR, "cold called: %s\n", called_cold ? "yes" : "no");
+    if (trace_mode) {
+        dr_fprintf(STDERR, "cold called in trace: %s\n",
+                   called_cold_in_trace ? "yes" : "no");
+        dr_fprintf(STDERR, "trace cold called: %s\n", called_trace_cold ? "yes" : "no");
+    }
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    const char *options = dr_get_options(id);
+    if (options != NULL && strstr(options, "trace") != NULL) {
+        trace_mode = true;
+        dr_register_trace_event(trace_event);
+    }
+    dr_register_bb_event(bb_event);
+    dr_register_exit_event(event_exit);
+}
@@ -37,6 +37,11 @@
 #include "drmgr.h"
 #include <string.h> /* memset */
 
+/* We use a raw bb event only to inspect the result of drmgr's optimization,
+ * which no drmgr event can observe.
+ */
+#undef dr_register_bb_event
+
 #define CHECK(x, msg) do {               \
     if (!(x)) {                          \
         dr_fprintf(STDERR, "CHECK failed %s:%d: %s\n", __FILE__, __LINE__, msg); \
@@ -65,6 +70,13 @@ static bool checked_cls_from_cache;
 static bool checked_tls_write_from_cache;
 static bool checked_cls_write_from_cache;
 
+/* two passes whose flags preservation drmgr's optimization merges */
+static uint count_A;
+static uint count_B;
+/* arithmetic flags saves seen before and after drmgr's optimization */
+static int flags_saves_before;
+static int flags_saves_after;
+
 static void event_exit(void);
 static void event_thread_init(void *drcontext);
 static void event_thread_exit(void *drcontext);
@@ -82,6 +94,17 @@ static dr_emit_flags_t event_bb_insert(void *drcontext, void *tag, instrlist_t *
                                        instr_t *inst, bool for_trace, bool translating,
                                        void *user_data);
 
+static dr_emit_flags_t event_bb_count_A(void *drcontext, void *tag, instrlist_t *bb,
+                                        instr_t *inst, bool for_trace, bool translating,
+                                        void *user_data);
+static dr_emit_flags_t event_bb_count_B(void *drcontext, void *tag, instrlist_t *bb,
+                                        instr_t *inst, bool for_trace, bool translating,
+                                        void *user_data);
+
+static dr_emit_flags_t event_bb_after_drmgr(void *drcontext, void *tag,
+                                            instrlist_t *bb, bool for_trace,
+                                            bool translating);
+
 static dr_emit_flags_t event_bb4_app2app(void *drcontext, void *tag, instrlist_t *bb,
                                          bool for_trace, bool translating,
                                          OUT void **user_data);
@@ -100,11 +123,19 @@ dr_init(client_id_t id)
 {
     drmgr_priority_t priority = {sizeof(priority), "drmgr-test", NULL, NULL, 0};
     drmgr_priority_t priority4 = {sizeof(priority), "drmgr-test4", NULL, NULL, 0};
+    drmgr_priority_t priority_A = {sizeof(priority), "drmgr-test-count-A",
+                                   NULL, NULL, 0};
+    drmgr_priority_t priority_B = {sizeof(priority), "drmgr-test-count-B",
+                                   NULL, "drmgr-test-count-A", 0};
     drmgr_priority_t sys_pri_A = {sizeof(priority), "drmgr-test-A", NULL, NULL, 0};
     drmgr_priority_t sys_pri_B = {sizeof(priority), "drmgr-test-B",
                                   "drmgr-test-A", NULL, 0};
     bool ok;
 
+    /* DR calls the most recently registered bb event first, so registering
+     * before drmgr_init() lets us see the optimized result.
+     */
+    dr_register_bb_event(event_bb_after_drmgr);
     drmgr_init();
     dr_register_exit_event(event_exit);
     drmgr_register_thread_init_event(event_thread_init);
@@ -122,6 +153,14 @@ dr_init(client_id_t id)
                                                     event_bb4_instru2instru,
                                                     &priority4);
 
+    ok = drmgr_register_bb_instrumentation_event(event_bb_analysis, event_bb_count_A,
+                                                 &priority_A) &&
+        drmgr_register_bb_instrumentation_event(event_bb_analysis, event_bb_count_B,
+                                                &priority_B);
+    CHECK(ok, "drmgr register bb failed");
+    ok = drmgr_enable_instru_optimization(true);
+    CHECK(ok, "drmgr_enable_instru_optimization failed");
+
     tls_idx = drmgr_register_tls_field();
     CHECK(tls_idx != -1, "drmgr_register_tls_field failed");
     cls_idx = drmgr_register_cls_field(event_thread_context_init,
@@ -147,6 +186,9 @@ event_exit(void)
     CHECK(checked_cls_from_cache, "failed to hit clean call");
     CHECK(checked_tls_write_from_cache, "failed to hit clean call");
     CHECK(checked_cls_write_from_cache, "failed to hit clean call");
+    CHECK(count_A > 0 && count_A == count_B, "optimized counters disagree");
+    CHECK(flags_saves_after < flags_saves_before, "flags saves were not merged");
+    CHECK(drmgr_enable_instru_optimization(false), "failed to disable optimization");
     drmgr_unregister_cls_field(event_thread_context_init,
                                event_thread_context_exit,
                                cls_idx);
@@ -294,6 +336,56 @@ event_bb_insert(void *drcontext, void *tag, instrlist_t *bb, instr_t *inst,
     return DR_EMIT_DEFAULT;
 }
 
+static void
+insert_count(void *drcontext, instrlist_t *bb, instr_t *inst, uint *counter)
+{
+    dr_save_reg(drcontext, bb, inst, DR_REG_XAX, SPILL_SLOT_1);
+    dr_save_arith_flags_to_xax(drcontext, bb, inst);
+    instrlist_meta_preinsert(bb, inst, LOCK(INSTR_CREATE_inc
+                                            (drcontext,
+                                             OPND_CREATE_ABSMEM(counter, OPSZ_4))));
+    dr_restore_arith_flags_from_xax(drcontext, bb, inst);
+    dr_restore_reg(drcontext, bb, inst, DR_REG_XAX, SPILL_SLOT_1);
+}
+
+static int
+count_flags_saves(instrlist_t *bb)
+{
+    instr_t *inst;
+    int count = 0;
+    for (inst = instrlist_first(bb); inst != NULL; inst = instr_get_next(inst)) {
+        if (!instr_ok_to_mangle(inst) && instr_get_opcode(inst) == OP_lahf)
+            count++;
+    }
+    return count;
+}
+
+static dr_emit_flags_t
+event_bb_after_drmgr(void *drcontext, void *tag, instrlist_t *bb,
+                     bool for_trace, bool translating)
+{
+    dr_atomic_add32_return_sum(&flags_saves_after, count_flags_saves(bb));
+    return DR_EMIT_DEFAULT;
+}
+
+static dr_emit_flags_t
+event_bb_count_A(void *drcontext, void *tag, instrlist_t *bb, instr_t *inst,
+                 bool for_trace, bool translating, void *user_data)
+{
+    if (inst == (instr_t*)user_data/*first instr*/)
+        insert_count(drcontext, bb, inst, &count_A);
+    return DR_EMIT_DEFAULT;
+}
+
+static dr_emit_flags_t
+event_bb_count_B(void *drcontext, void *tag, instrlist_t *bb, instr_t *inst,
+                 bool for_trace, bool translating, void *user_data)
+{
+    if (inst == (instr_t*)user_data/*first instr*/)
+        insert_count(drcontext, bb, inst, &count_B);
+    return DR_EMIT_DEFAULT;
+}
+
 /* test data passed among all 4 phases */
 static dr_emit_flags_t
 event_bb4_app2app(void *drcontext, void *tag, instrlist_t *bb,
@@ -328,6 +420,8 @@ event_bb4_instru2instru(void *drcontext, void *tag, instrlist_t *bb,
                         void *user_data)
 {
     CHECK(user_data == (void *) ((ptr_uint_t)tag + 1), "user data not preserved");
+    /* runs after all insertion but before drmgr's optimization */
+    dr_atomic_add32_return_sum(&flags_saves_before, count_flags_saves(bb));
     return DR_EMIT_DEFAULT;
 }
 
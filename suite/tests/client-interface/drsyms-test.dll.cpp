@@ -718,17 +718,21 @@ enum_syms_with_flags(const char *dll_path, const char **syms_expected,
                                    sizeof(drsym_info_legacy_t), NULL, flags);
     ASSERT(r == DRSYM_SUCCESS);
 
-#ifdef WINDOWS
-    if (TEST(DRSYM_PDB, debug_kind)) {
+    {
         /* drsym_search_symbols should find the same symbols with the short
          * mangling, regardless of the flags used by the previous enumerations.
+         * For ELF and PECOFF a pattern starting with a literal exercises the
+         * sorted name index; PDB searches keep the original pattern.
          */
+        const char *stack_trace_pattern = TEST(DRSYM_PDB, debug_kind) ?
+            "*!*stack_trace*" : "*!stack_trace*";
         memset(&syms_found, 0, sizeof(syms_found));
-        syms_found.syms_expected = dll_syms_short_pdb;
+        syms_found.syms_expected = TEST(DRSYM_PDB, debug_kind) ? dll_syms_short_pdb :
+            dll_syms_short;
         r = drsym_search_symbols(dll_path, "*!*dll_*", false, enum_sym_cb,
                                  &syms_found);
         ASSERT(r == DRSYM_SUCCESS);
-        r = drsym_search_symbols(dll_path, "*!*stack_trace*", false, enum_sym_cb,
+        r = drsym_search_symbols(dll_path, stack_trace_pattern, false, enum_sym_cb,
                                  &syms_found);
         ASSERT(r == DRSYM_SUCCESS);
         for (i = 0; i < BUFFER_SIZE_ELEMENTS(syms_found.syms_found); i++) {
@@ -742,7 +746,7 @@ enum_syms_with_flags(const char *dll_path, const char **syms_expected,
         r = drsym_search_symbols_ex(dll_path, "*!*dll_*", false, enum_sym_ex_cb,
                                     sizeof(drsym_info_t), &syms_found);
         ASSERT(r == DRSYM_SUCCESS);
-        r = drsym_search_symbols_ex(dll_path, "*!*stack_trace*", false, enum_sym_ex_cb,
+        r = drsym_search_symbols_ex(dll_path, stack_trace_pattern, false, enum_sym_ex_cb,
                                     sizeof(drsym_info_t), &syms_found);
         ASSERT(r == DRSYM_SUCCESS);
         for (i = 0; i < BUFFER_SIZE_ELEMENTS(syms_found.syms_found); i++) {
@@ -754,7 +758,6 @@ enum_syms_with_flags(const char *dll_path, const char **syms_expected,
                                     sizeof(drsym_info_legacy_t), NULL);
         ASSERT(r == DRSYM_SUCCESS);
     }
-#endif
 }
 
 
@@ -0,0 +1,107 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Tests the drworker pool in the drcontainers extension */
+
+#include "dr_api.h"
+#include "drworker.h"
+
+#define CHECK(x, msg) do {               \
+    if (!(x)) {                          \
+        dr_fprintf(STDERR, "%s\n", msg); \
+        dr_abort();                      \
+    }                                    \
+} while (0);
+
+#define NUM_WORKERS 3
+#define NUM_PARENTS 64
+#define CHILDREN_PER_PARENT 16
+
+static void *pool;
+static volatile int tasks_submitted;
+static volatile int tasks_run;
+
+static void
+leaf_task(void *arg)
+{
+    dr_atomic_add32_return_sum(&tasks_run, 1);
+}
+
+static void
+parent_task(void *arg)
+{
+    int i;
+    /* tests submission from a worker, which goes to its own deque */
+    for (i = 0; i < CHILDREN_PER_PARENT; i++) {
+        dr_atomic_add32_return_sum(&tasks_submitted, 1);
+        CHECK(drworker_submit(pool, leaf_task, NULL), "submit failed");
+    }
+    dr_atomic_add32_return_sum(&tasks_run, 1);
+}
+
+static dr_emit_flags_t
+event_basic_block(void *drcontext, void *tag, instrlist_t *bb,
+                  bool for_trace, bool translating)
+{
+    /* tests submission from application threads */
+    dr_atomic_add32_return_sum(&tasks_submitted, 1);
+    CHECK(drworker_submit(pool, (tasks_submitted % 8 == 0) ? parent_task : leaf_task,
+                          NULL), "submit failed");
+    return DR_EMIT_DEFAULT;
+}
+
+static void
+event_exit(void)
+{
+    drworker_pool_destroy(pool);
+    CHECK(tasks_run == tasks_submitted, "tasks lost at exit");
+    dr_fprintf(STDERR, "drworker destroy passed\n");
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    int i;
+    pool = drworker_pool_create(NUM_WORKERS);
+    CHECK(pool != NULL, "pool creation failed");
+    for (i = 0; i < NUM_PARENTS; i++) {
+        dr_atomic_add32_return_sum(&tasks_submitted, 1);
+        CHECK(drworker_submit(pool, parent_task, NULL), "submit failed");
+    }
+    drworker_pool_flush(pool);
+    CHECK(tasks_run == NUM_PARENTS * (1 + CHILDREN_PER_PARENT), "flush incomplete");
+    CHECK(tasks_run == tasks_submitted, "flush incomplete");
+    dr_fprintf(STDERR, "drworker flush passed\n");
+
+    dr_register_bb_event(event_basic_block);
+    dr_register_exit_event(event_exit);
+}
@@ -55,6 +55,9 @@
 # define EVENTS "events"
 #endif
 
+/* how many trace components the trace event checks */
+#define MAX_TRACE_TAGS 64
+
 void *mutex;
 
 enum event_seq {
@@ -272,6 +275,28 @@ dr_emit_flags_t trace_event2(void *dcontext, void *tag, instrlist_t *trace,
                              bool translating)
 {
     inc_count_second(EVENT_TRACE_2);
+    if (!translating) {
+        void *tags[MAX_TRACE_TAGS];
+        uint64 count, count_indir, threshold;
+        uint i, num = dr_trace_component_tags(dcontext, tags, MAX_TRACE_TAGS);
+        if (num == 0 || tags[0] != tag)
+            dr_fprintf(STDERR, "trace component tags are wrong!\n");
+        if (!dr_get_integer_option("trace_threshold", &threshold) ||
+            dr_trace_head_count(dcontext) < threshold)
+            dr_fprintf(STDERR, "trace head count is wrong!\n");
+        /* each block but the last ran once during selection, exiting to the next */
+        for (i = 0; i + 1 < num && i + 1 < MAX_TRACE_TAGS; i++) {
+            if (!dr_trace_component_exit_count(dcontext, i, tags[i+1], &count) ||
+                !dr_trace_component_exit_count(dcontext, i, NULL, &count_indir) ||
+                count + count_indir != 1)
+                dr_fprintf(STDERR, "exit count to next block is wrong!\n");
+            if (!dr_trace_component_exit_count(dcontext, i, (void *)&count, &count) ||
+                count != 0)
+                dr_fprintf(STDERR, "exit count for untaken exit is wrong!\n");
+        }
+        if (dr_trace_component_exit_count(dcontext, num, NULL, &count))
+            dr_fprintf(STDERR, "exit count for bad index should fail!\n");
+    }
     if (!dr_unregister_trace_event(trace_event2))
         dr_fprintf(STDERR, "unregister failed!\n");
     return DR_EMIT_DEFAULT;
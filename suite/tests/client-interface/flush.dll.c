@@ -48,6 +48,9 @@ static bool delay_flush_at_next_build = false;
 
 static int bb_build_count = 0;
 static uint callback_count = 0;
+static uint delete_count = 0;
+static uint batch_delete_count = 0;
+static uint max_batch_size = 0;
 
 /* Keep a list that tracks which tags have been created and deleted.
  * We need to make sure we're informed of all flushed fragments.
@@ -152,6 +155,17 @@ void exit_event(void)
     }
 
     dr_fprintf(STDERR, "%d undeleted fragments\n", count);
+    if (delete_count == batch_delete_count)
+        dr_fprintf(STDERR, "batched deletions match\n");
+    else {
+        dr_fprintf(STDERR, "ERROR: %d deletions but %d batched\n",
+                   delete_count, batch_delete_count);
+    }
+    /* a flush or the exit deletion should deliver many tags at once */
+    if (max_batch_size > 1)
+        dr_fprintf(STDERR, "deletions were batched\n");
+    else
+        dr_fprintf(STDERR, "ERROR: largest deletion batch was %d\n", max_batch_size);
     /* get around nondeterminism */
     if (bb_build_count >= 5 && bb_build_count <= 15)
         dr_fprintf(STDERR, "constructed BB 5-15 times\n");
@@ -172,6 +186,20 @@ static
 void deleted_event(void *dcontext, void *tag)
 {
     decrement(tag);
+    delete_count++;
+}
+
+static
+void deleted_batch_event(void *dcontext, void **tags, uint num_tags,
+                         app_pc range_start, app_pc range_end)
+{
+    if (num_tags == 0)
+        dr_fprintf(STDERR, "ERROR: empty deletion batch\n");
+    if (range_start > range_end)
+        dr_fprintf(STDERR, "ERROR: invalid deletion batch range\n");
+    batch_delete_count += num_tags;
+    if (num_tags > max_batch_size)
+        max_batch_size = num_tags;
 }
 
 void flush_event(int flush_id)
@@ -293,6 +321,7 @@ void dr_init(client_id_t id)
     dr_register_exit_event(exit_event);
     dr_register_trace_event(trace_event);
     dr_register_delete_event(deleted_event);
+    dr_register_delete_batch_event(deleted_batch_event);
     dr_register_bb_event(bb_event);
     
 }
@@ -0,0 +1,73 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Application for the dr_prepopulate_cache() test.  The client builds the
+ * entry blocks of the library's functions as soon as the library is loaded,
+ * so calling them must not raise another basic block event.
+ */
+
+#include "tools.h"
+#ifdef LINUX
+# include <dlfcn.h>
+#endif
+
+typedef int (*func_t)(int);
+
+int
+main(int argc, char **argv)
+{
+    func_t prepop_a, prepop_b;
+#ifdef LINUX
+    void *hmod = dlopen(argv[1], RTLD_NOW|RTLD_LOCAL);
+    if (hmod == NULL) {
+        print("module load failed: %s\n", dlerror());
+        return 1;
+    }
+    prepop_a = (func_t) dlsym(hmod, "prepop_a");
+    prepop_b = (func_t) dlsym(hmod, "prepop_b");
+#else
+    HMODULE hmod = LoadLibrary(argv[1]);
+    if (hmod == NULL) {
+        print("LoadLibrary failed: %x\n", GetLastError());
+        return 1;
+    }
+    prepop_a = (func_t) GetProcAddress(hmod, "prepop_a");
+    prepop_b = (func_t) GetProcAddress(hmod, "prepop_b");
+#endif
+    if (prepop_a == NULL || prepop_b == NULL) {
+        print("function lookup failed\n");
+        return 1;
+    }
+    print("prepop_a(1) = %d\n", prepop_a(1));
+    print("prepop_b(2) = %d\n", prepop_b(2));
+    return 0;
+}
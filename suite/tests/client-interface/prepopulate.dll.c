@@ -0,0 +1,131 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Tests dr_prepopulate_cache(): the entry blocks of the library's functions
+ * are built at the first system call after the library is mapped, and the
+ * application's later calls must use those blocks without another basic
+ * block event.
+ */
+
+#include "dr_api.h"
+#include <string.h>
+
+#define NUM_TAGS 2
+
+static app_pc tags[NUM_TAGS];
+static bool have_tags, prepopulated, prepopulating;
+static bool prepop_ok, extra_bb_event;
+static int tag_executions;
+
+static void
+at_tag(void)
+{
+    tag_executions++;
+}
+
+static bool
+is_tag(void *tag)
+{
+    int i;
+    for (i = 0; i < NUM_TAGS; i++) {
+        if (tags[i] == (app_pc) tag)
+            return true;
+    }
+    return false;
+}
+
+static dr_emit_flags_t
+bb_event(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, bool translating)
+{
+    if (!have_tags || !is_tag(tag))
+        return DR_EMIT_DEFAULT;
+    if (!for_trace && !translating && !prepopulating)
+        extra_bb_event = true;
+    dr_insert_clean_call(drcontext, bb, instrlist_first(bb), (void *) at_tag, false, 0);
+    return DR_EMIT_DEFAULT;
+}
+
+static void
+module_load_event(void *drcontext, const module_data_t *info, bool loaded)
+{
+    const char *name = dr_module_preferred_name(info);
+    if (name != NULL && strstr(name, "prepopulate.appdll") != NULL) {
+        tags[0] = (app_pc) dr_get_proc_address(info->handle, "prepop_a");
+        tags[1] = (app_pc) dr_get_proc_address(info->handle, "prepop_b");
+        have_tags = (tags[0] != NULL && tags[1] != NULL);
+    }
+}
+
+static bool
+filter_syscall_event(void *drcontext, int sysnum)
+{
+    return true;
+}
+
+static bool
+pre_syscall_event(void *drcontext, int sysnum)
+{
+    uint prot;
+    int i;
+    if (!have_tags || prepopulated)
+        return true;
+    /* The load event can come before every segment is mapped executable. */
+    for (i = 0; i < NUM_TAGS; i++) {
+        if (!dr_query_memory(tags[i], NULL, NULL, &prot) ||
+            (prot & DR_MEMPROT_EXEC) == 0)
+            return true;
+    }
+    prepopulating = true;
+    prepop_ok = dr_prepopulate_cache(tags, NUM_TAGS);
+    prepopulating = false;
+    prepopulated = true;
+    return true;
+}
+
+static void
+event_exit(void)
+{
+    dr_fprintf(STDERR, "prepopulated: %s\n", (prepopulated && prepop_ok) ? "yes" : "no");
+    dr_fprintf(STDERR, "bb event for prepopulated tag: %s\n",
+               extra_bb_event ? "yes" : "no");
+    dr_fprintf(STDERR, "prepopulated blocks executed: %d\n", tag_executions);
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    dr_register_bb_event(bb_event);
+    dr_register_module_load_event(module_load_event);
+    dr_register_filter_syscall_event(filter_syscall_event);
+    dr_register_pre_syscall_event(pre_syscall_event);
+    dr_register_exit_event(event_exit);
+}
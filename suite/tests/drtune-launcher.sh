@@ -0,0 +1,18 @@
+#!/bin/sh
+# Stands in for drrun in the drtune test (see drtune.cmake): checks the
+# arguments drtune passes and prints a release statistics block in the format
+# of -rstats_to_stderr before running the app.
+[ "$1" = "-ops" ] && [ "$3" = "--" ] || exit 1
+case "$2" in
+  "-foo 1 "*" -rstats_to_stderr") ;;
+  *) exit 1 ;;
+esac
+case "$2" in
+  *"-max_trace_bbs 32 "*) value=1 ;;
+  *) value=100 ;;
+esac
+shift 3
+echo "(Begin) Release statistics" >&2
+printf '\tnum_fake = %d\n' $value >&2
+echo "(End) Release statistics" >&2
+exec "$@"
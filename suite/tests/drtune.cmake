@@ -0,0 +1,58 @@
+# **********************************************************
+# Copyright (c) 2013 Google, Inc.  All rights reserved.
+# **********************************************************
+
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 
+# * Redistributions of source code must retain the above copyright notice,
+#   this list of conditions and the following disclaimer.
+# 
+# * Redistributions in binary form must reproduce the above copyright notice,
+#   this list of conditions and the following disclaimer in the documentation
+#   and/or other materials provided with the distribution.
+# 
+# * Neither the name of Google, Inc. nor the names of its contributors may be
+#   used to endorse or promote products derived from this software without
+#   specific prior written permission.
+# 
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+# DAMAGE.
+
+# Smoke test of drtune's argument handling.  drtune is pointed at
+# drtune-launcher.sh in place of drrun, which checks the arguments it is
+# given and reports a statistic that is lowest for -max_trace_bbs 32.
+#
+# input:
+# * drtune = path to drtune
+# * launcher = path to the stand-in launcher
+
+# an invalid argument must print the usage message and fail
+execute_process(COMMAND ${drtune} -runs 0 -- true
+  RESULT_VARIABLE cmd_result
+  ERROR_VARIABLE cmd_err
+  OUTPUT_VARIABLE cmd_out)
+if (NOT cmd_result OR NOT "${cmd_err}" MATCHES "Usage:")
+  message(FATAL_ERROR "*** drtune accepted -runs 0 (${cmd_result}): ${cmd_err}***\n")
+endif ()
+
+execute_process(COMMAND ${drtune} -drrun ${launcher} -ops "-foo 1"
+  -runs 1 -rounds 1 -param max_trace_bbs 32,64 -weight num_fake 1 -- true
+  RESULT_VARIABLE cmd_result
+  ERROR_VARIABLE cmd_err
+  OUTPUT_VARIABLE cmd_out)
+if (cmd_result)
+  message(FATAL_ERROR "*** drtune failed (${cmd_result}): ${cmd_err}${cmd_out}***\n")
+endif (cmd_result)
+if (NOT "${cmd_out}" MATCHES "Recommended options: \"-max_trace_bbs 32\"")
+  message(FATAL_ERROR "*** unexpected drtune output: ${cmd_out}***\n")
+endif ()
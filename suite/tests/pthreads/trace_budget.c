@@ -0,0 +1,80 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Runs the same hot code in the main thread and then in a second thread,
+ * for -private_trace_budget: the main thread spends its budget before it
+ * gets there, so it must skip the hot heads without keeping the second
+ * thread from tracing them.
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+
+#define ITER 10000
+
+static int
+fib(int n)
+{
+    if (n <= 1)
+        return 1;
+    return fib(n-1) + fib(n-2);
+}
+
+static void *
+run_fib(void *arg)
+{
+    int i, t = 0;
+    for (i = 0; i < ITER; i++)
+        t = fib(12);
+    fprintf(stderr, "fib(12)=%d\n", t);
+    return NULL;
+}
+
+int
+main(void)
+{
+    pthread_t thread;
+    volatile int sum = 0;
+    int i;
+
+    /* a hot loop of our own to spend the budget on */
+    for (i = 0; i < ITER; i++)
+        sum += i;
+
+    run_fib(NULL);
+    if (pthread_create(&thread, NULL, run_fib, NULL) != 0) {
+        fprintf(stderr, "pthread_create failed\n");
+        return 1;
+    }
+    pthread_join(thread, NULL);
+    return 0;
+}
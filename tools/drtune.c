@@ -0,0 +1,432 @@
+/* **********************************************************
+ * Copyright (c) 2012 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* drtune.c
+ *
+ * Option-set tuner: runs a workload repeatedly under drrun with
+ * different cache and trace option values and recommends the option
+ * string that minimizes its cost.
+ *
+ * Each candidate option set is run -runs times with -rstats_to_stderr
+ * added, and its cost is the median wall-clock time plus any -weight
+ * terms applied to the release-build statistics DR prints at exit.
+ * The search is a coordinate descent: each parameter in turn is set to
+ * each of its candidate values while the others are held at the best
+ * values so far, and a value is kept only if it improves the cost by
+ * more than -min_gain percent.  Passes repeat until one makes no change
+ * or -rounds is reached.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_PARAMS 32
+#define MAX_VALUES 16
+#define MAX_WEIGHTS 16
+#define MAX_RUNS 32
+#define MAX_OPS_LEN 4096
+#define MAX_LINE_LEN 256
+#define STAT_NAME_MAX_LEN 50 /* matches dr_stats.h */
+
+#define STATS_BEGIN "(Begin) Release statistics"
+#define STATS_END "(End) Release statistics"
+
+typedef struct {
+    const char *name;
+    /* values[0] is the empty string, meaning DR's default */
+    const char *values[MAX_VALUES];
+    int num_values;
+    int best; /* index into values */
+} param_t;
+
+typedef struct {
+    char name[STAT_NAME_MAX_LEN];
+    double weight; /* cost in seconds per unit of the statistic */
+    long long value;
+} weight_t;
+
+/* Parameters searched when no -param is given.  Internal options such as
+ * -trace_threshold are left out as they are not accepted by release builds.
+ */
+static const struct {
+    const char *name;
+    const char *values;
+} default_params[] = {
+    {"max_trace_bbs",                "32,64,256"},
+    {"max_elide_jmp",                "0,4,32"},
+    {"max_elide_call",               "0,4,32"},
+    {"cache_shared_bb_unit_init",    "16K,32K"},
+    {"cache_shared_trace_unit_init", "16K,32K"},
+    {"cache_shared_bb_regen",        "10,40"},
+    {"cache_shared_trace_regen",     "5,20"},
+    {"shared_ibt_table_trace_init",  "8,10,12"},
+    {"coarse_htable_load",           "50,90"},
+};
+
+static param_t params[MAX_PARAMS];
+static int num_params;
+static weight_t weights[MAX_WEIGHTS];
+static int num_weights;
+
+static const char *drrun = "drrun";
+static const char *base_ops = "";
+static char **app_argv;
+static int runs = 3;
+static int rounds = 2;
+static double min_gain = 1.0; /* percent */
+static int verbose;
+
+static void
+info(const char *fmt, ...)
+{
+    va_list ap;
+    if (!verbose)
+        return;
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+static int
+usage(const char *us)
+{
+    fprintf(stderr, "Usage: %s [-drrun <path>] [-ops \"<base DR options>\"]\n"
+            "  [-runs N] [-rounds N] [-min_gain <percent>]\n"
+            "  [-param <option> <value1,value2,...>]...\n"
+            "  [-weight <stat> <seconds per unit>]... [-v]\n"
+            "  -- <program> <args...>\n", us);
+    return 1;
+}
+
+/***************************************************************************/
+/* option sets */
+
+/* splits a comma-separated value list; the list is not freed */
+static void
+add_param(const char *name, const char *list)
+{
+    param_t *p;
+    char *copy, *val;
+    if (num_params >= MAX_PARAMS) {
+        fprintf(stderr, "Too many parameters: ignoring %s\n", name);
+        return;
+    }
+    p = &params[num_params++];
+    p->name = name;
+    p->values[0] = "";
+    p->num_values = 1;
+    p->best = 0;
+    copy = strdup(list);
+    assert(copy != NULL);
+    for (val = strtok(copy, ","); val != NULL; val = strtok(NULL, ",")) {
+        if (p->num_values >= MAX_VALUES) {
+            fprintf(stderr, "Too many values for %s: ignoring %s\n", name, val);
+            break;
+        }
+        p->values[p->num_values++] = val;
+    }
+}
+
+/* Writes the option string selecting the current best value of every
+ * parameter except that param_idx, if not -1, uses value_idx instead.
+ * A value of "" leaves the option at its default and is not written.
+ */
+static void
+build_ops(char *buf, size_t bufsz, int param_idx, int value_idx)
+{
+    int i, len;
+    size_t sofar = 0;
+    buf[0] = '\0';
+    for (i = 0; i < num_params; i++) {
+        const char *val = params[i].values[i == param_idx ? value_idx : params[i].best];
+        if (val[0] == '\0')
+            continue;
+        len = snprintf(buf + sofar, bufsz - sofar, "%s-%s %s",
+                       sofar == 0 ? "" : " ", params[i].name, val);
+        if (len < 0 || (size_t)len >= bufsz - sofar) {
+            fprintf(stderr, "Option string too long\n");
+            exit(1);
+        }
+        sofar += len;
+    }
+}
+
+/***************************************************************************/
+/* running the workload */
+
+/* Reads the statistics block written by -rstats_to_stderr and fills in
+ * the value of each weighted statistic.  Returns whether the block was found.
+ */
+static int
+read_stats(FILE *f)
+{
+    char line[MAX_LINE_LEN];
+    int in_stats = 0, found = 0, i;
+    for (i = 0; i < num_weights; i++)
+        weights[i].value = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char name[MAX_LINE_LEN];
+        long long value;
+        if (strncmp(line, STATS_BEGIN, strlen(STATS_BEGIN)) == 0) {
+            in_stats = 1;
+            continue;
+        }
+        if (strncmp(line, STATS_END, strlen(STATS_END)) == 0) {
+            in_stats = 0;
+            found = 1;
+            continue;
+        }
+        if (!in_stats) {
+            /* the app's own stderr */
+            info("%s", line);
+            continue;
+        }
+        if (sscanf(line, " %255s = %lld", name, &value) != 2)
+            continue;
+        info("\t%s = %lld\n", name, value);
+        for (i = 0; i < num_weights; i++) {
+            if (strcmp(name, weights[i].name) == 0)
+                weights[i].value = value;
+        }
+    }
+    return found;
+}
+
+/* Runs the workload once with the given options.  Returns the elapsed
+ * wall-clock seconds, or a negative value if the run failed.
+ */
+static double
+run_once(const char *ops)
+{
+    char full_ops[MAX_OPS_LEN];
+    const char **argv;
+    int argc, i, fd, status, found;
+    FILE *f;
+    pid_t child;
+    struct timeval start, end;
+    char tmpname[] = "/tmp/drtune-XXXXXX";
+
+    snprintf(full_ops, sizeof(full_ops), "%s%s%s -rstats_to_stderr",
+             base_ops, base_ops[0] == '\0' ? "" : " ", ops);
+    full_ops[sizeof(full_ops) - 1] = '\0';
+    for (argc = 0; app_argv[argc] != NULL; argc++)
+        ; /* nothing */
+    argv = (const char **) malloc((argc + 5) * sizeof(char *));
+    assert(argv != NULL);
+    argv[0] = drrun;
+    argv[1] = "-ops";
+    argv[2] = full_ops;
+    argv[3] = "--";
+    for (i = 0; i <= argc; i++)
+        argv[4 + i] = app_argv[i];
+
+    /* stderr goes to a file to keep the statistics apart from our output */
+    fd = mkstemp(tmpname);
+    if (fd < 0) {
+        perror("ERROR creating temp file");
+        exit(1);
+    }
+    unlink(tmpname);
+
+    gettimeofday(&start, (struct timezone *) 0);
+    child = fork();
+    if (child < 0) {
+        perror("ERROR on fork");
+        exit(1);
+    } else if (child == 0) {
+        dup2(fd, 2);
+        if (!verbose) {
+            int null_fd = open("/dev/null", O_WRONLY);
+            if (null_fd >= 0)
+                dup2(null_fd, 1);
+        }
+        execvp(argv[0], (char **) argv);
+        perror("ERROR on execvp");
+        _exit(127);
+    }
+    if (waitpid(child, &status, 0) != child) {
+        perror("ERROR on waitpid");
+        exit(1);
+    }
+    gettimeofday(&end, (struct timezone *) 0);
+    free(argv);
+
+    lseek(fd, 0, SEEK_SET);
+    f = fdopen(fd, "r");
+    assert(f != NULL);
+    found = read_stats(f);
+    fclose(f);
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        info("run failed with status 0x%x\n", status);
+        return -1.0;
+    }
+    if (!found) {
+        fprintf(stderr, "No statistics from run: is %s a DynamoRIO launcher?\n",
+                drrun);
+        return -1.0;
+    }
+    return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+}
+
+static int
+compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Returns the cost of an option set, or a negative value if any run failed.
+ * The weighted statistics are taken from the last run.
+ */
+static double
+evaluate(const char *ops)
+{
+    double times[MAX_RUNS], cost;
+    int i;
+    printf("  trying \"%s\"", ops);
+    fflush(stdout);
+    for (i = 0; i < runs; i++) {
+        times[i] = run_once(ops);
+        if (times[i] < 0) {
+            printf(" => failed\n");
+            return -1.0;
+        }
+    }
+    qsort(times, runs, sizeof(times[0]), compare_double);
+    cost = times[runs / 2];
+    printf(" => %.3fs", cost);
+    for (i = 0; i < num_weights; i++) {
+        cost += weights[i].weight * weights[i].value;
+        printf(" %s=%lld", weights[i].name, weights[i].value);
+    }
+    printf(" cost %.3f\n", cost);
+    return cost;
+}
+
+/***************************************************************************/
+
+int
+main(int argc, char *argv[])
+{
+    int arg_offs = 1, round, i, v;
+    char ops[MAX_OPS_LEN];
+    double best_cost, base_cost;
+
+    while (arg_offs < argc && strcmp(argv[arg_offs], "--") != 0) {
+        if (strcmp(argv[arg_offs], "-drrun") == 0 && arg_offs + 1 < argc) {
+            drrun = argv[arg_offs + 1];
+            arg_offs += 2;
+        } else if (strcmp(argv[arg_offs], "-ops") == 0 && arg_offs + 1 < argc) {
+            base_ops = argv[arg_offs + 1];
+            arg_offs += 2;
+        } else if (strcmp(argv[arg_offs], "-runs") == 0 && arg_offs + 1 < argc) {
+            runs = atoi(argv[arg_offs + 1]);
+            if (runs < 1 || runs > MAX_RUNS)
+                return usage(argv[0]);
+            arg_offs += 2;
+        } else if (strcmp(argv[arg_offs], "-rounds") == 0 && arg_offs + 1 < argc) {
+            rounds = atoi(argv[arg_offs + 1]);
+            arg_offs += 2;
+        } else if (strcmp(argv[arg_offs], "-min_gain") == 0 && arg_offs + 1 < argc) {
+            min_gain = atof(argv[arg_offs + 1]);
+            arg_offs += 2;
+        } else if (strcmp(argv[arg_offs], "-param") == 0 && arg_offs + 2 < argc) {
+            add_param(argv[arg_offs + 1], argv[arg_offs + 2]);
+            arg_offs += 3;
+        } else if (strcmp(argv[arg_offs], "-weight") == 0 && arg_offs + 2 < argc) {
+            if (num_weights >= MAX_WEIGHTS)
+                return usage(argv[0]);
+            strncpy(weights[num_weights].name, argv[arg_offs + 1],
+                    sizeof(weights[num_weights].name));
+            weights[num_weights].name[sizeof(weights[num_weights].name) - 1] = '\0';
+            weights[num_weights].weight = atof(argv[arg_offs + 2]);
+            num_weights++;
+            arg_offs += 3;
+        } else if (strcmp(argv[arg_offs], "-v") == 0) {
+            verbose = 1;
+            arg_offs += 1;
+        } else
+            return usage(argv[0]);
+    }
+    if (arg_offs + 1 >= argc)
+        return usage(argv[0]);
+    app_argv = &argv[arg_offs + 1];
+
+    if (num_params == 0) {
+        for (i = 0; i < (int)(sizeof(default_params)/sizeof(default_params[0])); i++)
+            add_param(default_params[i].name, default_params[i].values);
+    }
+
+    printf("Baseline:\n");
+    build_ops(ops, sizeof(ops), -1, 0);
+    base_cost = best_cost = evaluate(ops);
+    if (best_cost < 0) {
+        fprintf(stderr, "The workload fails with the baseline options\n");
+        return 1;
+    }
+
+    for (round = 0; round < rounds; round++) {
+        int changed = 0;
+        printf("Round %d:\n", round + 1);
+        for (i = 0; i < num_params; i++) {
+            for (v = 0; v < params[i].num_values; v++) {
+                double cost;
+                if (v == params[i].best)
+                    continue;
+                build_ops(ops, sizeof(ops), i, v);
+                cost = evaluate(ops);
+                if (cost >= 0 && cost < best_cost * (1.0 - min_gain / 100.0)) {
+                    best_cost = cost;
+                    params[i].best = v;
+                    changed = 1;
+                }
+            }
+        }
+        if (!changed)
+            break;
+    }
+
+    build_ops(ops, sizeof(ops), -1, 0);
+    printf("Recommended options: \"%s\"\n", ops);
+    printf("Cost %.3f vs. baseline %.3f (%.1f%% better)\n", best_cost, base_cost,
+           base_cost > 0 ? 100.0 * (base_cost - best_cost) / base_cost : 0.0);
+    return 0;
+}